@@ -1,6 +1,13 @@
 #include "graph_io.h"
+#include "kernel.h"
+#include "output_cache.h"
 #include "picojson.h"
+#include "plugin_host.h"
+#include "ui_evaluator.h"
 #include "ui_library.h"
+#include "ui_library_matches.h"
+#include "ui_minimap.h"
+#include "ui_registry_watcher.h"
 #include "ui_scene.h"
 #include "ui_tree_filter.h"
 #include "ui_view.h"
@@ -10,8 +17,11 @@
 
 #include "QtWidgets/QApplication"
 #include "QtWidgets/QDockWidget"
+#include "QtWidgets/QLabel"
 #include "QtWidgets/QLineEdit"
+#include "QtWidgets/QListView"
 #include "QtWidgets/QMainWindow"
+#include "QtWidgets/QStatusBar"
 #include "QtWidgets/QTreeView"
 #include "QtWidgets/QVboxLayout"
 
@@ -42,7 +52,33 @@ void save(picojson::object const &config, std::string const &config_file)
   }
 }
 
-void setup_ui(ui_view *scene_view, ui_library_model *library_model)
+size_t const max_expanded_matches = 500;
+
+void expand_all(QTreeView *view, QAbstractItemModel *model, QModelIndex const &parent)
+{
+  if(model->canFetchMore(parent))
+  {
+    model->fetchMore(parent);
+  }
+  for(int row{}; row < model->rowCount(parent); ++row)
+  {
+    auto index = model->index(row, 0, parent);
+    if(model->hasChildren(index))
+    {
+      view->expand(index);
+      expand_all(view, model, index);
+    }
+  }
+}
+
+kernel_registry make_kernels(type_registry const &registry)
+{
+  kernel_registry kernels;
+  add_builtin_kernels(kernels, registry);
+  return kernels;
+}
+
+void setup_ui(ui_scene *scene, ui_view *scene_view, ui_library_model *library_model, ui_evaluator *evaluator)
 {
   auto window = new QMainWindow;
   window->setObjectName("Skadi");
@@ -61,6 +97,8 @@ void setup_ui(ui_view *scene_view, ui_library_model *library_model)
 
   auto library_filter = new QLineEdit(dock_widget);
   dock_layout->addWidget(library_filter);
+  auto best_matches_view = new QListView(dock_widget);
+  dock_layout->addWidget(best_matches_view);
   auto library_view = new QTreeView(dock_widget);
   dock_layout->addWidget(library_view);
   library_view->setHeaderHidden(true);
@@ -68,8 +106,53 @@ void setup_ui(ui_view *scene_view, ui_library_model *library_model)
   auto filtered_library_model = new ui_tree_filter(library_view);
   filtered_library_model->setSourceModel(library_model);
   library_view->setModel(filtered_library_model);
-  library_view->expandAll();
-  QObject::connect(library_filter, &QLineEdit::textChanged, filtered_library_model, &ui_tree_filter::setFilterWildcard);
+  QObject::connect(library_filter, &QLineEdit::textChanged, filtered_library_model, &ui_tree_filter::set_query);
+  QObject::connect(filtered_library_model, &QAbstractItemModel::modelReset, library_view, [=]
+  {
+    // categories are fetched lazily, so only a few filtered results are expanded
+    if(filtered_library_model->is_filtered() && filtered_library_model->get_match_count() <= max_expanded_matches)
+    {
+      expand_all(library_view, filtered_library_model, {});
+    }
+  });
+
+  // ranked matches above the tree, only while there is a query
+  auto best_matches = new ui_library_matches(library_model, filtered_library_model, best_matches_view);
+  best_matches_view->setModel(best_matches);
+  best_matches_view->setDragEnabled(true);
+  best_matches_view->setMaximumHeight(160);
+  best_matches_view->hide();
+  QObject::connect(best_matches, &QAbstractItemModel::modelReset, best_matches_view, [=]
+  {
+    best_matches_view->setVisible(best_matches->rowCount() > 0);
+  });
+
+  auto minimap_dock = new QDockWidget(window);
+  window->addDockWidget(Qt::RightDockWidgetArea, minimap_dock);
+  minimap_dock->setFeatures(QDockWidget::DockWidgetMovable | QDockWidget::DockWidgetFloatable | QDockWidget::DockWidgetClosable);
+  minimap_dock->setWidget(new ui_minimap(scene, scene_view, minimap_dock));
+
+  QObject::connect(evaluator, &ui_evaluator::evaluated, window->statusBar(), [=](QString summary)
+  {
+    window->statusBar()->showMessage(summary);
+  });
+  QObject::connect(scene_view, &ui_view::profile_saved, window->statusBar(), [=](QString message)
+  {
+    window->statusBar()->showMessage(message);
+  });
+
+  // errors of the content stay visible next to the evaluation summaries, the details go
+  // to the log
+  auto content_errors = new QLabel(window->statusBar());
+  window->statusBar()->addPermanentWidget(content_errors);
+  QObject::connect(scene, &ui_scene::content_checked, content_errors, [=](QStringList errors)
+  {
+    for(auto &&error : errors)
+    {
+      std::cerr << "error: " << error.toStdString() << std::endl;
+    }
+    content_errors->setText(errors.isEmpty() ? QString() : QString("%1 errors").arg(errors.size()));
+  });
 
   window->show();
 }
@@ -79,30 +162,125 @@ try
 {
   QApplication app{argc, argv};
 
-  auto config_file = (argc > 1) ? argv[1] : "test.json";
+  // usage: skadi [--opengl] [--virtualized] [--profile] [--profile-file file] [--plugins directory]
+  //              [--cache directory] [config_file]
+  // the renderer can also be selected with SKADI_RENDER_MODE=opengl
+  std::string config_file = "test.json";
+  bool use_opengl = (qgetenv("SKADI_RENDER_MODE") == "opengl");
+  bool use_virtualized_scene = false;
+  bool use_profiler = false;
+  std::string profile_file;
+  std::string plugin_directory;
+  std::string cache_directory;
+  for(int i = 1; i < argc; ++i)
+  {
+    if(std::string(argv[i]) == "--opengl")
+    {
+      use_opengl = true;
+    }
+    else if(std::string(argv[i]) == "--virtualized")
+    {
+      use_virtualized_scene = true;
+    }
+    else if(std::string(argv[i]) == "--profile")
+    {
+      use_profiler = true;
+    }
+    else if((std::string(argv[i]) == "--profile-file") && (i + 1 < argc))
+    {
+      profile_file = argv[++i];
+    }
+    else if((std::string(argv[i]) == "--plugins") && (i + 1 < argc))
+    {
+      plugin_directory = argv[++i];
+    }
+    else if((std::string(argv[i]) == "--cache") && (i + 1 < argc))
+    {
+      cache_directory = argv[++i];
+    }
+    else
+    {
+      config_file = argv[i];
+    }
+  }
+
   auto config = load_config(config_file);
-  auto type_registry = load_type_registry(config["type_registry"]);
+  // only the manifests of plugins are read here, libraries are loaded on first use
+  plugin_host plugins;
+  if(!plugin_directory.empty())
+  {
+    for(auto &&problem : plugins.discover(plugin_directory))
+    {
+      std::cerr << "skipping plugin " << problem << std::endl;
+    }
+  }
+  auto const add_plugin_types = [&](type_registry &registry) { plugins.add_types(registry); };
+
+  auto loaded_registry = load_type_registry(config["type_registry"]);
+  add_plugin_types(loaded_registry);
+  auto registry = std::make_shared<type_registry const>(std::move(loaded_registry));
 
-  ui_scene scene(type_registry);
+  ui_scene scene(*registry);
+  QObject::connect(&scene, &ui_scene::node_type_used, [&](node_type_id id)
+  {
+    if(plugins.is_provided(id) && !plugins.is_loaded(id))
+    {
+      try
+      {
+        plugins.load(id);
+      }
+      catch(std::runtime_error &e)
+      {
+        std::cerr << "loading plugin failed: " << e.what() << std::endl;
+      }
+    }
+  });
+  scene.set_virtualized(use_virtualized_scene);
   ui_view view(&scene);
+  if(use_opengl && (view.set_render_mode(render_mode::opengl) != render_mode::opengl))
+  {
+    std::cerr << "OpenGL is not available, falling back to raster rendering" << std::endl;
+  }
+  view.set_profiler_enabled(use_profiler);
+  if(!profile_file.empty())
+  {
+    view.set_profile_file(QString::fromStdString(profile_file));
+  }
+
+  ui_library_model library_model(registry);
+  // outputs spilled to the cache directory are reused by later sessions
+  output_cache cache(size_t{256} << 20, cache_directory);
+  ui_evaluator evaluator(&scene, *registry, make_kernels(*registry));
+  evaluator.set_cache(&cache);
+  evaluator.set_plugins(&plugins);
+
+  // edits of the type registry in the config file are applied while running
+  ui_registry_watcher registry_watcher(QString::fromStdString(config_file), registry, config["type_registry"]);
+  registry_watcher.set_extension(add_plugin_types);
+  QObject::connect(&registry_watcher, &ui_registry_watcher::registry_changed, [&](std::shared_ptr<type_registry const> new_registry, registry_diff const &diff)
+  {
+    scene.update_registry(*new_registry, diff);
+    library_model.update_registry(new_registry, diff);
+    evaluator.reset(*new_registry, make_kernels(*new_registry));
+  });
+
+  // before loading, so the check of the content is shown
+  setup_ui(&scene, &view, &library_model, &evaluator);
 
-  ui_library_model library_model(type_registry);
-  
   try
   {
     scene.set_content(load_graph(config["graph"]));
     scene.set_layout(load_graph_layout(config["layout"]));
-    view.centerOn(scene.itemsBoundingRect().center());
+    view.centerOn(scene.content_bounds().center());
   }
   catch(std::runtime_error &)
   {
     // nothing to be done - just start fresh if it failed
   }
-  
-  setup_ui(&view, &library_model);
 
   int result = app.exec();
 
+  config["type_registry"] = registry_watcher.get_registry_config();
   config["layout"] = save(scene.get_layout());
   config["graph"] = save(scene.get_content());
   save(config, config_file);
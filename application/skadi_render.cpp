@@ -0,0 +1,330 @@
+#include "graph_io.h"
+#include "picojson.h"
+#include "ui_scene.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "QtCore/QDir"
+#include "QtCore/QFileInfo"
+#include "QtCore/QProcess"
+#include "QtCore/QThread"
+#include "QtGui/QImage"
+#include "QtGui/QPainter"
+#include "QtSvg/QSvgGenerator"
+#include "QtWidgets/QApplication"
+
+using namespace skadi;
+
+// Renders graph files to images without a display.
+// usage: skadi_render [--format png|svg] [--jobs n] [--scale factor] [--output dir] config_file...
+// the files are split among n worker processes (default: one per core); each image is
+// written to the output directory with the name of its config file, so config files with
+// the same name are rejected.
+
+namespace constants
+{
+  static qreal const margin = 20;
+  static qreal const default_scale = 1;
+  static int const max_image_size = 16384;
+  static QColor const background_color(50, 50, 50);
+  static char const *const worker_argument = "--worker";
+  static char const *const usage = "usage: skadi_render [--format png|svg] [--jobs n] [--scale factor] [--output dir] config_file...";
+}
+
+namespace
+{
+  struct options
+  {
+    std::string format = "png";
+    std::string output = ".";
+    qreal scale = constants::default_scale;
+    int jobs = 0;
+    bool is_worker = false;
+    std::vector<std::string> files;
+  };
+
+  // the usage is printed along with it
+  struct usage_error
+    : std::runtime_error
+  {
+    using std::runtime_error::runtime_error;
+  };
+
+  // all of the text has to be a number
+  template<typename T, typename F>
+  T parse_number(std::string const &arg, std::string const &text, F convert)
+  {
+    try
+    {
+      size_t parsed{};
+      auto const result = convert(text, &parsed);
+      if(parsed == text.size())
+      {
+        return result;
+      }
+    }
+    catch(std::exception &)
+    {
+    }
+    throw usage_error("invalid value " + text + " for " + arg);
+  }
+
+  options parse_options(int argc, char *argv[])
+  {
+    options result{};
+    for(int i = 1; i < argc; ++i)
+    {
+      std::string const arg = argv[i];
+      auto const value = [&]
+      {
+        if(i + 1 >= argc)
+        {
+          throw usage_error("missing value for " + arg);
+        }
+        return std::string(argv[++i]);
+      };
+
+      if(arg == "--format")
+      {
+        result.format = value();
+        if(result.format != "png" && result.format != "svg")
+        {
+          throw usage_error("unknown format " + result.format);
+        }
+      }
+      else if(arg == "--jobs")
+      {
+        result.jobs = parse_number<int>(arg, value(), [](auto &&text, size_t *parsed) { return std::stoi(text, parsed); });
+      }
+      else if(arg == "--scale")
+      {
+        result.scale = parse_number<qreal>(arg, value(), [](auto &&text, size_t *parsed) { return std::stod(text, parsed); });
+        if(!(result.scale > 0))
+        {
+          throw usage_error("the scale has to be positive");
+        }
+      }
+      else if(arg == "--output")
+      {
+        result.output = value();
+      }
+      else if(arg == constants::worker_argument)
+      {
+        result.is_worker = true;
+      }
+      else
+      {
+        result.files.push_back(arg);
+      }
+    }
+
+    if(result.files.empty())
+    {
+      throw usage_error("no config file");
+    }
+    if(result.jobs <= 0)
+    {
+      result.jobs = std::max(1, QThread::idealThreadCount());
+    }
+    return result;
+  }
+
+  picojson::object load_config(std::string const &config_file)
+  {
+    std::ifstream fs(config_file);
+    if(!fs)
+    {
+      throw std::runtime_error("cannot open " + config_file);
+    }
+    picojson::value v;
+    fs >> v;
+    auto err = picojson::get_last_error();
+    if(!err.empty())
+    {
+      throw std::runtime_error(err);
+    }
+    return v.get<picojson::object>();
+  }
+
+  QString get_output_file(std::string const &config_file, options const &opts)
+  {
+    return QDir(QString::fromStdString(opts.output))
+           .filePath(QFileInfo(QString::fromStdString(config_file)).completeBaseName() + "." + QString::fromStdString(opts.format));
+  }
+
+  // before any work is split, so no image overwrites another; lists the collisions
+  bool check_output_files(options const &opts)
+  {
+    auto is_unique = true;
+    std::map<QString, std::string> sources;
+    for(auto &&file : opts.files)
+    {
+      auto const output = QFileInfo(get_output_file(file, opts)).absoluteFilePath();
+      auto [it, is_new] = sources.emplace(output, file);
+      if(!is_new)
+      {
+        std::cerr << it->second << " and " << file << " would both be written to " << output.toStdString() << std::endl;
+        is_unique = false;
+      }
+    }
+    return is_unique;
+  }
+
+  void render_file(std::string const &config_file, options const &opts)
+  {
+    auto config = load_config(config_file);
+
+    ui_scene scene(load_type_registry(config["type_registry"]));
+    scene.set_content(load_graph(config["graph"]));
+    if(config.count("layout"))
+    {
+      scene.set_layout(load_graph_layout(config["layout"]));
+    }
+    scene.finish_routing();
+
+    auto const source = scene.itemsBoundingRect().adjusted(-constants::margin, -constants::margin, constants::margin, constants::margin);
+    auto const target_size = (source.size() * opts.scale).toSize().boundedTo({constants::max_image_size, constants::max_image_size});
+    QRectF const target(QPointF(), target_size);
+
+    auto const output = get_output_file(config_file, opts);
+
+    if(opts.format == "svg")
+    {
+      QSvgGenerator generator;
+      generator.setFileName(output);
+      generator.setSize(target_size);
+      generator.setViewBox(target);
+      QPainter painter(&generator);
+      painter.fillRect(target, constants::background_color);
+      scene.render(&painter, target, source);
+      return;
+    }
+
+    QImage image(target_size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(constants::background_color);
+    {
+      QPainter painter(&image);
+      painter.setRenderHint(QPainter::Antialiasing);
+      scene.render(&painter, target, source);
+    }
+    if(!image.save(output))
+    {
+      throw std::runtime_error("cannot write " + output.toStdString());
+    }
+  }
+
+  // returns the number of files which failed
+  int render_files(options const &opts)
+  {
+    int failed{};
+    for(auto &&file : opts.files)
+    {
+      try
+      {
+        render_file(file, opts);
+      }
+      catch(std::exception &e)
+      {
+        std::cerr << file << ": " << e.what() << std::endl;
+        ++failed;
+      }
+    }
+    return failed;
+  }
+
+  // splits the files among worker processes running this executable
+  int run_workers(options const &opts)
+  {
+    auto const job_count = std::min<size_t>(opts.jobs, opts.files.size());
+    std::vector<QStringList> arguments(job_count);
+    std::vector<int> file_counts(job_count);
+    for(auto &&args : arguments)
+    {
+      args << constants::worker_argument
+           << "--format" << QString::fromStdString(opts.format)
+           << "--scale" << QString::number(opts.scale)
+           << "--output" << QString::fromStdString(opts.output);
+    }
+    for(size_t i{}; i < opts.files.size(); ++i)
+    {
+      arguments[i % job_count] << QString::fromStdString(opts.files[i]);
+      ++file_counts[i % job_count];
+    }
+
+    std::vector<std::unique_ptr<QProcess>> workers;
+    for(auto &&args : arguments)
+    {
+      workers.push_back(std::make_unique<QProcess>());
+      workers.back()->setProcessChannelMode(QProcess::ForwardedChannels);
+      workers.back()->start(QCoreApplication::applicationFilePath(), args);
+    }
+
+    int failed{};
+    for(size_t i{}; i < workers.size(); ++i)
+    {
+      auto &&worker = workers[i];
+      worker->waitForFinished(-1);
+      if(worker->exitStatus() != QProcess::NormalExit || worker->error() == QProcess::FailedToStart)
+      {
+        // a crashed worker might have rendered some of its files, but none can be trusted
+        std::cerr << "worker " << i << " failed" << std::endl;
+        failed += file_counts[i];
+      }
+      else
+      {
+        failed += worker->exitCode();
+      }
+    }
+    return failed;
+  }
+}
+
+int main(int argc, char *argv[])
+try
+{
+  // no display is needed unless a platform was requested explicitly
+  if(qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+  {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+  QApplication app{argc, argv};
+
+  auto const opts = parse_options(argc, argv);
+  if(opts.is_worker)
+  {
+    return std::min(render_files(opts), 255);
+  }
+
+  if(!check_output_files(opts))
+  {
+    return 1;
+  }
+  QDir().mkpath(QString::fromStdString(opts.output));
+
+  auto const start = std::chrono::steady_clock::now();
+  auto const failed = (opts.jobs > 1 && opts.files.size() > 1) ? run_workers(opts) : render_files(opts);
+  auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  auto const rendered = static_cast<int>(opts.files.size()) - failed;
+  std::cout << "rendered " << rendered << " of " << opts.files.size() << " files in " << seconds << " s ("
+            << rendered / seconds << " files/s)" << std::endl;
+  return failed ? 1 : 0;
+}
+catch(usage_error &e)
+{
+  std::cerr << "skadi_render: " << e.what() << "\n" << constants::usage << std::endl;
+  return 1;
+}
+catch(std::exception &e)
+{
+  std::cerr << "unhandled exception: " << e.what() << std::endl;
+  return 1;
+}
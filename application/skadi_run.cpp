@@ -0,0 +1,466 @@
+#include "engine.h"
+#include "graph_io.h"
+#include "kernel.h"
+#include "optimizer.h"
+#include "output_cache.h"
+#include "picojson.h"
+#include "plugin_host.h"
+#include "scheduler.h"
+#include "type_system.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace skadi;
+
+// Executes the graph of a config file without a display and writes the outputs of all
+// nodes with the time each took to compute.
+// usage: skadi_run [--threads n] [--format json|binary] [--output file] [--timings]
+//                  [--optimize] [--cache directory] [--plugins directory] [--strict] config_file
+//        skadi_run --help
+// --threads 1 runs on the calling thread, 0 (the default) on all hardware threads.
+// --plugins adds the node types of the plugins in a directory; the libraries providing
+// the ones in the graph are loaded before it runs.
+// --timings lists the nodes by time on stderr, slowest first.
+// Type errors are listed on stderr, with --strict they fail the run as an invalid graph.
+// The binary format is little endian: "SKR1", the node count as uint32, and per node its
+// id and nanoseconds as int64 and the output count as uint32, followed by the data type
+// guid as int64, a tag byte (0 empty, 1 int64, 2 double, 3 other data) and an 8-byte
+// payload per output.
+// The exit code tells what failed, see constants.
+
+namespace constants
+{
+  static int const exit_success = 0;
+  static int const exit_usage = 1;
+  static int const exit_load_failed = 2; // config, type registry, graph or plugins unreadable
+  static int const exit_invalid_graph = 3; // unknown types or ports, cycles, missing kernels
+  static int const exit_kernel_failed = 4;
+  static int const exit_output_failed = 5;
+  static uint32_t const binary_magic = 0x31524b53; // "SKR1"
+  static size_t const cache_budget = size_t{256} << 20;
+  static char const *const usage = "usage: skadi_run [--threads n] [--format json|binary] [--output file] [--timings] [--optimize] [--cache directory] [--plugins directory] [--strict] config_file";
+}
+
+namespace
+{
+  struct options
+  {
+    bool is_help_shown = false;
+    int threads = 0;
+    std::string format = "json";
+    std::string output;
+    bool is_timing_listed = false;
+    bool is_optimized = false;
+    std::string cache;
+    std::string plugins;
+    bool is_strict = false;
+    std::string config_file;
+  };
+
+  // thrown with the exit code for the failure
+  struct run_error
+    : std::runtime_error
+  {
+    run_error(int code, std::string const &message)
+      : std::runtime_error(message)
+      , code(code)
+    {
+    }
+
+    int code;
+  };
+
+  options parse_options(int argc, char *argv[])
+  {
+    options result{};
+    for(int i = 1; i < argc; ++i)
+    {
+      std::string const arg = argv[i];
+      auto const value = [&]
+      {
+        if(i + 1 >= argc)
+        {
+          throw run_error(constants::exit_usage, "missing value for " + arg);
+        }
+        return std::string(argv[++i]);
+      };
+
+      if((arg == "--help") || (arg == "-h"))
+      {
+        result.is_help_shown = true;
+        return result;
+      }
+      else if(arg == "--threads")
+      {
+        auto const text = value();
+        size_t parsed{};
+        try
+        {
+          result.threads = std::stoi(text, &parsed);
+        }
+        catch(std::exception &)
+        {
+          parsed = 0;
+        }
+        if((parsed == 0) || (parsed != text.size()) || (result.threads < 0))
+        {
+          throw run_error(constants::exit_usage, "invalid thread count " + text);
+        }
+      }
+      else if(arg == "--format")
+      {
+        result.format = value();
+        if(result.format != "json" && result.format != "binary")
+        {
+          throw run_error(constants::exit_usage, "unknown format " + result.format);
+        }
+      }
+      else if(arg == "--output")
+      {
+        result.output = value();
+      }
+      else if(arg == "--timings")
+      {
+        result.is_timing_listed = true;
+      }
+      else if(arg == "--optimize")
+      {
+        result.is_optimized = true;
+      }
+      else if(arg == "--cache")
+      {
+        result.cache = value();
+      }
+      else if(arg == "--plugins")
+      {
+        result.plugins = value();
+      }
+      else if(arg == "--strict")
+      {
+        result.is_strict = true;
+      }
+      else if((arg.size() > 1) && (arg[0] == '-'))
+      {
+        throw run_error(constants::exit_usage, "unknown option " + arg);
+      }
+      else if(result.config_file.empty())
+      {
+        result.config_file = arg;
+      }
+      else
+      {
+        throw run_error(constants::exit_usage, "more than one config file");
+      }
+    }
+
+    if(result.config_file.empty())
+    {
+      throw run_error(constants::exit_usage, "no config file");
+    }
+    return result;
+  }
+
+  picojson::object load_config(std::string const &config_file)
+  {
+    std::ifstream fs(config_file);
+    if(!fs)
+    {
+      throw run_error(constants::exit_load_failed, "cannot open " + config_file);
+    }
+    picojson::value v;
+    fs >> v;
+    auto err = picojson::get_last_error();
+    if(!err.empty() || !v.is<picojson::object>())
+    {
+      throw run_error(constants::exit_load_failed, config_file + ": " + (err.empty() ? "not an object" : err));
+    }
+    return v.get<picojson::object>();
+  }
+
+  struct node_result
+  {
+    node_instance_id id;
+    node_type const *type;
+    std::chrono::nanoseconds duration;
+    std::vector<value> outputs;
+  };
+
+  picojson::value save(value const &v)
+  {
+    if(auto i = std::get_if<int64_t>(&v.data))
+    {
+      return picojson::value(*i);
+    }
+    if(auto f = std::get_if<double>(&v.data))
+    {
+      return picojson::value(*f);
+    }
+    if(is_empty(v))
+    {
+      return {};
+    }
+    return picojson::value("<data>");
+  }
+
+  void write_json(std::ostream &os, std::vector<node_result> const &results, std::chrono::nanoseconds total)
+  {
+    picojson::array nodes;
+    for(auto &&r : results)
+    {
+      picojson::object outputs;
+      for(size_t i{}; i < r.outputs.size(); ++i)
+      {
+        outputs[r.type->outputs[i].name] = save(r.outputs[i]);
+      }
+      picojson::object n;
+      n["uid"] = picojson::value(r.id.id);
+      n["type"] = picojson::value(r.type->name);
+      n["ms"] = picojson::value(std::chrono::duration<double, std::milli>(r.duration).count());
+      n["outputs"] = picojson::value(outputs);
+      nodes.push_back(picojson::value(n));
+    }
+    picojson::object result;
+    result["ms"] = picojson::value(std::chrono::duration<double, std::milli>(total).count());
+    result["nodes"] = picojson::value(nodes);
+    picojson::value(result).serialize(std::ostreambuf_iterator<char>(os), true);
+  }
+
+  // least significant byte first, whatever the byte order of the machine
+  template<typename T>
+  void write(std::ostream &os, T v)
+  {
+    static_assert(std::is_integral_v<T>, "only integers have a fixed layout");
+    auto const bits = static_cast<uint64_t>(static_cast<std::make_unsigned_t<T>>(v));
+    char bytes[sizeof(T)];
+    for(size_t i{}; i < sizeof(T); ++i)
+    {
+      bytes[i] = static_cast<char>((bits >> (8 * i)) & 0xff);
+    }
+    os.write(bytes, sizeof(bytes));
+  }
+
+  void write_binary(std::ostream &os, std::vector<node_result> const &results)
+  {
+    write(os, constants::binary_magic);
+    write(os, static_cast<uint32_t>(results.size()));
+    for(auto &&r : results)
+    {
+      write(os, r.id.id);
+      write(os, static_cast<int64_t>(r.duration.count()));
+      write(os, static_cast<uint32_t>(r.outputs.size()));
+      for(auto &&v : r.outputs)
+      {
+        uint8_t tag = 3;
+        uint64_t payload{};
+        if(auto i = std::get_if<int64_t>(&v.data))
+        {
+          tag = 1;
+          payload = static_cast<uint64_t>(*i);
+        }
+        else if(auto f = std::get_if<double>(&v.data))
+        {
+          tag = 2;
+          std::memcpy(&payload, f, sizeof(payload));
+        }
+        else if(is_empty(v))
+        {
+          tag = 0;
+        }
+        write(os, v.type.guid);
+        write(os, tag);
+        write(os, payload);
+      }
+    }
+  }
+
+  void list_timings(std::vector<node_result> results, std::chrono::nanoseconds total)
+  {
+    std::sort(begin(results), end(results), [](auto &&a, auto &&b) { return a.duration > b.duration; });
+    std::cerr << "total " << std::chrono::duration<double, std::milli>(total).count() << " ms\n";
+    for(auto &&r : results)
+    {
+      std::cerr << std::chrono::duration<double, std::milli>(r.duration).count() << " ms\tnode " << r.id.id << " (" << r.type->name << ")\n";
+    }
+  }
+
+  int run(options const &opts)
+  {
+    auto config = load_config(opts.config_file);
+    type_registry registry;
+    graph content;
+    try
+    {
+      registry = load_type_registry(config["type_registry"]);
+      content = load_graph(config["graph"]);
+    }
+    catch(std::exception &e)
+    {
+      throw run_error(constants::exit_load_failed, opts.config_file + ": " + e.what());
+    }
+
+    // before the kernels, which must not outlive it
+    plugin_host plugins;
+    if(!opts.plugins.empty())
+    {
+      for(auto &&problem : plugins.discover(opts.plugins))
+      {
+        std::cerr << "skipping plugin " << problem << "\n";
+      }
+      plugins.add_types(registry);
+      try
+      {
+        for(auto &&n : content.nodes)
+        {
+          if(plugins.is_provided(n.type))
+          {
+            plugins.load(n.type);
+          }
+        }
+      }
+      catch(std::exception &e)
+      {
+        throw run_error(constants::exit_load_failed, e.what());
+      }
+    }
+
+    type_system types(registry);
+    auto type_errors = types.get_registry_errors();
+    for(auto &&error : types.check(content))
+    {
+      type_errors.push_back("connection " + std::to_string(error.connection.id) + ": " + error.message);
+    }
+    for(auto &&error : type_errors)
+    {
+      std::cerr << "type error: " << error << "\n";
+    }
+    if(opts.is_strict && !type_errors.empty())
+    {
+      throw run_error(constants::exit_invalid_graph, std::to_string(type_errors.size()) + " type errors");
+    }
+
+    kernel_registry kernels;
+    add_builtin_kernels(kernels, registry);
+    plugins.add_kernels(kernels);
+
+    // checked up front, so that errors in the graph are told apart from failing kernels
+    optimized_graph o{content, registry, kernels, 0, 0, 0};
+    try
+    {
+      if(opts.is_optimized)
+      {
+        o = optimize(content, registry, kernels, execution_target::values);
+        std::cerr << o.removed_count << " nodes removed, " << o.folded_count << " folded, " << o.fused_count << " fused\n";
+      }
+      compile(o.content, o.registry, o.kernels);
+    }
+    catch(std::exception &e)
+    {
+      throw run_error(constants::exit_invalid_graph, e.what());
+    }
+
+    std::unique_ptr<output_cache> cache;
+    if(!opts.cache.empty())
+    {
+      cache = std::make_unique<output_cache>(constants::cache_budget, opts.cache);
+    }
+
+    engine e(o.registry, o.kernels);
+    e.set_cache(cache.get());
+    e.set_timing_enabled(true);
+    e.load(o.content);
+
+    auto const start = std::chrono::steady_clock::now();
+    try
+    {
+      if(opts.threads == 1)
+      {
+        e.run();
+      }
+      else
+      {
+        scheduler pool(opts.threads);
+        e.run(pool);
+      }
+    }
+    catch(std::exception &e)
+    {
+      throw run_error(constants::exit_kernel_failed, e.what());
+    }
+    auto const total = std::chrono::steady_clock::now() - start;
+
+    std::vector<node_result> results;
+    for(auto &&n : o.content.nodes)
+    {
+      auto type = std::find_if(begin(o.registry.node_types), end(o.registry.node_types), [&](auto &&t) { return t.guid.guid == n.type.guid; });
+      auto const outputs = e.get_outputs(n.uid);
+      results.push_back({n.uid, &*type, e.get_duration(n.uid), {outputs.begin(), outputs.end()}});
+    }
+
+    if(opts.is_timing_listed)
+    {
+      list_timings(results, total);
+    }
+
+    std::ofstream file;
+    if(!opts.output.empty())
+    {
+      file.open(opts.output, std::ios::binary);
+      if(!file)
+      {
+        throw run_error(constants::exit_output_failed, "cannot write " + opts.output);
+      }
+    }
+    auto &&os = opts.output.empty() ? std::cout : file;
+    if(opts.format == "binary")
+    {
+      write_binary(os, results);
+    }
+    else
+    {
+      write_json(os, results, total);
+      os << "\n";
+    }
+    os.flush();
+    if(!os)
+    {
+      throw run_error(constants::exit_output_failed, "writing the results failed");
+    }
+    return constants::exit_success;
+  }
+}
+
+int main(int argc, char *argv[])
+try
+{
+  auto const opts = parse_options(argc, argv);
+  if(opts.is_help_shown)
+  {
+    std::cout << constants::usage << std::endl;
+    return constants::exit_success;
+  }
+  return run(opts);
+}
+catch(run_error &e)
+{
+  std::cerr << "skadi_run: " << e.what() << std::endl;
+  if(e.code == constants::exit_usage)
+  {
+    std::cerr << constants::usage << std::endl;
+  }
+  return e.code;
+}
+catch(std::exception &e)
+{
+  std::cerr << "unhandled exception: " << e.what() << std::endl;
+  return constants::exit_usage;
+}
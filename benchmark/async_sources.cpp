@@ -0,0 +1,149 @@
+#include "engine.h"
+#include "reactor.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace skadi;
+
+// Runs a graph of many slow sources, e.g. network reads, each feeding a node of CPU work,
+// on a scheduler. Blocking sources sleep on a worker for their delay; asynchronous ones
+// wait for a timer of a reactor and free the worker meanwhile. Reports the wall time and
+// how busy the workers were with actual work.
+// usage: benchmark_async_sources [source_count] [delay_ms] [work_us] [threads]
+
+namespace
+{
+  int const repetitions = 3;
+
+  node_type_id const source_type{0};
+  node_type_id const work_type{1};
+  node_type_id const sink_type{2};
+
+  type_registry make_registry()
+  {
+    data_type_id const number{0};
+    type_registry registry;
+    registry.data_types.push_back({number, "float"});
+    registry.node_types.push_back({source_type, "source", "", {}, {{number, "value"}}});
+    registry.node_types.push_back({work_type, "work", "", {{number, "value"}}, {{number, "value"}}});
+    registry.node_types.push_back({sink_type, "sink", "", {{number, "value"}}, {}});
+    return registry;
+  }
+
+  // spins for the given time, so it occupies a worker like real work
+  double spin(std::chrono::microseconds work, double x)
+  {
+    auto const stop = std::chrono::steady_clock::now() + work;
+    while(std::chrono::steady_clock::now() < stop)
+    {
+      for(int i{}; i < 100; ++i)
+      {
+        x = std::sqrt(x * x + 1e-9);
+      }
+    }
+    return x;
+  }
+
+  void add_work_kernels(kernel_registry &kernels, std::chrono::microseconds work, std::atomic<int64_t> &busy)
+  {
+    kernels.add(work_type, [work, &busy](auto &&inputs, auto &&outputs)
+    {
+      auto const start = std::chrono::steady_clock::now();
+      outputs[0].data = spin(work, get_float(inputs[0]));
+      busy += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    });
+    kernels.add(sink_type, [](auto &&, auto &&) {});
+  }
+
+  graph make_graph(int source_count)
+  {
+    graph g;
+    int64_t next_connection{};
+    for(int i{}; i < source_count; ++i)
+    {
+      node_instance_id const source{3 * int64_t{i}};
+      node_instance_id const work{3 * int64_t{i} + 1};
+      node_instance_id const sink{3 * int64_t{i} + 2};
+      g.nodes.push_back({source, source_type});
+      g.nodes.push_back({work, work_type});
+      g.nodes.push_back({sink, sink_type});
+      g.connections.push_back({{next_connection++}, source, "value", work, "value"});
+      g.connections.push_back({{next_connection++}, work, "value", sink, "value"});
+    }
+    return g;
+  }
+
+  void run(std::string const &name, kernel_registry kernels, std::atomic<int64_t> &busy, int source_count, int threads)
+  {
+    engine e(make_registry(), std::move(kernels));
+    scheduler pool(threads);
+    auto const g = make_graph(source_count);
+
+    double best{};
+    double utilization{};
+    for(int r{}; r < repetitions; ++r)
+    {
+      e.load(g);
+      busy = 0;
+      auto const start = std::chrono::steady_clock::now();
+      e.run(pool);
+      auto const stop = std::chrono::steady_clock::now();
+      auto const time = std::chrono::duration<double, std::milli>(stop - start).count();
+      if((r == 0) || (time < best))
+      {
+        best = time;
+        utilization = busy / (1e6 * time * threads);
+      }
+    }
+    std::cout << "  " << name << ": " << best << " ms, workers busy " << 100.0 * utilization << "%\n";
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  auto const source_count = (argc > 1) ? std::stoi(argv[1]) : 256;
+  std::chrono::milliseconds const delay{(argc > 2) ? std::stoi(argv[2]) : 20};
+  std::chrono::microseconds const work{(argc > 3) ? std::stoi(argv[3]) : 500};
+  auto const threads = (argc > 4) ? std::stoi(argv[4]) : 4;
+
+  std::cout << source_count << " sources waiting " << delay.count() << " ms each, " << work.count()
+            << " us of work per source, " << threads << " threads\n";
+  // what the workers cannot do faster than
+  std::cout << "  bound: " << std::max(1e-3 * work.count() * source_count / threads, double(delay.count()))
+            << " ms\n";
+
+  std::atomic<int64_t> busy{};
+  {
+    kernel_registry kernels;
+    kernels.add(source_type, [delay](auto &&, auto &&outputs)
+    {
+      std::this_thread::sleep_for(delay);
+      outputs[0].data = 1.0;
+    }, false);
+    add_work_kernels(kernels, work, busy);
+    run("blocking sources", std::move(kernels), busy, source_count, threads);
+  }
+  {
+    reactor io;
+    kernel_registry kernels;
+    kernels.add_async(source_type, [delay, &io](auto &&, auto &&outputs, completion done)
+    {
+      io.after(delay, [outputs, done = std::move(done)]
+      {
+        outputs[0].data = 1.0;
+        done(nullptr);
+      });
+    }, false);
+    add_work_kernels(kernels, work, busy);
+    run("asynchronous sources", std::move(kernels), busy, source_count, threads);
+  }
+
+  return 0;
+}
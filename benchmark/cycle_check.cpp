@@ -0,0 +1,159 @@
+#include "topological_order.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace skadi;
+
+// Adds connections to a layered graph of 1M edges, keeping it free of cycles with a
+// dynamic topological order, and compares them to a full search of the graph per
+// connection. Every node has inputs from two nodes of the previous layer.
+// usage: benchmark_cycle_check [width] [depth] [edits]
+
+namespace
+{
+  int64_t id(int width, int layer, int column)
+  {
+    return int64_t{layer} * width + column;
+  }
+
+  template<typename F>
+  double measure(F &&f)
+  {
+    auto const start = std::chrono::steady_clock::now();
+    f();
+    auto const stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+  }
+
+  // what checking a connection costs without an order: Kahn's algorithm over everything
+  bool has_cycle(std::vector<std::vector<int>> const &successors)
+  {
+    std::vector<int> in_degree(successors.size());
+    for(auto &&s : successors)
+    {
+      for(auto &&next : s)
+      {
+        ++in_degree[next];
+      }
+    }
+    std::vector<int> ready;
+    for(size_t i{}; i < in_degree.size(); ++i)
+    {
+      if(in_degree[i] == 0)
+      {
+        ready.push_back(static_cast<int>(i));
+      }
+    }
+    size_t sorted{};
+    while(!ready.empty())
+    {
+      auto const current = ready.back();
+      ready.pop_back();
+      ++sorted;
+      for(auto &&next : successors[current])
+      {
+        if(--in_degree[next] == 0)
+        {
+          ready.push_back(next);
+        }
+      }
+    }
+    return sorted != successors.size();
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  auto const width = (argc > 1) ? std::stoi(argv[1]) : 1000;
+  auto const depth = (argc > 2) ? std::stoi(argv[2]) : 500;
+  auto const edits = (argc > 3) ? std::stoi(argv[3]) : 10000;
+
+  topological_order order;
+  std::vector<std::vector<int>> successors(static_cast<size_t>(width) * depth);
+  size_t edge_count{};
+  auto const load_time = measure([&]
+  {
+    for(int layer{}; layer < depth; ++layer)
+    {
+      for(int column{}; column < width; ++column)
+      {
+        order.add_node(id(width, layer, column));
+      }
+    }
+    for(int layer{1}; layer < depth; ++layer)
+    {
+      for(int column{}; column < width; ++column)
+      {
+        for(auto &&source : {column, (column + 1) % width})
+        {
+          order.add_edge(id(width, layer - 1, source), id(width, layer, column));
+          successors[id(width, layer - 1, source)].push_back(static_cast<int>(id(width, layer, column)));
+          ++edge_count;
+        }
+      }
+    }
+  });
+  std::cout << order.get_node_count() << " nodes, " << edge_count << " edges loaded in " << load_time << " ms\n";
+
+  std::cout << "full search per connection: " << measure([&] { has_cycle(successors); }) << " ms\n";
+
+  std::mt19937 random(1);
+  auto const column = [&] { return static_cast<int>(random() % width); };
+  auto const layer = [&](int first, int last) { return first + static_cast<int>(random() % (last - first)); };
+
+  // kinds of connections users make: along the layers, within one and back to earlier ones
+  auto const run = [&](std::string const &what, auto &&make_edge)
+  {
+    size_t accepted{};
+    size_t visited{};
+    std::vector<std::pair<int64_t, int64_t>> added;
+    auto const time = measure([&]
+    {
+      for(int i{}; i < edits; ++i)
+      {
+        auto const [source, destination] = make_edge();
+        if(order.add_edge(source, destination))
+        {
+          ++accepted;
+          added.emplace_back(source, destination);
+        }
+        visited += order.get_visited_count();
+      }
+    });
+    std::cout << what << ": " << (1000.0 * time / edits) << " us per connection, "
+              << accepted << " of " << edits << " accepted, "
+              << (static_cast<double>(visited) / edits) << " nodes searched on average\n";
+
+    for(auto &&[source, destination] : added)
+    {
+      order.remove_edge(source, destination);
+    }
+  };
+
+  run("along the order", [&]
+  {
+    auto const first = layer(0, depth - 1);
+    return std::make_pair(id(width, first, column()), id(width, layer(first + 1, depth), column()));
+  });
+  run("within a layer", [&]
+  {
+    auto const l = layer(0, depth);
+    return std::make_pair(id(width, l, column()), id(width, l, column()));
+  });
+  run("back one layer", [&]
+  {
+    auto const l = layer(1, depth);
+    return std::make_pair(id(width, l, column()), id(width, l - 1, column()));
+  });
+  run("back five layers", [&]
+  {
+    auto const l = layer(5, depth);
+    return std::make_pair(id(width, l, column()), id(width, l - 5, column()));
+  });
+
+  return 0;
+}
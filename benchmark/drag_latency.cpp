@@ -0,0 +1,121 @@
+#include "ui_scene.h"
+#include "ui_view.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "QtWidgets/QApplication"
+#include "QtWidgets/QGraphicsItem"
+
+using namespace skadi;
+
+// Measures the latency of dragging large multi-node selections.
+// usage: benchmark_drag_latency [node_count] [step_count] [--opengl]
+// (use -platform offscreen to run without a display, LIBGL_ALWAYS_SOFTWARE=1 for llvmpipe)
+
+namespace
+{
+  type_registry make_registry()
+  {
+    type_registry registry{};
+    registry.data_types.push_back({{0}, "int"});
+
+    node_type pass{};
+    pass.guid = {0};
+    pass.name = "pass";
+    pass.category = "benchmark";
+    pass.inputs.push_back({{0}, "in"});
+    pass.outputs.push_back({{0}, "out"});
+    registry.node_types.push_back(pass);
+
+    return registry;
+  }
+
+  // a grid of nodes, each one connected to its right and lower neighbour
+  void make_graph(int node_count, graph &content, graph_layout &layout)
+  {
+    auto columns = std::max(1, static_cast<int>(std::sqrt(node_count)));
+    int64_t connection_uid{};
+    for(int i{}; i < node_count; ++i)
+    {
+      content.nodes.push_back({{i}, {0}});
+      layout.node_layouts.push_back({{i}, QPointF((i % columns) * 250.0, (i / columns) * 150.0)});
+
+      if((i % columns) + 1 < columns && i + 1 < node_count)
+      {
+        content.connections.push_back({{connection_uid++}, {i}, "out", {i + 1}, "in"});
+      }
+      if(i + columns < node_count)
+      {
+        content.connections.push_back({{connection_uid++}, {i}, "out", {i + columns}, "in"});
+      }
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  QApplication app{argc, argv};
+
+  auto const node_count = (argc > 1) ? std::stoi(argv[1]) : 500;
+  auto const step_count = std::max(1, (argc > 2) ? std::stoi(argv[2]) : 200);
+
+  ui_scene scene(make_registry());
+  ui_view view(&scene);
+  if((argc > 3) && (std::string(argv[3]) == "--opengl"))
+  {
+    view.set_render_mode(render_mode::opengl);
+  }
+
+  graph content{};
+  graph_layout layout{};
+  make_graph(node_count, content, layout);
+  scene.set_content(content);
+  scene.set_layout(layout);
+
+  view.resize(1280, 960);
+  view.show();
+  for(auto &&item : scene.items())
+  {
+    item->setSelected(item->type() == QGraphicsItem::UserType + 1);
+  }
+  QApplication::processEvents();
+
+  auto const selection = scene.selectedItems();
+
+  std::vector<double> latencies;
+  for(int step{}; step < step_count; ++step)
+  {
+    auto const start = std::chrono::steady_clock::now();
+
+    // same as QGraphicsItem::mouseMoveEvent does for a selection
+    auto const offset = ((step / 20) % 2) ? -5.0 : 5.0;
+    for(auto &&item : selection)
+    {
+      item->moveBy(offset, offset);
+    }
+    QApplication::processEvents();
+
+    auto const stop = std::chrono::steady_clock::now();
+    latencies.push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+  }
+
+  std::sort(begin(latencies), end(latencies));
+  auto const mean = std::accumulate(begin(latencies), end(latencies), 0.0) / latencies.size();
+
+  std::cout << "renderer: " << ((view.get_render_mode() == render_mode::opengl) ? "opengl" : "raster") << "\n"
+            << "nodes: " << node_count
+            << ", connections: " << content.connections.size()
+            << ", selected: " << selection.size() << "\n"
+            << "drag latency [ms]: mean " << mean
+            << ", median " << latencies[latencies.size() / 2]
+            << ", p95 " << latencies[latencies.size() * 95 / 100]
+            << ", max " << latencies.back() << std::endl;
+
+  return 0;
+}
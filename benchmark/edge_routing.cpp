@@ -0,0 +1,113 @@
+#include "edge_router.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace skadi;
+
+// Routes edges between randomly connected nodes on a jittered grid, then moves a
+// single node and measures the incremental update.
+// usage: benchmark_edge_routing [edge_count]
+
+namespace
+{
+  double const node_width = 160;
+  double const node_height = 90;
+  double const node_spacing_x = 280;
+  double const node_spacing_y = 180;
+  double const insertion_width = 20;
+
+  template<typename F>
+  double measure(F &&f)
+  {
+    auto const start = std::chrono::steady_clock::now();
+    f();
+    auto const stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+  }
+
+  route_point output_of(route_rect const &r)
+  {
+    return{r.right + insertion_width, 0.5 * (r.top + r.bottom)};
+  }
+
+  route_point input_of(route_rect const &r)
+  {
+    return{r.left - insertion_width, 0.5 * (r.top + r.bottom)};
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  auto const edge_count = (argc > 1) ? std::stoi(argv[1]) : 10000;
+  auto const node_count = std::max(2, edge_count / 2);
+  auto const columns = std::max(1, static_cast<int>(std::sqrt(node_count)));
+
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<double> jitter(-40, 40);
+  std::uniform_int_distribution<int> neighbour(-3, 3);
+
+  edge_router router;
+  std::vector<route_rect> nodes;
+  for(int i{}; i < node_count; ++i)
+  {
+    auto const x = (i % columns) * node_spacing_x + jitter(rng);
+    auto const y = (i / columns) * node_spacing_y + jitter(rng);
+    nodes.push_back({x, y, x + node_width, y + node_height});
+    router.set_obstacle(i, nodes.back());
+  }
+
+  // edges mostly go to nearby nodes to the right, like in hand-drawn graphs
+  std::vector<std::pair<int, int>> edges;
+  for(int e{}; e < edge_count; ++e)
+  {
+    auto const source = std::uniform_int_distribution<int>(0, node_count - 1)(rng);
+    auto const column = std::min(columns - 1, std::max(0, (source % columns) + 1 + std::abs(neighbour(rng))));
+    auto const row = (source / columns) + neighbour(rng);
+    auto const destination = std::min(node_count - 1, std::max(0, row * columns + column));
+    edges.emplace_back(source, destination);
+    router.set_edge(e, output_of(nodes[source]), input_of(nodes[destination]));
+  }
+
+  size_t routed{};
+  size_t failed{};
+  auto const full_time = measure([&]
+  {
+    for(auto &&[id, path] : router.update())
+    {
+      ++routed;
+      failed += path.empty() ? 1 : 0;
+    }
+  });
+
+  // move one node, like a single drag step
+  auto const moved = node_count / 2;
+  nodes[moved].left += 30;
+  nodes[moved].right += 30;
+  router.set_obstacle(moved, nodes[moved]);
+  for(size_t e{}; e < edges.size(); ++e)
+  {
+    if((edges[e].first == moved) || (edges[e].second == moved))
+    {
+      router.set_edge(static_cast<int64_t>(e), output_of(nodes[edges[e].first]), input_of(nodes[edges[e].second]));
+    }
+  }
+
+  size_t rerouted{};
+  auto const incremental_time = measure([&]
+  {
+    rerouted = router.update().size();
+  });
+
+  std::cout << "nodes: " << node_count << ", edges: " << edge_count << "\n"
+            << "full routing: " << full_time << " ms (" << (1000.0 * routed / full_time) << " edges/s, "
+            << failed << " fell back to direct routes)\n"
+            << "incremental update after moving one node: " << incremental_time << " ms ("
+            << rerouted << " edges rerouted)" << std::endl;
+
+  return 0;
+}
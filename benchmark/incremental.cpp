@@ -0,0 +1,128 @@
+#include "engine.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+using namespace skadi;
+
+// Edits single nodes and connections of a graph of 100k nodes and compares the incremental
+// runs to a full one. Every node waits for two of the previous layer, so the downstream
+// cone of a node widens by one column per layer.
+// usage: benchmark_incremental [width] [depth] [work]
+
+namespace
+{
+  node_type_id const source_type{0};
+  node_type_id const combine_type{1};
+
+  type_registry make_registry()
+  {
+    data_type_id const number{0};
+    type_registry registry;
+    registry.data_types.push_back({number, "float"});
+    registry.node_types.push_back({source_type, "source", "", {}, {{number, "value"}}});
+    registry.node_types.push_back({combine_type, "combine", "", {{number, "a"}, {number, "b"}}, {{number, "value"}}});
+    return registry;
+  }
+
+  kernel_registry make_kernels(int work)
+  {
+    kernel_registry kernels;
+    kernels.add(source_type, [](auto &&, auto &&outputs) { outputs[0].data = 1.0; });
+    kernels.add(combine_type, [work](auto &&inputs, auto &&outputs)
+    {
+      auto x = 0.5 * (get_float(inputs[0]) + get_float(inputs[1]));
+      for(int i{}; i < work; ++i)
+      {
+        x = std::sqrt(x * x + 1e-9);
+      }
+      outputs[0].data = x;
+    });
+    return kernels;
+  }
+
+  int64_t id(int width, int layer, int column)
+  {
+    return int64_t{layer} * width + column;
+  }
+
+  graph make_graph(int width, int depth)
+  {
+    graph g;
+    int64_t next_connection{};
+    for(int layer{}; layer < depth; ++layer)
+    {
+      for(int column{}; column < width; ++column)
+      {
+        g.nodes.push_back({{id(width, layer, column)}, (layer == 0) ? source_type : combine_type});
+        if(layer > 0)
+        {
+          g.connections.push_back({{next_connection++}, {id(width, layer - 1, column)}, "value", {id(width, layer, column)}, "a"});
+          g.connections.push_back({{next_connection++}, {id(width, layer - 1, (column + 1) % width)}, "value", {id(width, layer, column)}, "b"});
+        }
+      }
+    }
+    return g;
+  }
+
+  template<typename F>
+  double measure(F &&f)
+  {
+    auto const start = std::chrono::steady_clock::now();
+    f();
+    auto const stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+  }
+
+  void report(std::string const &what, double time, engine const &e)
+  {
+    std::cout << what << ": " << time << " ms, " << e.get_run_count() << " nodes computed\n";
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  auto const width = (argc > 1) ? std::stoi(argv[1]) : 1000;
+  auto const depth = (argc > 2) ? std::stoi(argv[2]) : 100;
+  auto const work = (argc > 3) ? std::stoi(argv[3]) : 20;
+
+  engine e(make_registry(), make_kernels(work));
+  scheduler pool;
+  auto const g = make_graph(width, depth);
+  e.load(g);
+  std::cout << g.nodes.size() << " nodes, " << g.connections.size() << " connections, " << pool.get_thread_count() << " threads\n";
+
+  report("full run", measure([&] { e.run(pool); }), e);
+  report("nothing changed", measure([&] { e.run(pool); }), e);
+
+  // a parameter edit in the last layers only affects a few nodes
+  e.invalidate({id(width, depth - 3, width / 2)});
+  report("node in layer " + std::to_string(depth - 3), measure([&] { e.run(pool); }), e);
+
+  e.invalidate({id(width, depth / 2, width / 2)});
+  report("node in layer " + std::to_string(depth / 2), measure([&] { e.run(pool); }), e);
+
+  e.invalidate({id(width, 1, width / 2)});
+  report("node in layer 1", measure([&] { e.run(pool); }), e);
+
+  // rewiring an input to another node of the previous layer keeps the order valid
+  auto const rewired = g.connections[2 * width * (depth - 3) + width];
+  e.disconnect(rewired.uid);
+  auto replacement = rewired;
+  replacement.source.id = id(width, depth - 4, 0);
+  report("rewired connection", measure([&] { e.connect(replacement); e.run(pool); }), e);
+
+  // an input from a later node of the same layer goes against the order the plan was
+  // compiled in
+  auto const backwards = g.connections[2 * width * (depth - 3)];
+  e.disconnect(backwards.uid);
+  auto reversed = backwards;
+  reversed.source.id = id(width, depth - 2, width - 1);
+  report("connection against the order", measure([&] { e.connect(reversed); e.run(pool); }), e);
+
+  return 0;
+}
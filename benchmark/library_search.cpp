@@ -0,0 +1,115 @@
+#include "library_index.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+
+using namespace skadi;
+
+// Searches a library of generated node names, both from scratch for single queries and
+// incrementally while a query is typed, and reports the time per query against a frame.
+// usage: benchmark_library_search [entry_count]
+
+namespace
+{
+  double const frame_budget = 16.7; // ms per frame at 60Hz
+  int const repetitions = 20;
+  size_t const best_count = 20;
+
+  char const *const words[] = {
+    "add", "subtract", "multiply", "divide", "load", "save", "image", "mesh", "gaussian", "blur",
+    "sharpen", "filter", "resample", "convert", "color", "space", "noise", "random", "vector", "matrix",
+    "transform", "rotate", "scale", "translate", "merge", "split", "select", "sort", "reduce", "map",
+    "texture", "sample", "render", "shader", "buffer", "stream", "read", "write", "parse", "format"};
+
+  char const *const categories[] = {
+    "math", "image", "geometry", "io", "filter", "color", "utility", "shading", "data", "text"};
+
+  template<typename F>
+  double measure(F &&f)
+  {
+    auto const start = std::chrono::steady_clock::now();
+    f();
+    auto const stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+  }
+
+  // CamelCase names of two to four words with an optional version number
+  std::vector<library_entry> make_entries(int count)
+  {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> word(0, std::size(words) - 1);
+    std::uniform_int_distribution<int> category(0, std::size(categories) - 1);
+    std::uniform_int_distribution<int> length(2, 4);
+    std::uniform_int_distribution<int> version(0, 9);
+
+    std::vector<library_entry> entries;
+    for(int i{}; i < count; ++i)
+    {
+      std::string name;
+      for(int j = length(rng); j > 0; --j)
+      {
+        std::string w = words[word(rng)];
+        w[0] = static_cast<char>(w[0] - 'a' + 'A');
+        name += w;
+      }
+      if(auto v = version(rng); v < 3)
+      {
+        name += std::to_string(v + 2);
+      }
+      entries.push_back({name, categories[category(rng)]});
+    }
+    return entries;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  auto const entry_count = (argc > 1) ? std::stoi(argv[1]) : 100000;
+
+  std::unique_ptr<library_index> index;
+  auto const build_time = measure([&] { index = std::make_unique<library_index>(make_entries(entry_count)); });
+  std::cout << "entries: " << entry_count << ", index built in " << build_time << " ms\n";
+
+  for(std::string query : {"b", "gb", "blur", "gsblr", "ldimg", "imgflt2", "mesh*save", "xq"})
+  {
+    size_t matches{};
+    double total{};
+    for(int r{}; r < repetitions; ++r)
+    {
+      library_search search(*index);
+      total += measure([&]
+      {
+        matches = search.update(query).size();
+        search.get_best(best_count);
+      });
+    }
+    auto const time = total / repetitions;
+    std::cout << "query '" << query << "': " << matches << " matches, " << time << " ms"
+              << ((time > frame_budget) ? " (over budget)" : "") << "\n";
+  }
+
+  // typing narrows the previous result
+  std::string const typed = "gaussblurimg";
+  library_search search(*index);
+  double slowest{};
+  double total{};
+  for(size_t i = 1; i <= typed.size(); ++i)
+  {
+    auto const time = measure([&]
+    {
+      search.update(typed.substr(0, i));
+      search.get_best(best_count);
+    });
+    slowest = std::max(slowest, time);
+    total += time;
+  }
+  std::cout << "typing '" << typed << "': " << total / typed.size() << " ms per keystroke, slowest "
+            << slowest << " ms, " << search.get_result().size() << " matches" << std::endl;
+
+  return 0;
+}
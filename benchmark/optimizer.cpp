@@ -0,0 +1,169 @@
+#include "engine.h"
+#include "optimizer.h"
+#include "stream_engine.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+using namespace skadi;
+
+// Runs generated graphs before and after each optimizer pass, with the engine and with
+// the stream_engine. Every graph is made of chains of test nodes: a quarter of them starts
+// at a constant source, a quarter has no sink, the others start at an input which is not
+// pure and end in a sink.
+// usage: benchmark_optimizer [chains] [length] [rows]
+
+namespace
+{
+  data_type_id const int_type{0};
+  data_type_id const float_type{1};
+  node_type_id const source_type{0};
+  node_type_id const input_type{1};
+  node_type_id const test_type{2};
+  node_type_id const sink_type{3};
+
+  type_registry make_registry()
+  {
+    type_registry registry;
+    registry.data_types.push_back({int_type, "int"});
+    registry.data_types.push_back({float_type, "float"});
+    registry.node_types.push_back({source_type, "source", "", {}, {{int_type, "value"}}});
+    registry.node_types.push_back({input_type, "input", "", {}, {{float_type, "value"}}});
+    registry.node_types.push_back({test_type, "test", "", {{float_type, "a"}, {float_type, "b"}}, {{float_type, "value"}}});
+    registry.node_types.push_back({sink_type, "sink", "", {{float_type, "value"}}, {}});
+    return registry;
+  }
+
+  void add(std::atomic<double> &total, double x)
+  {
+    auto current = total.load();
+    while(!total.compare_exchange_weak(current, current + x))
+    {
+    }
+  }
+
+  // the builtin kernels, an input giving 2 or the row numbers, and sinks adding up what
+  // arrives for checking
+  kernel_registry make_kernels(type_registry const &registry, std::atomic<double> &checksum)
+  {
+    kernel_registry kernels;
+    add_builtin_kernels(kernels, registry);
+    kernels.add(input_type, [](auto &&, auto &&outputs) { outputs[0].data = 2.0; }, false);
+    kernels.add_batch(input_type, [](batch_range range, auto &&, auto &&outputs)
+    {
+      auto &&rows = set_rows<double>(outputs[0], range.row_count);
+      for(size_t r{}; r < rows.size(); ++r)
+      {
+        rows[r] = static_cast<double>(range.first_row + static_cast<int64_t>(r));
+      }
+    }, true);
+    kernels.add(sink_type, [&checksum](auto &&inputs, auto &&) { add(checksum, get_float(inputs[0])); }, false);
+    kernels.add_batch(sink_type, [&checksum](batch_range, auto &&inputs, auto &&)
+    {
+      double sum{};
+      for(auto &&row : std::get<std::vector<double>>(inputs[0]->data))
+      {
+        sum += row;
+      }
+      add(checksum, sum);
+    });
+    return kernels;
+  }
+
+  graph make_graph(int chains, int length)
+  {
+    graph g;
+    int64_t next_id{};
+    for(int c{}; c < chains; ++c)
+    {
+      auto previous = next_id++;
+      g.nodes.push_back({{previous}, (c % 4 == 0) ? source_type : input_type});
+      for(int i{}; i < length; ++i)
+      {
+        auto const id = next_id++;
+        g.nodes.push_back({{id}, test_type});
+        g.connections.push_back({{next_id++}, {previous}, "value", {id}, "a"});
+        previous = id;
+      }
+      if(c % 4 != 1)
+      {
+        auto const id = next_id++;
+        g.nodes.push_back({{id}, sink_type});
+        g.connections.push_back({{next_id++}, {previous}, "value", {id}, "value"});
+      }
+    }
+    return g;
+  }
+
+  template<typename F>
+  double measure(F &&f)
+  {
+    auto const start = std::chrono::steady_clock::now();
+    f();
+    auto const stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+  }
+
+  struct variant
+  {
+    std::string name;
+    optimizer_passes passes;
+  };
+
+  std::vector<variant> const variants{
+    {"unoptimized", {false, false, false}},
+    {"dead nodes", {true, false, false}},
+    {"dead nodes, constants", {true, true, false}},
+    {"dead nodes, constants, chains", {true, true, true}},
+  };
+
+  void report(std::string const &name, double optimize_time, optimized_graph const &o, double run_time, double checksum)
+  {
+    std::cout << "  " << name << ": " << o.content.nodes.size() << " nodes (" << o.removed_count << " removed, " << o.folded_count
+              << " folded, " << o.fused_count << " fused) in " << optimize_time << " ms, run " << run_time << " ms, checksum "
+              << checksum << "\n";
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  auto const chains = (argc > 1) ? std::stoi(argv[1]) : 10000;
+  auto const length = (argc > 2) ? std::stoi(argv[2]) : 10;
+  auto const rows = (argc > 3) ? std::stoll(argv[3]) : 4000000;
+  auto const registry = make_registry();
+
+  auto const g = make_graph(chains, length);
+  std::cout << "values, " << g.nodes.size() << " nodes:\n";
+  for(auto &&v : variants)
+  {
+    std::atomic<double> checksum{};
+    auto const kernels = make_kernels(registry, checksum);
+    optimized_graph o;
+    auto const optimize_time = measure([&] { o = optimize(g, registry, kernels, execution_target::values, v.passes); });
+    engine e(o.registry, o.kernels);
+    auto const run_time = measure([&] { e.load(o.content); e.run(); });
+    report(v.name, optimize_time, o, run_time, checksum);
+  }
+
+  auto const stream_chains = std::max(chains / 1000, 4);
+  auto const stream_graph = make_graph(stream_chains, length);
+  for(size_t batch_size : {size_t{4096}, size_t{65536}})
+  {
+    std::cout << "batches of " << batch_size << ", " << stream_graph.nodes.size() << " nodes, " << rows << " rows:\n";
+    for(auto &&v : variants)
+    {
+      std::atomic<double> checksum{};
+      auto const kernels = make_kernels(registry, checksum);
+      optimized_graph o;
+      auto const optimize_time = measure([&] { o = optimize(stream_graph, registry, kernels, execution_target::batches, v.passes); });
+      stream_engine e(o.registry, o.kernels, batch_size);
+      e.load(o.content);
+      auto const run_time = measure([&] { e.run(rows); });
+      report(v.name, optimize_time, o, run_time, checksum);
+    }
+  }
+  return 0;
+}
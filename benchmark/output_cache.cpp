@@ -0,0 +1,175 @@
+#include "engine.h"
+#include "output_cache.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+using namespace skadi;
+
+// Runs a layered graph of expensive nodes with and without an output cache: undoing a
+// parameter edit, reloading the graph and starting a new session on the spilled entries.
+// Every column has its own source type, so that no two nodes compute the same values.
+// usage: benchmark_output_cache [width] [depth] [work]
+
+namespace
+{
+  node_type_id const combine_type{0};
+
+  node_type_id source_type(int column)
+  {
+    return {1 + column};
+  }
+
+  type_registry make_registry(int width)
+  {
+    data_type_id const number{0};
+    type_registry registry;
+    registry.data_types.push_back({number, "float"});
+    registry.node_types.push_back({combine_type, "combine", "", {{number, "a"}, {number, "b"}}, {{number, "value"}}});
+    for(int column{}; column < width; ++column)
+    {
+      registry.node_types.push_back({source_type(column), "source " + std::to_string(column), "", {}, {{number, "value"}}});
+    }
+    return registry;
+  }
+
+  kernel_registry make_kernels(int width, int work)
+  {
+    kernel_registry kernels;
+    for(int column{}; column < width; ++column)
+    {
+      kernels.add(source_type(column), [column](auto &&, auto &&outputs) { outputs[0].data = 1.0 + column; });
+    }
+    kernels.add(combine_type, [work](auto &&inputs, auto &&outputs)
+    {
+      auto x = 0.75 * get_float(inputs[0]) + 0.25 * get_float(inputs[1]);
+      for(int i{}; i < work; ++i)
+      {
+        x = std::sqrt(x * x + 1e-9);
+      }
+      outputs[0].data = x;
+    });
+    return kernels;
+  }
+
+  int64_t id(int width, int layer, int column)
+  {
+    return int64_t{layer} * width + column;
+  }
+
+  graph make_graph(int width, int depth)
+  {
+    graph g;
+    int64_t next_connection{};
+    for(int layer{}; layer < depth; ++layer)
+    {
+      for(int column{}; column < width; ++column)
+      {
+        g.nodes.push_back({{id(width, layer, column)}, (layer == 0) ? source_type(column) : combine_type});
+        if(layer > 0)
+        {
+          g.connections.push_back({{next_connection++}, {id(width, layer - 1, column)}, "value", {id(width, layer, column)}, "a"});
+          g.connections.push_back({{next_connection++}, {id(width, layer - 1, (column + 1) % width)}, "value", {id(width, layer, column)}, "b"});
+        }
+      }
+    }
+    return g;
+  }
+
+  template<typename F>
+  double measure(F &&f)
+  {
+    auto const start = std::chrono::steady_clock::now();
+    f();
+    auto const stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+  }
+
+  void report(std::string const &what, double time, output_cache const *cache)
+  {
+    std::cout << what << ": " << time << " ms";
+    if(cache)
+    {
+      auto const s = cache->get_statistics();
+      std::cout << ", " << s.hits << " hits (" << s.disk_hits << " from disk), " << s.misses << " misses, "
+                << s.evictions << " evictions, " << s.entries << " entries in " << s.memory / 1024 << " KiB";
+    }
+    std::cout << "\n";
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  auto const width = (argc > 1) ? std::stoi(argv[1]) : 1000;
+  auto const depth = (argc > 2) ? std::stoi(argv[2]) : 100;
+  auto const work = (argc > 3) ? std::stoi(argv[3]) : 200;
+
+  auto const g = make_graph(width, depth);
+  node_instance_id const edited{id(width, 1, width / 2)};
+  scheduler pool;
+  std::cout << g.nodes.size() << " nodes, " << pool.get_thread_count() << " threads\n";
+
+  {
+    engine e(make_registry(width), make_kernels(width, work));
+    e.load(g);
+    report("without cache, full run", measure([&] { e.run(pool); }), nullptr);
+    e.set_parameter_hash(edited, 1);
+    report("without cache, parameter edit", measure([&] { e.run(pool); }), nullptr);
+    e.set_parameter_hash(edited, 0);
+    report("without cache, parameter undo", measure([&] { e.run(pool); }), nullptr);
+  }
+
+  {
+    output_cache cache(size_t{256} << 20);
+    engine e(make_registry(width), make_kernels(width, work));
+    e.set_cache(&cache);
+    e.load(g);
+    report("cold cache, full run", measure([&] { e.run(pool); }), &cache);
+    e.set_parameter_hash(edited, 1);
+    report("parameter edit", measure([&] { e.run(pool); }), &cache);
+    e.set_parameter_hash(edited, 0);
+    report("parameter undo", measure([&] { e.run(pool); }), &cache);
+    e.load(g);
+    report("graph reloaded", measure([&] { e.run(pool); }), &cache);
+  }
+
+  // Only expensive entries are spilled, so a smaller graph of heavier nodes is evicted to
+  // disk from a budget for a tenth of it, and read back.
+  auto const heavy_width = std::max(width / 10, 1);
+  auto const heavy_depth = std::max(depth / 10, 2);
+  auto const heavy_work = work * 100;
+  auto const heavy = make_graph(heavy_width, heavy_depth);
+  auto const directory = std::filesystem::temp_directory_path() / "skadi_output_cache_benchmark";
+  std::filesystem::remove_all(directory);
+  auto const budget = heavy.nodes.size() / 10 * 128;
+  std::cout << heavy.nodes.size() << " nodes with " << heavy_work << " work\n";
+  {
+    engine e(make_registry(heavy_width), make_kernels(heavy_width, heavy_work));
+    e.load(heavy);
+    report("without cache, full run", measure([&] { e.run(pool); }), nullptr);
+  }
+  {
+    output_cache cache(budget, directory);
+    engine e(make_registry(heavy_width), make_kernels(heavy_width, heavy_work));
+    e.set_cache(&cache);
+    e.load(heavy);
+    report("spilling cache, full run", measure([&] { e.run(pool); }), &cache);
+    e.load(heavy);
+    report("spilling cache, graph reloaded", measure([&] { e.run(pool); }), &cache);
+  }
+  {
+    output_cache cache(budget, directory);
+    engine e(make_registry(heavy_width), make_kernels(heavy_width, heavy_work));
+    e.set_cache(&cache);
+    e.load(heavy);
+    report("next session", measure([&] { e.run(pool); }), &cache);
+  }
+  std::filesystem::remove_all(directory);
+
+  return 0;
+}
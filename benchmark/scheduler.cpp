@@ -0,0 +1,146 @@
+#include "engine.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace skadi;
+
+// Runs synthetic graphs of cheap nodes sequentially and with the work-stealing scheduler
+// on increasing numbers of threads, and reports the time per node and the speedup.
+// wide: few layers of many nodes, deep: many layers of few nodes, where every node waits
+// for two of the previous layer.
+// usage: benchmark_scheduler [node_count] [work]
+
+namespace
+{
+  int const repetitions = 5;
+
+  node_type_id const source_type{0};
+  node_type_id const combine_type{1};
+  node_type_id const sink_type{2};
+
+  type_registry make_registry()
+  {
+    data_type_id const number{0};
+    type_registry registry;
+    registry.data_types.push_back({number, "float"});
+    registry.node_types.push_back({source_type, "source", "", {}, {{number, "value"}}});
+    registry.node_types.push_back({combine_type, "combine", "", {{number, "a"}, {number, "b"}}, {{number, "value"}}});
+    registry.node_types.push_back({sink_type, "sink", "", {{number, "value"}}, {}});
+    return registry;
+  }
+
+  // work is the number of iterations of a dependent floating point loop per node
+  kernel_registry make_kernels(int work)
+  {
+    kernel_registry kernels;
+    kernels.add(source_type, [](auto &&, auto &&outputs) { outputs[0].data = 1.0; });
+    kernels.add(combine_type, [work](auto &&inputs, auto &&outputs)
+    {
+      auto x = 0.5 * (get_float(inputs[0]) + get_float(inputs[1]));
+      for(int i{}; i < work; ++i)
+      {
+        x = std::sqrt(x * x + 1e-9);
+      }
+      outputs[0].data = x;
+    });
+    kernels.add(sink_type, [](auto &&, auto &&) {});
+    return kernels;
+  }
+
+  graph make_graph(int width, int depth)
+  {
+    graph g;
+    int64_t next_connection{};
+    auto const id = [&](int layer, int column) { return node_instance_id{int64_t{layer} * width + column}; };
+    auto const connect = [&](node_instance_id source, node_instance_id destination, std::string slot)
+    {
+      g.connections.push_back({{next_connection++}, source, "value", destination, std::move(slot)});
+    };
+
+    for(int layer{}; layer <= depth + 1; ++layer)
+    {
+      for(int column{}; column < width; ++column)
+      {
+        auto const type = (layer == 0) ? source_type : ((layer > depth) ? sink_type : combine_type);
+        g.nodes.push_back({id(layer, column), type});
+        if(layer == 0)
+        {
+          continue;
+        }
+        if(layer > depth)
+        {
+          connect(id(layer - 1, column), id(layer, column), "value");
+          continue;
+        }
+        connect(id(layer - 1, column), id(layer, column), "a");
+        connect(id(layer - 1, (column + 1) % width), id(layer, column), "b");
+      }
+    }
+    return g;
+  }
+
+  // the engine only computes outdated nodes, so all of them are outdated before each
+  // repetition, outside of the measured time
+  template<typename F>
+  double measure(engine &e, graph const &g, F &&f)
+  {
+    double best{};
+    for(int r{}; r < repetitions; ++r)
+    {
+      for(auto &&n : g.nodes)
+      {
+        e.invalidate(n.uid);
+      }
+      auto const start = std::chrono::steady_clock::now();
+      f();
+      auto const stop = std::chrono::steady_clock::now();
+      auto const time = std::chrono::duration<double, std::milli>(stop - start).count();
+      best = (r == 0) ? time : std::min(best, time);
+    }
+    return best;
+  }
+
+  void run(std::string const &name, int width, int depth, int work)
+  {
+    engine e(make_registry(), make_kernels(work));
+    auto const g = make_graph(width, depth);
+    e.load(g);
+
+    auto const sequential = measure(e, g, [&] { e.run(); });
+    auto const node_count = e.get_run_count();
+    std::cout << name << " (" << width << " x " << depth << ", " << node_count << " nodes): sequential "
+              << sequential << " ms, " << 1e6 * sequential / node_count << " ns/node\n";
+
+    int const hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    for(int threads = 1; ; threads = std::min(2 * threads, hardware_threads))
+    {
+      scheduler pool(threads);
+      auto const time = measure(e, g, [&] { e.run(pool); });
+      std::cout << "  " << threads << " threads: " << time << " ms, " << 1e6 * time / node_count
+                << " ns/node, speedup " << sequential / time << "\n";
+      if(threads == hardware_threads)
+      {
+        break;
+      }
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  auto const node_count = (argc > 1) ? std::stoi(argv[1]) : 100000;
+  auto const work = (argc > 2) ? std::stoi(argv[2]) : 20;
+
+  run("wide", 1000, std::max(1, node_count / 1000), work);
+  run("deep", 16, std::max(1, node_count / 16), work);
+  // scheduling overhead alone
+  run("wide, empty kernels", 1000, std::max(1, node_count / 1000), 0);
+
+  return 0;
+}
@@ -0,0 +1,164 @@
+#include "scheduler.h"
+#include "stream_engine.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+using namespace skadi;
+
+// Streams rows through a linear pipeline and a fan-out/fan-in pipeline of the builtin
+// kernels at several batch sizes and reports the throughput in rows/s. A batch of one row
+// is about what evaluating the graph value by value costs.
+// usage: benchmark_stream [rows] [stages]
+
+namespace
+{
+  data_type_id const int_type{0};
+  data_type_id const float_type{1};
+  node_type_id const source_type{0};
+  node_type_id const test_type{1};
+  node_type_id const sink_type{2};
+
+  type_registry make_registry()
+  {
+    type_registry registry;
+    registry.data_types.push_back({int_type, "int"});
+    registry.data_types.push_back({float_type, "float"});
+    registry.node_types.push_back({source_type, "source", "", {}, {{int_type, "value"}}});
+    registry.node_types.push_back({test_type, "test", "", {{float_type, "a"}, {float_type, "b"}}, {{float_type, "value"}}});
+    registry.node_types.push_back({sink_type, "sink", "", {{float_type, "value"}}, {}});
+    return registry;
+  }
+
+  // the builtin kernels, with a sink adding up what arrives for checking
+  kernel_registry make_kernels(type_registry const &registry, std::atomic<double> &checksum)
+  {
+    kernel_registry kernels;
+    add_builtin_kernels(kernels, registry);
+    kernels.add_batch(sink_type, [&checksum](batch_range, auto &&inputs, auto &&)
+    {
+      double sum{};
+      for(auto &&row : std::get<std::vector<double>>(inputs[0]->data))
+      {
+        sum += row;
+      }
+      auto current = checksum.load();
+      while(!checksum.compare_exchange_weak(current, current + sum))
+      {
+      }
+    });
+    return kernels;
+  }
+
+  struct pipeline
+  {
+    graph g;
+    int64_t next_id;
+
+    int64_t add(node_type_id type)
+    {
+      g.nodes.push_back({{next_id}, type});
+      return next_id++;
+    }
+
+    void connect(int64_t source, std::string const &signal, int64_t destination, std::string const &slot)
+    {
+      g.connections.push_back({{next_id++}, {source}, signal, {destination}, slot});
+    }
+  };
+
+  // source -> test -> ... -> test -> sink, every row arrives unchanged
+  graph make_linear(int stages)
+  {
+    pipeline p{};
+    auto previous = p.add(source_type);
+    for(int i{}; i < stages; ++i)
+    {
+      auto next = p.add(test_type);
+      p.connect(previous, "value", next, "a");
+      previous = next;
+    }
+    p.connect(previous, "value", p.add(sink_type), "value");
+    return p.g;
+  }
+
+  // the source feeds both inputs of stages tests, which are summed up pairwise down to
+  // one; every row arrives multiplied by 2 * stages
+  graph make_fan(int stages)
+  {
+    pipeline p{};
+    auto const source = p.add(source_type);
+    std::vector<int64_t> layer;
+    for(int i{}; i < stages; ++i)
+    {
+      layer.push_back(p.add(test_type));
+      p.connect(source, "value", layer.back(), "a");
+      p.connect(source, "value", layer.back(), "b");
+    }
+    while(layer.size() > 1)
+    {
+      std::vector<int64_t> next;
+      for(size_t i{}; i + 1 < layer.size(); i += 2)
+      {
+        next.push_back(p.add(test_type));
+        p.connect(layer[i], "value", next.back(), "a");
+        p.connect(layer[i + 1], "value", next.back(), "b");
+      }
+      if(layer.size() % 2)
+      {
+        next.push_back(layer.back());
+      }
+      layer = std::move(next);
+    }
+    p.connect(layer[0], "value", p.add(sink_type), "value");
+    return p.g;
+  }
+
+  void measure(std::string const &name, graph const &g, double factor, int64_t rows, scheduler *pool)
+  {
+    auto const registry = make_registry();
+    for(size_t batch_size : {size_t{1}, size_t{64}, size_t{1024}, size_t{4096}, size_t{65536}})
+    {
+      // a batch of one row takes long, so it only gets a fraction of the rows
+      auto const count = (batch_size == 1) ? std::min<int64_t>(rows, 1000000) : rows;
+      std::atomic<double> checksum{};
+      stream_engine e(registry, make_kernels(registry, checksum), batch_size);
+      e.load(g);
+
+      auto const start = std::chrono::steady_clock::now();
+      if(pool)
+      {
+        e.run(count, *pool);
+      }
+      else
+      {
+        e.run(count);
+      }
+      auto const stop = std::chrono::steady_clock::now();
+
+      auto const seconds = std::chrono::duration<double>(stop - start).count();
+      auto const expected = factor * 0.5 * static_cast<double>(count) * static_cast<double>(count - 1);
+      std::cout << name << (pool ? ", parallel" : "") << ", batches of " << batch_size << ": " << count / seconds / 1e6
+                << " M rows/s, " << e.get_buffer_memory() / 1024 << " KiB in flight"
+                << ((std::abs(checksum - expected) <= 1e-9 * expected) ? "" : ", WRONG CHECKSUM") << "\n";
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  auto const rows = (argc > 1) ? std::stoll(argv[1]) : 20000000;
+  auto const stages = (argc > 2) ? std::stoi(argv[2]) : 8;
+
+  scheduler pool;
+  std::cout << rows << " rows, " << stages << " stages, " << pool.get_thread_count() << " threads\n";
+
+  measure("linear", make_linear(stages), 1, rows, nullptr);
+  measure("linear", make_linear(stages), 1, rows, &pool);
+  measure("fan-out/fan-in", make_fan(stages), 2 * stages, rows, nullptr);
+  measure("fan-out/fan-in", make_fan(stages), 2 * stages, rows, &pool);
+  return 0;
+}
@@ -0,0 +1,73 @@
+#include "type_system.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+using namespace skadi;
+
+// Type checks chains of nodes of growing size, the time per connection should stay the
+// same. The output of every node has another data type than the input it is connected to,
+// so the connections are only accepted over conversions.
+// usage: benchmark_type_check [nodes] [data_types]
+
+namespace
+{
+  type_registry make_registry(int data_types)
+  {
+    type_registry registry;
+    for(int t{}; t < data_types; ++t)
+    {
+      registry.data_types.push_back({{t}, "type " + std::to_string(t)});
+      registry.node_types.push_back({{t}, "node " + std::to_string(t), "", {{{t}, "in"}}, {{{(t + 2) % data_types}, "out"}}});
+      // a cycle, so every type converts to every other one over several conversions
+      registry.conversions.push_back({{t}, {(t + 1) % data_types}});
+    }
+    return registry;
+  }
+
+  graph make_graph(int node_count, int data_types)
+  {
+    graph g;
+    for(int i{}; i < node_count; ++i)
+    {
+      g.nodes.push_back({{i}, {i % data_types}});
+      if(i > 0)
+      {
+        g.connections.push_back({{i}, {i - 1}, "out", {i}, "in"});
+      }
+    }
+    return g;
+  }
+
+  template<typename F>
+  double measure(F &&f)
+  {
+    auto const start = std::chrono::steady_clock::now();
+    f();
+    auto const stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  auto const node_count = (argc > 1) ? std::stoi(argv[1]) : 1000000;
+  auto const data_types = (argc > 2) ? std::stoi(argv[2]) : 64;
+
+  auto const registry = make_registry(data_types);
+  type_system types(registry);
+  std::cout << "matrix of " << data_types << " data types: " << measure([&] { types = type_system(registry); }) << " ms\n";
+
+  for(auto size = node_count / 8; size <= node_count; size *= 2)
+  {
+    auto const g = make_graph(size, data_types);
+    size_t error_count{};
+    auto const time = measure([&] { error_count = types.check(g).size(); });
+    std::cout << g.connections.size() << " connections: " << time << " ms, "
+              << (1e6 * time / static_cast<double>(g.connections.size())) << " ns per connection, "
+              << error_count << " errors\n";
+  }
+
+  return 0;
+}
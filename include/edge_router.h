@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace skadi
+{
+
+struct route_point
+{
+  double x;
+  double y;
+};
+
+struct route_rect
+{
+  double left;
+  double top;
+  double right;
+  double bottom;
+};
+
+// corner points from the source to the destination, empty if no route was found
+using route = std::vector<route_point>;
+
+// Orthogonal edge router. Each edge is routed with A* on a sparse grid spanned by the
+// borders of the obstacles and the channels of other edges around it; channels which
+// are already in use are cheaper, so parallel edges get bundled.
+// Only edges affected by changes are routed again by update().
+class edge_router
+{
+public:
+  edge_router();
+  ~edge_router();
+
+  edge_router(edge_router const &) = delete;
+  edge_router &operator=(edge_router const &) = delete;
+
+  void set_obstacle(int64_t id, route_rect);
+  void remove_obstacle(int64_t id);
+
+  // source and destination are the points where the edge leaves / enters its ports
+  void set_edge(int64_t id, route_point source, route_point destination);
+  void remove_edge(int64_t id);
+
+  std::vector<std::pair<int64_t, route>> update();
+
+private:
+  struct state;
+
+  std::unique_ptr<state> d;
+};
+
+} // namespace skadi
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "graph.h"
+#include "kernel.h"
+
+#include <chrono>
+#include <map>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace skadi
+{
+
+class output_cache;
+class scheduler;
+struct cache_key;
+
+// A graph resolved for execution: nodes with the kernel of their type and the inputs each
+// of their outputs feeds, compiled in topological order.
+struct execution_plan
+{
+  struct port_ref
+  {
+    int node;
+    int port;
+    int input; // of all inputs of the plan
+  };
+
+  struct step
+  {
+    node_instance_id id;
+    node_type_id type;
+    kernel const *run;
+    async_kernel const *run_async; // if run is null
+    bool is_pure;
+    int input_count;
+    int connected_input_count;
+    int first_input; // of all inputs of the plan, in step order
+    int first_output;
+    std::vector<data_type_id> output_types;
+    std::vector<std::vector<port_ref>> consumers; // per output
+  };
+
+  std::vector<step> steps;
+  int input_count;
+  int output_count;
+  std::unordered_map<int64_t, int> indices; // node instance id -> step
+};
+
+// throws runtime_error for unknown types or ports, inputs connected more than once and
+// cycles; steps have no kernel
+execution_plan compile(graph const &, type_registry const &);
+// also throws for node types with neither a kernel nor an asynchronous one
+execution_plan compile(graph const &, type_registry const &, kernel_registry const &);
+
+// Runs graphs with the kernels bound to their node types. Values are pushed along the
+// connections as soon as their producer has run, and are kept after a run for inspection.
+// The engine keeps the outputs of all nodes between runs and tracks which of them are
+// outdated by edits; a run only computes those and everything downstream of them.
+class engine
+{
+public:
+  engine(type_registry, kernel_registry);
+
+  engine(engine const &) = delete;
+  engine &operator=(engine const &) = delete;
+
+  // replaces the graph, everything is computed at the next run
+  void load(graph const &);
+
+  // edits of the loaded graph; they are applied to the plan in place where possible, and
+  // it is compiled again at the next run where they need checking
+  void add_node(node);
+  void remove_node(node_instance_id);
+  void connect(connection);
+  void disconnect(connection_instance_id);
+  // the outputs of a node are outdated, e.g. because one of its parameters changed
+  void invalidate(node_instance_id);
+
+  // Outputs of pure kernels are looked up in the cache by the node type, the parameter
+  // hash of the node and the hash of its inputs, and only computed on a miss. Nodes with
+  // inputs that cannot be hashed are always computed. The cache has to outlive the engine
+  // or be reset to null.
+  void set_cache(output_cache *);
+  // hash of whatever besides the inputs determines the outputs of a node, 0 by default;
+  // a different hash outdates the node
+  void set_parameter_hash(node_instance_id, uint64_t);
+
+  // throws runtime_error naming the node if a kernel fails, or if the graph cannot be
+  // compiled or has a cycle; the outdated nodes stay outdated then
+  void run();
+  // independent nodes run in parallel; kernels have to be thread safe. Workers go on with
+  // other nodes while asynchronous kernels are waiting, the calling thread waits for them
+  // in the plain run.
+  void run(scheduler &);
+
+  // number of nodes computed by the last run
+  size_t get_run_count() const;
+
+  // measures how long computing each node takes, including the cache lookup; off by default
+  void set_timing_enabled(bool);
+  // of the last run which computed the node with timing enabled, zero if there was none
+  std::chrono::nanoseconds get_duration(node_instance_id) const;
+
+  execution_plan const &get_plan() const;
+  port_range<value const> get_inputs(node_instance_id) const;
+  port_range<value const> get_outputs(node_instance_id) const;
+
+private:
+  void update_plan();
+  std::vector<int> const &collect_outdated();
+  void run_step(int);
+  // false if an asynchronous kernel has been started, which calls done when it is complete
+  bool start_step(int, std::function<void(std::exception_ptr)> const &done);
+  void finish_step(int, std::optional<cache_key> const &, std::chrono::steady_clock::time_point start, bool is_cached);
+  // the step of a node and the index of a port, if the plan has them
+  int find_step(node_instance_id) const;
+  int find_input(connection const &) const;
+  int find_output(connection const &) const;
+
+  type_registry registry;
+  kernel_registry kernels;
+  std::unordered_map<int64_t, node_type const *> types;
+  output_cache *cache;
+  std::unordered_map<int64_t, uint64_t> parameter_hashes;
+
+  // the graph by id, for compiling
+  std::map<int64_t, node> nodes;
+  std::map<int64_t, connection> connections;
+  std::unordered_set<int64_t> outdated;
+
+  execution_plan plan;
+  bool is_plan_outdated;
+  // of all steps in one block each, for locality
+  std::vector<value> inputs;
+  std::vector<value> outputs;
+  std::vector<int64_t> input_connections; // per input, -1 if not connected
+  std::vector<bool> is_scheduled;
+  bool is_timing_enabled;
+  std::vector<std::chrono::nanoseconds> durations;
+  std::vector<int> waiting; // inputs from the same run
+  std::vector<int> scheduled;
+};
+
+} // namespace skadi
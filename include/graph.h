@@ -45,10 +45,18 @@ struct node_type
   std::vector<output> outputs;
 };
 
+// values of one data type are accepted by inputs of another, see type_system
+struct conversion
+{
+  data_type_id from;
+  data_type_id to;
+};
+
 struct type_registry
 {
   std::vector<data_type> data_types;
   std::vector<node_type> node_types;
+  std::vector<conversion> conversions;
 };
 
 struct node_instance_id
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "graph.h"
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace skadi
+{
+
+// A value passed along a connection, tagged with the data type of the output which
+// produced it. Numbers are stored directly, anything else is shared immutable data.
+struct value
+{
+  data_type_id type;
+  std::variant<std::monostate, int64_t, double, std::shared_ptr<void const>> data;
+};
+
+bool is_empty(value const &);
+// content hash of empty and numeric values, none for shared data
+std::optional<uint64_t> hash_value(value const &);
+// numeric values converted to the requested representation, 0 if there is none
+int64_t get_int(value const &);
+double get_float(value const &);
+
+// the values of the ports of a node, which are stored contiguously
+template<typename T>
+class port_range
+{
+public:
+  port_range(T *first, size_t count)
+    : first(first)
+    , count(count)
+  {
+  }
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  T &operator[](size_t i) const { return first[i]; }
+  T *begin() const { return first; }
+  T *end() const { return first + count; }
+
+private:
+  T *first;
+  size_t count;
+};
+
+// Computes the outputs of a node from its inputs, one value per port in the order of
+// the node_type. Inputs which are not connected are empty. The type of the outputs is
+// set by the engine. Kernels are shared by all nodes of a type and may run concurrently.
+using kernel = std::function<void(port_range<value const> inputs, port_range<value> outputs)>;
+
+// Signals that an async_kernel has written its outputs, or failed with error; called
+// exactly once, from any thread.
+using completion = std::function<void(std::exception_ptr error)>;
+
+// Starts computing the outputs of a node and returns without waiting for them, e.g. for
+// nodes which read files or wait for other processes; see reactor. The inputs and outputs
+// stay valid until done is called. Kernels which throw must not call done.
+using async_kernel = std::function<void(port_range<value const> inputs, port_range<value> outputs, completion done)>;
+
+// The values of a port for a batch of rows, stored contiguously in the representation of
+// the data type.
+struct column
+{
+  data_type_id type;
+  std::variant<std::monostate, std::vector<int64_t>, std::vector<double>> data;
+};
+
+size_t get_row_count(column const &);
+// the values of a column in the representation T, which it is switched to if necessary;
+// resized to row_count, existing buffers are reused
+template<typename T>
+std::vector<T> &set_rows(column &c, size_t row_count)
+{
+  if(!std::holds_alternative<std::vector<T>>(c.data))
+  {
+    c.data = std::vector<T>{};
+  }
+  auto &&rows = std::get<std::vector<T>>(c.data);
+  rows.resize(row_count);
+  return rows;
+}
+
+// the rows [first_row, first_row + row_count) of a stream
+struct batch_range
+{
+  int64_t first_row;
+  size_t row_count;
+};
+
+// Computes the outputs of a node for a whole batch of rows at once, with row_count values
+// per output column. Inputs which are not connected are null. Nodes without inputs are the
+// sources of a stream and produce the rows of the range. Output columns are kept between
+// batches, so kernels should fill them with set_rows rather than replace them. The type of
+// the outputs is set by the engine. Batches of a stream may be computed concurrently and
+// out of order.
+using batch_kernel = std::function<void(batch_range, port_range<column const *const> inputs, port_range<column> outputs)>;
+
+// Pure kernels compute the same outputs from the same inputs, so their results may be
+// cached; kernels which e.g. read files or generate random numbers are not pure.
+// Node types may have a kernel for single values, an asynchronous one instead, one for
+// batches, or both. Element-wise
+// batch kernels compute every row from the same row of their inputs alone, so batches may
+// be split into smaller ones for them.
+class kernel_registry
+{
+public:
+  void add(node_type_id, kernel, bool is_pure = true);
+  void add_async(node_type_id, async_kernel, bool is_pure = true);
+  void add_batch(node_type_id, batch_kernel, bool is_elementwise = false);
+  kernel const *find(node_type_id) const;
+  async_kernel const *find_async(node_type_id) const;
+  batch_kernel const *find_batch(node_type_id) const;
+  bool is_pure(node_type_id) const;
+  bool is_elementwise(node_type_id) const;
+
+private:
+  struct entry
+  {
+    kernel run;
+    async_kernel run_async;
+    batch_kernel run_batch;
+    bool is_pure;
+    bool is_elementwise;
+  };
+
+  std::unordered_map<int64_t, entry> kernels;
+};
+
+// kernels for single values and batches for the node types "source", "sink" and "test"
+// over the data types "int" and "float", bound to whatever guids they have in the registry
+void add_builtin_kernels(kernel_registry &, type_registry const &);
+
+} // namespace skadi
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace skadi
+{
+
+struct library_entry
+{
+  std::string name;
+  std::string category;
+};
+
+// Search index over the names and categories of the node types in the library.
+// Queries containing '*' or '?' are case insensitive wildcards which may match anywhere
+// in the name or the category of an entry, and are answered with a trigram index.
+// Other queries are fuzzy: their characters have to appear in order, but not contiguously.
+// The index is immutable, so it can be searched from several threads; searches stop early
+// and return nothing useful once an optional cancel flag is set.
+class library_index
+{
+public:
+  explicit library_index(std::vector<library_entry>);
+
+  size_t size() const;
+  library_entry const &get_entry(int) const;
+
+  // entries in ascending order
+  std::vector<int> find(std::string const &query, std::atomic<bool> const *cancel = nullptr) const;
+  // only the candidates are checked, for queries which can match no other entries
+  std::vector<int> refine(std::string const &query, std::vector<int> const &candidates, std::atomic<bool> const *cancel = nullptr) const;
+
+  // relevance of the matching entries, higher is better; contiguous runs, word boundaries
+  // and prefixes score higher than scattered characters
+  void score(std::string const &query, std::vector<int> const &entries, std::vector<int> &scores, std::atomic<bool> const *cancel = nullptr) const;
+
+  static bool is_wildcard(std::string const &query);
+
+private:
+  // all texts of a column in one buffer, with per character flags and per text masks
+  struct column
+  {
+    std::string chars;
+    std::vector<uint8_t> boundaries;
+    std::vector<uint32_t> offsets;
+    std::vector<uint64_t> masks;
+
+    void add(std::string const &);
+    std::string_view get(int) const;
+  };
+
+  std::vector<int> find_wildcard(std::string const &pattern, std::atomic<bool> const *cancel) const;
+  std::vector<int> find_fuzzy(std::string const &pattern, std::atomic<bool> const *cancel) const;
+  std::vector<int> filter(std::vector<int> const &candidates, std::string const &pattern, bool wildcard, std::atomic<bool> const *cancel) const;
+  bool matches(int, std::string const &pattern, bool wildcard) const;
+  int score(column const &, int, std::string const &pattern, std::vector<int> &rows) const;
+
+  std::vector<library_entry> entries;
+  column names;
+  column categories;
+  std::unordered_map<uint32_t, std::vector<int>> trigrams;
+};
+
+// Keeps the result of the last query. A query containing the previous one can only match
+// a subset of its entries, so typing narrows the previous result instead of searching again.
+class library_search
+{
+public:
+  explicit library_search(library_index const &);
+
+  std::vector<int> const &update(std::string const &query);
+  // keeps the previous result and returns false if cancel was set during the search
+  bool update(std::string const &query, std::atomic<bool> const &cancel);
+  std::vector<int> const &get_result() const;
+
+  // the highest scoring entries of the result, none for an empty query
+  std::vector<int> get_best(size_t count) const;
+
+private:
+  library_index const &index;
+  std::string query;
+  std::vector<int> result;
+  std::vector<int> scores;
+};
+
+} // namespace skadi
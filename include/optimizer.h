@@ -0,0 +1,54 @@
+#pragma once
+
+#include "graph.h"
+#include "kernel.h"
+
+namespace skadi
+{
+
+// what an optimized graph is run by: the engine, which computes single values, or the
+// stream_engine, which computes batches
+enum class execution_target
+{
+  values,
+  batches
+};
+
+struct optimizer_passes
+{
+  bool eliminate_dead_nodes = true;
+  bool fold_constants = true;
+  bool fuse_chains = true;
+};
+
+// A graph rewritten for execution, with the node types and kernels it needs besides the
+// original ones. Nodes which stay keep their ids: folded nodes are replaced by nodes of a
+// constant type, and a fused chain takes the id of its last node.
+struct optimized_graph
+{
+  graph content;
+  type_registry registry;
+  kernel_registry kernels;
+  size_t removed_count; // by dead-node elimination
+  size_t folded_count; // computed while optimizing
+  size_t fused_count; // merged into chains
+};
+
+// runs the enabled passes in order; throws runtime_error like compile
+optimized_graph optimize(graph const &, type_registry const &, kernel_registry const &, execution_target, optimizer_passes = {});
+
+// Removes the nodes without a path to a sink, a node without outputs.
+void eliminate_dead_nodes(optimized_graph &);
+
+// Computes the nodes of pure kernels whose inputs are all constant or not connected, and
+// replaces those feeding other nodes by constants. Nodes without inputs are constant when
+// computing values, for batches they are the sources of the stream. Sinks are kept.
+void fold_constants(optimized_graph &, execution_target);
+
+// Merges chains of nodes, where every node only feeds the next one and that is only fed by
+// it, into single nodes. The inputs of a chain are those of its first node and its outputs
+// those of its last. For batches only element-wise kernels are merged, and chains compute
+// them in tiles which stay in the cache instead of whole intermediate columns.
+void fuse_chains(optimized_graph &, execution_target);
+
+} // namespace skadi
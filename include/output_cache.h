@@ -0,0 +1,111 @@
+#pragma once
+
+#include "kernel.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace skadi
+{
+
+// identifies the outputs of a pure kernel by what they are computed from
+struct cache_key
+{
+  int64_t node_type;
+  uint64_t parameters;
+  uint64_t inputs;
+};
+
+// Outputs of nodes by the type, parameters and input values which produced them, within a
+// memory budget. The least recently used entries are evicted first; with a spill directory
+// they are appended to a log there and read back on a miss, which also serves later
+// sessions. Only entries which took longer to compute than reading them back are spilled,
+// and only empty and numeric values can be. Once the log outgrows its disk budget, or if
+// it has outgrown it or holds superseded records when it is opened, it is rewritten with
+// the most recently used records only. Thread safe; the log has a lock of its own,
+// so it is not accessed under the lock of the entries in memory. A directory must not be
+// used by more than one cache at a time.
+class output_cache
+{
+public:
+  struct statistics
+  {
+    uint64_t hits;
+    uint64_t disk_hits; // included in hits
+    uint64_t misses;
+    uint64_t evictions;
+    size_t memory; // bytes
+    size_t entries;
+  };
+
+  // without a spill directory evicted entries are dropped; throws runtime_error if the
+  // log cannot be opened
+  explicit output_cache(size_t memory_budget, std::filesystem::path spill_directory = {}, size_t disk_budget = size_t{1} << 30);
+  // spills the entries in memory
+  ~output_cache();
+
+  output_cache(output_cache const &) = delete;
+  output_cache &operator=(output_cache const &) = delete;
+
+  // copies the cached outputs and returns true if there are any
+  bool find(cache_key const &, port_range<value> outputs);
+  // cost is the time it took to compute the outputs
+  void insert(cache_key const &, port_range<value const> outputs, std::chrono::nanoseconds cost);
+
+  statistics get_statistics() const;
+  // drops the entries in memory, spilled ones stay
+  void clear();
+
+private:
+  struct entry
+  {
+    cache_key key;
+    std::vector<value> outputs;
+    size_t size;
+    std::chrono::nanoseconds cost;
+  };
+
+  struct record
+  {
+    std::streamoff offset;
+    std::streamoff size;
+    uint64_t last_use;
+  };
+
+  void add(entry, std::vector<entry> &evicted);
+  void open_log(std::filesystem::path const &);
+  void spill(entry const &);
+  std::optional<std::vector<value>> load(cache_key const &);
+  // with the log lock held; keeps the most recently used records within the size
+  void compact(std::streamoff);
+
+  size_t memory_budget;
+  std::streamoff disk_budget;
+  bool is_spilling;
+
+  mutable std::mutex mutex;
+  std::list<entry> entries; // most recently used first
+  std::unordered_map<uint64_t, std::list<entry>::iterator> index;
+  size_t memory;
+
+  std::mutex log_mutex;
+  std::filesystem::path log_path;
+  std::fstream log;
+  std::streamoff log_size;
+  std::unordered_map<uint64_t, record> spilled; // records in the log
+  uint64_t log_clock; // orders the uses of records
+
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> disk_hits;
+  std::atomic<uint64_t> misses;
+  std::atomic<uint64_t> evictions;
+};
+
+} // namespace skadi
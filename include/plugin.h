@@ -0,0 +1,85 @@
+#pragma once
+
+#include "graph.h"
+#include "plugin_api.h"
+
+#include <vector>
+
+// C++ side of the plugin ABI for plugin authors; a plugin defines
+//
+//   void register_types(skadi::plugin_registrar &registrar)
+//   {
+//     registrar.add(skadi::node_type{...});
+//     registrar.add_kernel(skadi::node_type_id{...}, &kernel_function, nullptr, true);
+//   }
+//   SKADI_PLUGIN(register_types)
+//
+// and ships a manifest listing the same types.
+
+namespace skadi
+{
+
+class plugin_registrar
+{
+public:
+  explicit plugin_registrar(skadi_registrar const *registrar)
+    : registrar(registrar)
+  {
+  }
+
+  void add(data_type const &type)
+  {
+    skadi_data_type t{type.guid.guid, type.name.c_str()};
+    registrar->add_data_type(registrar->context, &t);
+  }
+
+  void add(node_type const &type)
+  {
+    std::vector<skadi_port> inputs;
+    for(auto &&p : type.inputs)
+    {
+      inputs.push_back({p.type.guid, p.name.c_str()});
+    }
+    std::vector<skadi_port> outputs;
+    for(auto &&p : type.outputs)
+    {
+      outputs.push_back({p.type.guid, p.name.c_str()});
+    }
+
+    skadi_node_type t{type.guid.guid, type.name.c_str(), type.category.c_str(),
+                      inputs.data(), static_cast<int32_t>(inputs.size()),
+                      outputs.data(), static_cast<int32_t>(outputs.size())};
+    registrar->add_node_type(registrar->context, &t);
+  }
+
+  // for one of the node types added; the function must not throw, see skadi_kernel_function
+  void add_kernel(node_type_id type, skadi_kernel_function run, void *user_data, bool is_pure)
+  {
+    registrar->add_kernel(registrar->context, type.guid, run, user_data, is_pure ? 1 : 0);
+  }
+
+private:
+  skadi_registrar const *registrar;
+};
+
+} // namespace skadi
+
+// defines the exported entry points; exceptions must not cross the C ABI
+#define SKADI_PLUGIN(register_function) \
+  extern "C" SKADI_PLUGIN_EXPORT int32_t skadi_plugin_version(void) \
+  { \
+    return SKADI_PLUGIN_API_VERSION; \
+  } \
+  extern "C" SKADI_PLUGIN_EXPORT int32_t skadi_plugin_register(skadi_registrar const *registrar) \
+  { \
+    try \
+    { \
+      skadi::plugin_registrar r(registrar); \
+      register_function(r); \
+      return 0; \
+    } \
+    catch(...) \
+    { \
+      return 1; \
+    } \
+  }
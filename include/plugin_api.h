@@ -0,0 +1,100 @@
+#pragma once
+
+/*
+ * C ABI between skadi and plugins providing node types.
+ *
+ * A plugin is a shared library next to a manifest <name>.plugin.json in the plugin
+ * directory. The manifest names the library and lists the types it provides in the
+ * format of the type_registry of the config file:
+ *
+ *   { "library": "libexample.so", "type_registry": { "data_types": [...], "node_types": [...] } }
+ *
+ * Only manifests are read at startup; the library is loaded when a node of one of its
+ * types is first instantiated or executed. It has to export both functions below and
+ * register at least the types listed in its manifest, and a kernel for each node type
+ * which is to be executed; nodes of types without one can be edited, but graphs with them
+ * do not run.
+ * All strings and arrays passed to the registrar only need to live for the call.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SKADI_PLUGIN_API_VERSION 1
+
+#if defined(_WIN32)
+#define SKADI_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define SKADI_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+typedef struct skadi_port
+{
+  int64_t type;
+  char const *name;
+} skadi_port;
+
+typedef struct skadi_data_type
+{
+  int64_t guid;
+  char const *name;
+} skadi_data_type;
+
+typedef struct skadi_node_type
+{
+  int64_t guid;
+  char const *name;
+  char const *category;
+  skadi_port const *inputs;
+  int32_t input_count;
+  skadi_port const *outputs;
+  int32_t output_count;
+} skadi_node_type;
+
+/* kinds of skadi_value */
+#define SKADI_VALUE_EMPTY 0
+#define SKADI_VALUE_INT 1
+#define SKADI_VALUE_FLOAT 2
+/* shared data of skadi, which kernels can neither read nor produce */
+#define SKADI_VALUE_DATA 3
+
+/* a value passed along a connection; type is the guid of its data type, which skadi sets
+ * for outputs, and only the member of its kind is used */
+typedef struct skadi_value
+{
+  int64_t type;
+  int32_t kind;
+  int64_t int_value;
+  double float_value;
+} skadi_value;
+
+/* computes the outputs of a node from its inputs, one value per port in the order of the
+ * node type, and returns 0 on success. Inputs which are not connected are empty, outputs
+ * are empty when it is called. It is shared by all nodes of the type and may be called
+ * concurrently; user_data is the one passed to add_kernel. */
+typedef int32_t (*skadi_kernel_function)(void *user_data, skadi_value const *inputs, int32_t input_count, skadi_value *outputs, int32_t output_count);
+
+typedef struct skadi_registrar
+{
+  void *context;
+  void (*add_data_type)(void *context, skadi_data_type const *);
+  void (*add_node_type)(void *context, skadi_node_type const *);
+  /* pure kernels compute the same outputs from the same inputs, so their results may be
+   * cached */
+  void (*add_kernel)(void *context, int64_t node_type, skadi_kernel_function, void *user_data, int32_t is_pure);
+} skadi_registrar;
+
+/* returns SKADI_PLUGIN_API_VERSION of the header the plugin was built with */
+typedef int32_t (*skadi_plugin_version_function)(void);
+/* registers the types and kernels of the plugin, returns 0 on success */
+typedef int32_t (*skadi_plugin_register_function)(skadi_registrar const *);
+
+#define SKADI_PLUGIN_VERSION_SYMBOL "skadi_plugin_version"
+#define SKADI_PLUGIN_REGISTER_SYMBOL "skadi_plugin_register"
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "graph.h"
+#include "kernel.h"
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace skadi
+{
+
+// Plugins found in a directory. Discovery only reads their manifests, so it is cheap
+// regardless of the number of plugins; a library is loaded the first time one of its
+// node types is needed and stays loaded until the host is destroyed.
+// Loading may happen from several threads.
+class plugin_host
+{
+public:
+  plugin_host();
+  ~plugin_host();
+
+  plugin_host(plugin_host const &) = delete;
+  plugin_host &operator=(plugin_host const &) = delete;
+
+  // reads all <name>.plugin.json in a directory, returns the problems of the ones skipped
+  std::vector<std::string> discover(std::filesystem::path const &directory);
+
+  // types of all discovered plugins, as listed in their manifests
+  type_registry const &get_types() const;
+  // appends the plugin types whose guids are not in the registry yet
+  void add_types(type_registry &) const;
+
+  bool is_provided(node_type_id) const;
+  bool is_loaded(node_type_id) const;
+  // loads the library providing a node type if that has not happened yet, throws
+  // runtime_error if it cannot be loaded or does not provide the type
+  void load(node_type_id);
+  // adds the kernels registered by the loaded libraries, e.g. after loading the providers
+  // of the node types of a graph; the kernels must not be used after the host is destroyed
+  void add_kernels(kernel_registry &) const;
+
+  size_t get_plugin_count() const;
+  size_t get_loaded_count() const;
+
+private:
+  struct plugin;
+
+  void load(plugin &);
+
+  std::vector<std::unique_ptr<plugin>> plugins;
+  std::unordered_map<int64_t, plugin *> node_plugins;
+  type_registry types;
+  mutable std::mutex mutex;
+};
+
+} // namespace skadi
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace skadi
+{
+
+// Waits for file descriptors on a thread of its own and calls back once they are ready,
+// e.g. to complete async_kernels without occupying a worker of a scheduler while they
+// wait for I/O. Callbacks run on the thread of the reactor, so they should be short and
+// must not throw. Uses epoll, the constructor throws runtime_error where it is missing.
+// Should waiting fail, every waiting callback is called at once and later waits throw.
+class reactor
+{
+public:
+  reactor();
+  // callbacks which are still waiting are dropped
+  ~reactor();
+
+  reactor(reactor const &) = delete;
+  reactor &operator=(reactor const &) = delete;
+
+  // once, when fd can be read from or written to, or has failed; a descriptor can only
+  // be waited for once at a time
+  void when_readable(int fd, std::function<void()>);
+  void when_writable(int fd, std::function<void()>);
+  // once, after a delay, e.g. for retries or to simulate slow devices
+  void after(std::chrono::nanoseconds, std::function<void()>);
+
+  // callbacks waiting to be called
+  size_t get_waiting_count() const;
+
+private:
+  struct watch_record
+  {
+    std::function<void()> callback;
+    // closed by the reactor once it fired
+    bool is_timer;
+  };
+
+  void watch(int fd, uint32_t events, watch_record);
+  void serve();
+  void fail(std::exception_ptr);
+
+  int poll_fd;
+  int stop_fd;
+  mutable std::mutex mutex;
+  std::unordered_map<int, watch_record> watches;
+  std::exception_ptr error;
+  std::thread thread;
+};
+
+} // namespace skadi
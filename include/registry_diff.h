@@ -0,0 +1,28 @@
+#pragma once
+
+#include "graph.h"
+
+#include <vector>
+
+namespace skadi
+{
+
+// Differences between two versions of a type_registry, matched by guid.
+struct registry_diff
+{
+  std::vector<data_type> added_data_types;
+  std::vector<data_type> changed_data_types;
+  std::vector<data_type_id> removed_data_types;
+
+  std::vector<node_type> added_node_types;
+  std::vector<node_type> changed_node_types;
+  std::vector<node_type_id> removed_node_types;
+
+  bool are_conversions_changed;
+
+  bool empty() const;
+};
+
+registry_diff diff_registries(type_registry const &from, type_registry const &to);
+
+} // namespace skadi
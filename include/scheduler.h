@@ -0,0 +1,85 @@
+#pragma once
+
+#include "engine.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace skadi
+{
+
+// Runs the steps of an execution_plan on a pool of workers. Every step counts the inputs
+// it is still waiting for; the worker which delivers the last one pushes it onto its own
+// queue, and workers whose queue is empty steal from the queues of the others.
+// The thread calling run() takes part as one of the workers. Steps may also go on
+// asynchronously, e.g. while waiting for I/O, without occupying a worker.
+class scheduler
+{
+public:
+  // 0 uses all hardware threads
+  explicit scheduler(int thread_count = 0);
+  ~scheduler();
+
+  scheduler(scheduler const &) = delete;
+  scheduler &operator=(scheduler const &) = delete;
+
+  int get_thread_count() const;
+
+  // calls run_step for the given steps once the ones of them feeding it have run, and
+  // returns when all are done; the steps have to include everything downstream of them.
+  // If run_step throws, the remaining steps are skipped and the first exception is rethrown.
+  void run(execution_plan const &, std::vector<int> const &steps, std::function<void(int)> const &run_step);
+  // like run, but start_step returns false for steps which go on asynchronously; their
+  // consumers are released once complete is called for them. Also after a failure, this
+  // only returns once every started step is complete.
+  void run_async(execution_plan const &, std::vector<int> const &steps, std::function<bool(int)> const &start_step);
+  // from any thread, for a step started asynchronously; an error fails the run like an
+  // exception of run_step
+  void complete(int step, std::exception_ptr error = nullptr);
+
+private:
+  struct work_queue;
+
+  void work(int worker);
+  bool execute(int worker, int step);
+  void fail(std::exception_ptr);
+  int steal(int worker, uint32_t &random);
+  int take_resumed();
+  void serve(int worker);
+
+  int thread_count;
+  std::vector<std::unique_ptr<work_queue>> queues;
+  std::unique_ptr<std::atomic<int>[]> pending;
+  size_t capacity;
+
+  execution_plan const *plan;
+  std::function<bool(int)> const *start_step;
+  std::atomic<int> remaining;
+  // steps going on asynchronously, decremented under mutex
+  std::atomic<int> outstanding;
+  std::atomic<bool> is_aborted;
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  std::condition_variable done;
+  uint64_t generation;
+  int active_workers;
+  bool is_stopping;
+  std::vector<std::thread> threads;
+
+  // consumers released by complete, for any worker
+  std::vector<int> resumed;
+  std::atomic<int> resumed_count;
+  std::mutex resumed_mutex;
+  std::condition_variable resumed_ready;
+};
+
+} // namespace skadi
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "engine.h"
+
+#include <atomic>
+#include <vector>
+
+namespace skadi
+{
+
+class scheduler;
+
+// Streams rows through a graph in fixed-size batches of columns, with the batch kernels of
+// its node types. Every batch runs through the whole graph before its buffers are reused,
+// so the memory in flight is bounded by the number of batches processed at once, one per
+// lane, times the columns of one batch.
+class stream_engine
+{
+public:
+  stream_engine(type_registry, kernel_registry, size_t batch_size = 4096);
+
+  stream_engine(stream_engine const &) = delete;
+  stream_engine &operator=(stream_engine const &) = delete;
+
+  // throws runtime_error like compile, and for node types without a batch kernel
+  void load(graph const &);
+
+  // pushes the rows [0, row_count) through the graph, one batch after the other; throws
+  // runtime_error naming the node if a kernel fails or gives the wrong number of rows
+  void run(int64_t row_count);
+  // up to lane_count batches are processed at once, one per thread of the scheduler by
+  // default; sinks see the batches out of order then
+  void run(int64_t row_count, scheduler &, int lane_count = 0);
+
+  size_t get_batch_size() const;
+  // bytes held by the column buffers of all lanes
+  size_t get_buffer_memory() const;
+
+private:
+  // the columns of one batch in flight
+  struct lane
+  {
+    std::vector<column> outputs;
+    std::vector<column const *> inputs; // into outputs, null if not connected
+  };
+
+  void add_lanes(int count);
+  void run_batch(lane &, batch_range);
+  void run_lane(int index);
+
+  type_registry registry;
+  kernel_registry kernels;
+  size_t batch_size;
+
+  execution_plan plan;
+  std::vector<batch_kernel const *> batch_kernels; // per step
+  std::vector<lane> lanes;
+
+  // lanes of a run, as independent steps for the scheduler
+  execution_plan lane_plan;
+  int64_t row_count;
+  std::atomic<int64_t> next_batch;
+  std::atomic<bool> is_aborted;
+};
+
+} // namespace skadi
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace skadi
+{
+
+// Keeps the nodes of a graph in a topological order while edges are added and removed, as
+// in Pearce and Kelly, "A Dynamic Topological Sort Algorithm for Directed Acyclic Graphs".
+// An edge which agrees with the order costs nothing; otherwise only the nodes between its
+// ends in the order are searched and moved. Edges which would close a cycle are refused.
+// Nodes are identified by ids, e.g. node_instance_ids; edges may be added more than once.
+class topological_order
+{
+public:
+  topological_order();
+
+  void add_node(int64_t);
+  // with its edges
+  void remove_node(int64_t);
+  bool has_node(int64_t) const;
+
+  // false if the edge would close a cycle, path is set to the nodes from destination back
+  // to source then; unknown nodes are errors
+  bool add_edge(int64_t source, int64_t destination, std::vector<int64_t> *path = nullptr);
+  void remove_edge(int64_t source, int64_t destination);
+
+  // like add_edge without adding it, e.g. while a connection is dragged
+  bool closes_cycle(int64_t source, int64_t destination, std::vector<int64_t> *path = nullptr) const;
+
+  // whether lhs comes before rhs in the current order
+  bool precedes(int64_t lhs, int64_t rhs) const;
+
+  size_t get_node_count() const;
+  // nodes searched by the last add_edge or closes_cycle, i.e. the size of the affected region
+  size_t get_visited_count() const;
+
+private:
+  struct node_record
+  {
+    int64_t id;
+    size_t position;
+    std::vector<int> successors;
+    std::vector<int> predecessors;
+  };
+
+  int get_slot(int64_t) const;
+  // depth first from first along successors over the nodes before bound in the order, or
+  // along predecessors over the ones after it; true if target is reached, the searched
+  // nodes are in visited
+  bool search(int first, size_t bound, int target, bool is_forward) const;
+  void get_path(int first, int target, std::vector<int64_t> &path) const;
+  void next_epoch() const;
+  void compact();
+
+  std::unordered_map<int64_t, int> slots;
+  std::vector<node_record> nodes;
+  std::vector<int> free_slots;
+  // position -> slot, -1 where a removed node was
+  std::vector<int> order;
+  size_t hole_count;
+
+  // scratch space of the searches, marked with the epoch so it is never cleared in full
+  mutable std::vector<uint32_t> marks;
+  mutable std::vector<int> parents;
+  mutable uint32_t epoch;
+  mutable std::vector<int> visited;
+  mutable std::vector<int> pending;
+  mutable size_t visited_count;
+  std::vector<int> forward;
+  std::vector<size_t> positions;
+};
+
+} // namespace skadi
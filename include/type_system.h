@@ -0,0 +1,56 @@
+#pragma once
+
+#include "graph.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace skadi
+{
+
+struct type_error
+{
+  connection_instance_id connection;
+  std::string message;
+};
+
+// Which data types an input accepts, precomputed from a type_registry: its own, the ones
+// converting to it (also over several conversions) and any if either side is a wildcard,
+// i.e. a data type named "any". Data types which are not in the registry are compatible
+// with nothing.
+class type_system
+{
+public:
+  explicit type_system(type_registry const &);
+
+  bool is_known(data_type_id) const;
+  bool is_compatible(data_type_id from, data_type_id to) const;
+
+  // ports referencing unknown data types and conversions between them
+  std::vector<std::string> const &get_registry_errors() const;
+
+  // linear in the number of nodes and connections
+  std::vector<type_error> check(graph const &) const;
+
+private:
+  struct port_types
+  {
+    std::unordered_map<std::string, int> inputs;
+    std::unordered_map<std::string, int> outputs;
+  };
+
+  int get_index(data_type_id) const;
+  bool is_index_compatible(int from, int to) const;
+
+  std::unordered_map<int64_t, int> indices;
+  size_t type_count;
+  // type_count * type_count, a row per source type
+  std::vector<uint8_t> matrix;
+  // port name -> index of its data type, -1 for unknown ones
+  std::unordered_map<int64_t, port_types> node_types;
+  std::vector<std::string> registry_errors;
+};
+
+} // namespace skadi
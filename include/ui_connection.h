@@ -1,5 +1,6 @@
 #pragma once
 
+#include "QtGui/QPolygonF"
 #include "QtWidgets/QGraphicsItem"
 
 namespace skadi
@@ -15,6 +16,8 @@ class ui_connection
   Q_INTERFACES(QGraphicsItem)
 
 public:
+  enum { Type = UserType + 2 };
+
   ui_connection(ui_node *source, int source_port,
                 ui_node *destination = nullptr, int destination_port = 0);
   ~ui_connection();
@@ -22,12 +25,17 @@ public:
   ui_connection(ui_connection const &) = delete;
   ui_connection &operator=(ui_connection const &) = delete;
 
+  void set_source_port(int source_port);
   void set_destination(ui_node *destination, int destination_port);
 
   std::pair<ui_node *, int> get_source() const;
   std::pair<ui_node *, int> get_destination() const;
 
+  // path between the insertion points of the ports, in scene coordinates
+  void set_route(QPolygonF const &);
+
 public slots:
+  void invalidate_positions();
   void update_positions();
 
 private:
@@ -45,6 +53,7 @@ private:
   void mouseMoveEvent(QGraphicsSceneMouseEvent *event) override;
   void mouseReleaseEvent(QGraphicsSceneMouseEvent *event) override;
 
+  void build_path();
   void update_destination(QGraphicsSceneMouseEvent *event);
   ui_node *find_node(QPointF) const;
 
@@ -53,9 +62,14 @@ private:
   ui_node *destination;
   int destination_port;
 
+  QPointF loose_end;
+  QPointF source_anchor;
+  QPointF destination_anchor;
+  QPolygonF route;
   QPainterPath path;
   bool is_hovered;
   bool was_dragged;
+  bool is_dirty;
 };
 
 } // namespace skadi
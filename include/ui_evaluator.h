@@ -0,0 +1,100 @@
+#pragma once
+
+#include "engine.h"
+#include "scheduler.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "QtCore/QObject"
+#include "QtCore/QString"
+#include "QtCore/QTimer"
+
+namespace skadi
+{
+
+class plugin_host;
+class ui_scene;
+
+// Keeps an engine in sync with the edits of a scene and evaluates the graph again shortly
+// after them, computing only the nodes the edits affect. The engine lives on a worker
+// thread and only sees the edits and snapshots of the content handed to it; edits made
+// while it runs start another run, and only the summary of the latest one is published,
+// on the thread owning the ui_evaluator.
+class ui_evaluator
+  : public QObject
+{
+  Q_OBJECT
+
+public:
+  ui_evaluator(ui_scene *, type_registry, kernel_registry, QObject *parent = nullptr);
+  // waits for a run in progress
+  ~ui_evaluator();
+
+  ui_evaluator(ui_evaluator const &) = delete;
+  ui_evaluator &operator=(ui_evaluator const &) = delete;
+
+  // e.g. after the registry has been reloaded; everything is computed again
+  void reset(type_registry, kernel_registry);
+  // kept across resets, null for none; the hits and misses are part of the summary
+  void set_cache(output_cache *);
+  // the libraries providing the node types of the graph are loaded before it is evaluated
+  // and their kernels added; null for none
+  void set_plugins(plugin_host *);
+
+signals:
+  void evaluated(QString summary);
+
+private slots:
+  void start();
+  void publish();
+
+private:
+  using edit = std::function<void(engine &)>;
+
+  void schedule();
+  void add_edit(edit);
+  // with the mutex locked; the content replaces the edits not handed over yet
+  void take_content();
+  bool is_plugin_outdated(node_type_id) const;
+  void run();
+  void make_engine();
+
+  ui_scene *scene;
+  plugin_host *plugins;
+  std::vector<edit> edits;
+  QTimer debounce;
+  bool is_reset;
+
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  std::optional<type_registry> pending_registry;
+  std::optional<kernel_registry> pending_kernels;
+  std::optional<plugin_host *> pending_plugins;
+  std::optional<output_cache *> pending_cache;
+  std::optional<graph> pending_content;
+  std::vector<edit> pending_edits;
+  bool is_run_pending;
+  QString finished_summary;
+  bool is_publish_scheduled;
+  bool is_stopping;
+
+  // used by the worker only
+  type_registry registry;
+  kernel_registry kernels;
+  plugin_host *engine_plugins;
+  output_cache *cache;
+  std::unique_ptr<engine> graph_engine;
+  scheduler pool;
+  // libraries loaded when the engine was made
+  std::atomic<size_t> plugin_count;
+  std::thread worker;
+};
+
+} // namespace skadi
@@ -1,22 +1,30 @@
 #pragma once
 
 #include "graph.h"
+#include "library_index.h"
+#include "registry_diff.h"
 
-#include <variant>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
-#include "QtGui/QStandardItem"
-#include "QtGui/QStandardItemModel"
+#include "QtCore/QAbstractItemModel"
 
 namespace skadi
 {
 
+// Node types grouped by their categories, which are split into a hierarchy at '/'.
+// Only the root exists after construction; the children of a category are built when a
+// view fetches them, so the cost of the model grows with what has been expanded.
+// A new version of the registry only inserts and removes the rows of fetched categories.
 class ui_library_model
   : public QAbstractItemModel
 {
   Q_OBJECT
 
 public:
-  explicit ui_library_model(type_registry const &);
+  explicit ui_library_model(std::shared_ptr<type_registry const>);
   ~ui_library_model();
 
   QVariant data(QModelIndex const &index, int role) const override;
@@ -25,6 +33,26 @@ public:
   QModelIndex parent(QModelIndex const &index) const override;
   int rowCount(QModelIndex const &parent = QModelIndex()) const override;
   int columnCount(QModelIndex const &parent = QModelIndex()) const override;
+  bool hasChildren(QModelIndex const &parent = QModelIndex()) const override;
+  bool canFetchMore(QModelIndex const &parent) const override;
+  void fetchMore(QModelIndex const &parent) override;
+
+  std::shared_ptr<type_registry const> get_registry() const;
+  void update_registry(std::shared_ptr<type_registry const>, registry_diff const &);
+
+  // search index entries are the positions of the node types in the registry; the registry
+  // is immutable, so the index can be built on another thread
+  static std::shared_ptr<library_index const> make_search_index(type_registry const &);
+  // entries at or below an index, in registry order
+  std::vector<int> const &get_entries(QModelIndex const &) const;
+  node_type const &get_node_type(int entry) const;
+  int get_node_type_count() const;
+
+  static QMimeData *make_mime_data(node_type const &);
+
+signals:
+  // entries refer to the new registry
+  void registry_changed();
 
 private:
   Qt::DropActions supportedDragActions() const override;
@@ -32,15 +60,19 @@ private:
   QStringList mimeTypes() const override;
   QMimeData *mimeData(QModelIndexList const &) const override;
 
-  bool is_valid_index(QModelIndex const &) const;
-  struct node_item;
-  struct category_item;
-  struct index_data;
-  using item = std::variant<category_item, node_item>;
+  struct item;
+
+  item *get_item(QModelIndex const &) const;
+  QModelIndex get_index(item *) const;
+  void fetch(item *);
+  void insert_child(item *parent, int row, std::unique_ptr<item>);
+  void remove_child(item *parent, int row);
+  void insert_entry(int);
+  void remove_entry(int);
 
-  std::vector<index_data> index_map;
-  std::vector<int> index_reverse_map;
-  std::vector<item> model;
+  std::shared_ptr<type_registry const> registry;
+  std::unique_ptr<item> root;
+  std::unordered_map<int64_t, item *> node_items; // fetched ones by guid
 };
 
 } // namespace skadi
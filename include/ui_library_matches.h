@@ -0,0 +1,44 @@
+#pragma once
+
+#include "graph.h"
+
+#include <vector>
+
+#include "QtCore/QAbstractListModel"
+
+namespace skadi
+{
+
+class ui_library_model;
+class ui_tree_filter;
+
+// Flat list of the best ranked matches of the library filter, shown above the category tree.
+// Entries are shown by name with their category as tool tip, and drag like library nodes.
+class ui_library_matches
+  : public QAbstractListModel
+{
+  Q_OBJECT
+
+public:
+  ui_library_matches(ui_library_model *, ui_tree_filter *, QObject *parent = nullptr);
+
+  QVariant data(QModelIndex const &index, int role) const override;
+  Qt::ItemFlags flags(QModelIndex const &index) const override;
+  int rowCount(QModelIndex const &parent = QModelIndex()) const override;
+
+  Qt::DropActions supportedDragActions() const override;
+  QStringList mimeTypes() const override;
+  QMimeData *mimeData(QModelIndexList const &) const override;
+
+public slots:
+  void update_matches();
+
+private:
+  node_type const *get_node_type(QModelIndex const &) const;
+
+  ui_library_model *library;
+  ui_tree_filter *filter;
+  std::vector<int> matches;
+};
+
+} // namespace skadi
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "library_index.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "QtCore/QObject"
+#include "QtCore/QTimer"
+
+namespace skadi
+{
+
+// Searches a library_index on a worker thread, which also builds the index first. Queries
+// are debounced while typing, a new query cancels the one in progress and only the result
+// of the latest query is published, on the thread owning the ui_library_search.
+class ui_library_search
+  : public QObject
+{
+  Q_OBJECT
+
+public:
+  using index_factory = std::function<std::shared_ptr<library_index const>()>;
+
+  explicit ui_library_search(index_factory, QObject *parent = nullptr);
+  ~ui_library_search();
+
+  ui_library_search(ui_library_search const &) = delete;
+  ui_library_search &operator=(ui_library_search const &) = delete;
+
+  // the query of the current result, which is empty until the first one was published
+  std::string const &get_query() const;
+  // matching entries in ascending order
+  std::vector<int> const &get_result() const;
+  // the best ranked entries of the result
+  std::vector<int> const &get_best() const;
+
+  // replaces the index, the current query is searched again
+  void reset(index_factory);
+
+public slots:
+  void set_query(QString const &);
+
+signals:
+  void result_changed();
+
+private slots:
+  void start();
+  void publish();
+
+private:
+  void run();
+
+  QTimer debounce;
+  std::string query;
+  std::string result_query;
+  std::vector<int> result;
+  std::vector<int> best;
+
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  std::optional<std::string> pending;
+  std::optional<index_factory> pending_index;
+  std::string finished_query;
+  std::vector<int> finished_result;
+  std::vector<int> finished_best;
+  std::atomic<bool> cancel;
+  bool is_publish_scheduled;
+  bool is_stopping;
+  std::thread worker;
+};
+
+} // namespace skadi
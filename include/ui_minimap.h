@@ -0,0 +1,55 @@
+#pragma once
+
+#include "QtGui/QImage"
+#include "QtGui/QRegion"
+#include "QtGui/QTransform"
+#include "QtWidgets/QWidget"
+
+namespace skadi
+{
+
+class ui_scene;
+class ui_view;
+
+// Overview of the whole graph. Nodes and connections are drawn into a cached image,
+// which is only redrawn where the scene reports changes; the visible region of the
+// view is shown on top and the view follows clicks and drags.
+class ui_minimap
+  : public QWidget
+{
+  Q_OBJECT
+
+public:
+  ui_minimap(ui_scene *, ui_view *, QWidget *parent = nullptr);
+  ~ui_minimap();
+
+  ui_minimap(ui_minimap const &) = delete;
+  ui_minimap &operator=(ui_minimap const &) = delete;
+
+  QSize sizeHint() const override;
+
+private slots:
+  void scene_changed(QList<QRectF> const &);
+  void visible_region_changed(QRectF);
+
+private:
+  void paintEvent(QPaintEvent *) override;
+  void resizeEvent(QResizeEvent *) override;
+  void mousePressEvent(QMouseEvent *) override;
+  void mouseMoveEvent(QMouseEvent *) override;
+
+  void reset_mapping();
+  void redraw(QRegion const &);
+  void center_view(QPoint);
+
+  ui_scene *scene;
+  ui_view *view;
+
+  QImage cache;
+  QRegion dirty;
+  QRectF mapped_bounds;
+  QTransform scene_to_image;
+  QRectF visible;
+};
+
+} // namespace skadi
@@ -20,6 +20,8 @@ class ui_node
   Q_INTERFACES(QGraphicsItem)
 
 public:
+  enum { Type = UserType + 1 };
+
   explicit ui_node(node_type const &);
   ~ui_node();
 
@@ -33,6 +35,7 @@ public:
   QColor get_output_color(int) const;
 
   node_type const &get_type_info() const;
+  void set_type_info(node_type const &);
 
 signals:
   void positionChanged();
@@ -47,6 +50,8 @@ private:
   QVariant itemChange(GraphicsItemChange, QVariant const &) override;
 
   void calculate_layout();
+  QPointF get_input_offset(int) const;
+  QPointF get_output_offset(int) const;
 
   int get_output_index(QPointF) const;
   void mousePressEvent(QGraphicsSceneMouseEvent *) override;
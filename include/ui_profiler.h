@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+namespace skadi
+{
+
+// Per-frame paint statistics for the profiler overlay of ui_view.
+// Instrumented code adds to the current frame, ui_view closes it after painting.
+// Everything is a no-op while the profiler is disabled.
+class ui_profiler
+{
+public:
+  enum class timer
+  {
+    node_paint,
+    connection_paint,
+    background,
+    count
+  };
+
+  enum class counter
+  {
+    items_painted,
+    spatial_queries,
+    position_updates,
+    count
+  };
+
+  struct frame
+  {
+    double frame_time;
+    double frame_interval;
+    std::array<double, static_cast<size_t>(timer::count)> timers;
+    std::array<int64_t, static_cast<size_t>(counter::count)> counters;
+  };
+
+  class scoped_timer
+  {
+  public:
+    explicit scoped_timer(timer);
+    ~scoped_timer();
+
+    scoped_timer(scoped_timer const &) = delete;
+    scoped_timer &operator=(scoped_timer const &) = delete;
+
+  private:
+    timer t;
+    bool is_active;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  static ui_profiler &instance();
+
+  bool is_enabled() const;
+  void set_enabled(bool);
+
+  void add_time(timer, double milliseconds);
+  void increment(counter, int64_t = 1);
+  void end_frame(double frame_time);
+
+  std::deque<frame> const &get_history() const;
+
+  // writes all recorded frames as json
+  void save(std::string const &file) const;
+
+  static char const *name(timer);
+  static char const *name(counter);
+
+private:
+  ui_profiler();
+
+  bool enabled;
+  frame current;
+  std::chrono::steady_clock::time_point last_frame;
+  std::deque<frame> history;
+};
+
+} // namespace skadi
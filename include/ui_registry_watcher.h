@@ -0,0 +1,52 @@
+#pragma once
+
+#include "graph.h"
+#include "picojson.h"
+#include "registry_diff.h"
+
+#include <functional>
+#include <memory>
+
+#include "QtCore/QFileSystemWatcher"
+#include "QtCore/QObject"
+#include "QtCore/QString"
+#include "QtCore/QTimer"
+
+namespace skadi
+{
+
+// Reloads the type registry when the config file changes and announces the differences
+// to the current version. Editors often save in several steps, so changes are debounced,
+// and a file which cannot be parsed is ignored until the next change.
+class ui_registry_watcher
+  : public QObject
+{
+  Q_OBJECT
+
+public:
+  ui_registry_watcher(QString config_file, std::shared_ptr<type_registry const>, picojson::value registry_config, QObject *parent = nullptr);
+
+  // applied to every reloaded registry, e.g. to add the types of plugins
+  void set_extension(std::function<void(type_registry &)>);
+
+  std::shared_ptr<type_registry const> get_registry() const;
+  // the registry as last loaded from the config file
+  picojson::value const &get_registry_config() const;
+
+signals:
+  // emitted after the new registry has been made current; only for direct connections
+  void registry_changed(std::shared_ptr<type_registry const>, registry_diff const &);
+
+private slots:
+  void reload();
+
+private:
+  QString config_file;
+  QFileSystemWatcher watcher;
+  QTimer debounce;
+  std::function<void(type_registry &)> extend;
+  std::shared_ptr<type_registry const> registry;
+  picojson::value registry_config;
+};
+
+} // namespace skadi
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "edge_router.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "QtCore/QObject"
+#include "QtCore/QRectF"
+#include "QtGui/QPolygonF"
+
+namespace skadi
+{
+
+// Runs an edge_router on a worker thread. Changes are queued and applied in batches,
+// new routes are published on the thread owning the ui_router.
+class ui_router
+  : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit ui_router(QObject *parent = nullptr);
+  ~ui_router();
+
+  ui_router(ui_router const &) = delete;
+  ui_router &operator=(ui_router const &) = delete;
+
+  void set_obstacle(int64_t id, QRectF);
+  void remove_obstacle(int64_t id);
+  void set_edge(int64_t id, QPointF source, QPointF destination);
+  void remove_edge(int64_t id);
+
+  // blocks until all queued changes are routed and publishes the routes right away
+  void flush();
+
+signals:
+  // route in scene coordinates, empty if the edge could not be routed
+  void route_changed(qint64 id, QPolygonF route);
+
+private slots:
+  void publish();
+
+private:
+  void post(std::function<void(edge_router &)>);
+  void run();
+
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  std::condition_variable idle;
+  std::vector<std::function<void(edge_router &)>> pending;
+  std::vector<std::pair<int64_t, route>> finished;
+  bool is_busy;
+  bool is_publish_scheduled;
+  bool is_stopping;
+  std::thread worker;
+};
+
+} // namespace skadi
@@ -2,18 +2,28 @@
 
 #include "graph.h"
 #include "picojson.h"
+#include "registry_diff.h"
+#include "topological_order.h"
+#include "type_system.h"
 
+#include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "QtWidgets/QgraphicsScene"
+#include "QtCore/QLineF"
+#include "QtCore/QPointer"
 #include "QtCore/QPointF"
+#include "QtCore/QRectF"
+#include "QtCore/QStringList"
 
 namespace skadi
 {
 
 class ui_node;
 class ui_connection;
+class ui_router;
 
 struct node_layout
 {
@@ -43,6 +53,10 @@ public:
 
   void clear();
 
+  // switches to a new version of the registry: nodes of removed types are deleted, nodes of
+  // changed types are laid out again and their connections follow the ports by name
+  void update_registry(type_registry, registry_diff const &);
+
   graph get_content() const;
   void set_content(graph);
 
@@ -50,23 +64,122 @@ public:
   void set_layout(graph_layout);
 
   ui_connection *create_connection(ui_node *source, int source_port);
+  // a dragged connection has been dropped onto an input
+  void commit_connection(ui_connection *);
 
   bool is_input_connected(ui_node *node, int port);
   bool is_output_connected(ui_node *node, int port);
 
   void create_node(node_type_id, QPointF pos);
+  void delete_node(ui_node *);
+
+  void invalidate_connection(ui_connection *);
+  void invalidate_ports(ui_node *);
+
+  // requests a route around the nodes between the insertion points of a connection
+  void route_connection(ui_connection *, QPointF source, QPointF destination);
+
+  // nearest input port within radius of a scene position which accepts the data type of an
+  // output, ignoring the ports of its node
+  std::pair<ui_node *, int> find_input(QPointF, qreal radius, ui_node const *source, int source_port);
+
+  bool can_connect(ui_node const *source, int source_port, ui_node const *destination, int destination_port) const;
+  // while a connection is dragged nodes highlight the inputs accepting it
+  void begin_drag(ui_node *source, int source_port);
+  void end_drag();
+  std::pair<ui_node *, int> get_drag_source() const;
+
+  // connections loaded with incompatible or unknown types, see type_system::check, or
+  // closing a cycle
+  bool is_invalid(ui_connection const *) const;
+
+  // false if a connection from source to destination would close a cycle, which is kept
+  // highlighted then until a connection is accepted or the drag ends; the check only
+  // searches the nodes between both in a topological order
+  bool check_cycle(ui_node const *source, ui_node const *destination);
+  bool is_on_rejected_cycle(ui_node const *) const;
+  bool is_on_rejected_cycle(ui_connection const *) const;
+
+  // applies pending updates and waits for all routes, for rendering without an event loop
+  void finish_routing();
+
+  // in virtualized mode the graph is kept in a compact model with a spatial index, and
+  // ui_nodes / ui_connections only exist for the region around the visible area
+  void set_virtualized(bool);
+  bool is_virtualized() const;
+  void set_visible_region(QRectF);
+  QRectF content_bounds() const;
+
+  // node rects and straight connection lines intersecting an area, including the ones
+  // which are not materialized in virtualized mode
+  void get_overview(QRectF area, std::vector<QRectF> &node_rects, std::vector<QLineF> &connection_lines) const;
+
+signals:
+  // a node of a type has been instantiated, e.g. to load the plugin providing it
+  void node_type_used(node_type_id);
+
+  // edits of the content, e.g. to evaluate the graph incrementally; after a reset all of it
+  // may have changed
+  void content_reset();
+  void node_added(node);
+  void node_removed(node_instance_id);
+  void connection_added(connection);
+  void connection_removed(connection_instance_id);
+
+  // after the content has been loaded or the registry changed, empty if there are no errors
+  void content_checked(QStringList errors);
 
 public slots:
+  void update_connections();
   void remove_connection(connection_instance_id);
   void remove_node(node_instance_id);
 
 private:
+  struct virtual_model;
+  struct port_index;
+
   void add_connection(connection_instance_id, ui_connection *);
   void add_node(node_instance_id, ui_node *);
 
+  void schedule_update();
+  void update_ports();
+  // items only grow the content bounds, removals have them computed again when needed
+  void grow_content_bounds(QRectF);
+  void invalidate_content_bounds();
+  void check_content();
+  void set_rejected_cycle(std::vector<int64_t> const &path);
+
+  void sync_model();
+  void update_materialized();
+  void acquire_node(node_instance_id);
+  void release_node(node_instance_id);
+  void acquire_connection(connection_instance_id);
+  void release_connection(connection_instance_id);
+
   type_registry registry;
+  type_system types;
+  std::unordered_set<int64_t> type_errors;
+  // of the nodes by id; connections are edges of it once they have a destination
+  topological_order order;
+  std::unordered_map<int64_t, std::pair<int64_t, int64_t>> ordered_connections;
+  std::unordered_set<int64_t> cyclic_connections;
+  // node id -> next one on the cycle a rejected connection would close
+  std::unordered_map<int64_t, int64_t> rejected_cycle;
+  std::pair<ui_node *, int> drag_source;
   std::map<node_instance_id, ui_node *> nodes;
+  std::unordered_map<ui_node const *, node_instance_id> node_ids;
   std::map<connection_instance_id, ui_connection *> connections;
+  std::unordered_map<ui_connection const *, connection_instance_id> connection_ids;
+  std::vector<QPointer<ui_connection>> dirty_connections;
+  ui_router *router;
+  std::unique_ptr<port_index> ports;
+  bool is_update_scheduled;
+  // of the items in normal mode, so changes of the scene do not walk all of them
+  mutable QRectF item_bounds;
+  mutable bool is_item_bounds_outdated;
+
+  bool virtualized;
+  std::unique_ptr<virtual_model> model;
 
   int64_t last_node_uid;
   int64_t last_connection_uid;
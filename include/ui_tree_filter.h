@@ -1,10 +1,20 @@
 #pragma once
 
+#include <memory>
+#include <vector>
+
 #include "QtCore/QSortFilterProxyModel"
 
 namespace skadi
 {
 
+class ui_library_model;
+class ui_library_search;
+
+// Filters the leaves of a tree, categories stay visible while any of their leaves does.
+// For a ui_library_model the query is answered asynchronously by its search index and the
+// filter is reset at once when the result arrives; a category is checked against the node
+// types below it without fetching its children. Other models fall back to the wildcard filter.
 class ui_tree_filter
   : public QSortFilterProxyModel
 {
@@ -12,9 +22,31 @@ class ui_tree_filter
 
 public:
   ui_tree_filter(QObject *parent);
+  ~ui_tree_filter();
+
+  void setSourceModel(QAbstractItemModel *) override;
+
+  // search index entries of the best ranked matches of the current query
+  std::vector<int> get_best_matches(size_t count) const;
+  bool is_filtered() const;
+  size_t get_match_count() const;
+
+public slots:
+  void set_query(QString const &);
+
+signals:
+  void query_changed();
+
+private slots:
+  void update_result();
 
 private:
   bool filterAcceptsRow(int, QModelIndex const &) const override;
+
+  ui_library_model *library;
+  ui_library_search *search;
+  bool filtered;
+  std::vector<bool> accepted;
 };
 
 } // namespace skadi
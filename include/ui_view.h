@@ -7,6 +7,12 @@
 namespace skadi
 {
 
+enum class render_mode
+{
+  raster,
+  opengl
+};
+
 class ui_view
   : public QGraphicsView
 {
@@ -19,15 +25,42 @@ public:
   ui_view(ui_view const &) = delete;
   ui_view &operator=(ui_view const &) = delete;
 
+  // switches the viewport widget; falls back to raster if no OpenGL context can be created
+  render_mode set_render_mode(render_mode);
+  render_mode get_render_mode() const;
+
+  QRectF get_visible_region() const;
+
+  // overlay with frame times and paint costs, toggled with F3; F4 saves the recorded frames
+  // to the profile file, skadi_profile.json in the working directory by default
+  void set_profiler_enabled(bool);
+  bool is_profiler_enabled() const;
+  void set_profile_file(QString);
+
+signals:
+  void visible_region_changed(QRectF);
+  // where the profile has been saved to, or why that failed
+  void profile_saved(QString message);
+
 private:
   void dragEnterEvent(QDragEnterEvent *) override;
   void dragMoveEvent(QDragMoveEvent *) override;
   void dropEvent(QDropEvent *) override;
   void drawBackground(QPainter *, QRectF const &) override;
+  void drawForeground(QPainter *, QRectF const &) override;
+  void keyPressEvent(QKeyEvent *) override;
+  void paintEvent(QPaintEvent *) override;
+  void resizeEvent(QResizeEvent *) override;
+  void scrollContentsBy(int, int) override;
   void showEvent(QShowEvent *) override;
   void wheelEvent(QWheelEvent *) override;
 
+  void update_visible_region();
+
   ui_scene *scene;
+  render_mode mode;
+  ViewportUpdateMode update_mode;
+  QString profile_file;
 };
 
 } // namespace skadi
@@ -0,0 +1,472 @@
+#include "edge_router.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "boost/geometry.hpp"
+#include "boost/geometry/index/rtree.hpp"
+#include "boost/iterator/function_output_iterator.hpp"
+
+namespace skadi
+{
+
+namespace constants
+{
+  static double const clearance = 8;
+  static double const region_margin = 120;
+  static int const region_attempts = 2;
+  static double const region_growth = 4;
+  static size_t const max_grid_cells = 250000;
+  static double const bend_penalty = 30;
+  static double const shared_channel_factor = 0.6;
+}
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+namespace
+{
+  using point = bg::model::point<double, 2, bg::cs::cartesian>;
+  using box = bg::model::box<point>;
+  using entry = std::pair<box, int64_t>;
+  using rtree = bgi::rtree<entry, bgi::quadratic<16>>;
+
+  box to_box(route_rect r)
+  {
+    return box(point(r.left, r.top), point(r.right, r.bottom));
+  }
+
+  double left(box const &b) { return b.min_corner().get<0>(); }
+  double top(box const &b) { return b.min_corner().get<1>(); }
+  double right(box const &b) { return b.max_corner().get<0>(); }
+  double bottom(box const &b) { return b.max_corner().get<1>(); }
+
+  bool strictly_inside(box const &b, route_point p)
+  {
+    return (p.x > left(b)) && (p.x < right(b)) && (p.y > top(b)) && (p.y < bottom(b));
+  }
+
+  box route_bounds(route const &r)
+  {
+    auto result = box(point(r.front().x, r.front().y), point(r.front().x, r.front().y));
+    for(auto &&p : r)
+    {
+      bg::expand(result, point(p.x, p.y));
+    }
+    return result;
+  }
+
+  // neighbour offsets for the directions +x, -x, +y, -y
+  int const direction_dx[] = {1, -1, 0, 0};
+  int const direction_dy[] = {0, 0, 1, -1};
+}
+
+struct edge_router::state
+{
+  struct edge
+  {
+    route_point source;
+    route_point destination;
+    route path;
+  };
+
+  template<typename F>
+  void query(rtree const &index, box const &region, F &&f) const
+  {
+    index.query(bgi::intersects(region), boost::make_function_output_iterator(std::forward<F>(f)));
+  }
+
+  void invalidate(box const &region)
+  {
+    query(route_index, region, [&](entry const &e) { dirty.insert(e.second); });
+  }
+
+  void clear_route(int64_t id)
+  {
+    auto &&path = edges.at(id).path;
+    if(!path.empty())
+    {
+      route_index.remove(entry{route_bounds(path), id});
+      path.clear();
+    }
+    if(auto it = channels.find(id); it != end(channels))
+    {
+      channel_index.remove(it->second);
+      channels.erase(it);
+    }
+  }
+
+  void store_route(int64_t id, route path)
+  {
+    if(!path.empty())
+    {
+      route_index.insert(entry{route_bounds(path), id});
+
+      auto &&segments = channels[id];
+      for(size_t i = 1; i < path.size(); ++i)
+      {
+        auto const &a = path[i - 1];
+        auto const &b = path[i];
+        segments.emplace_back(box(point(std::min(a.x, b.x), std::min(a.y, b.y)),
+                                  point(std::max(a.x, b.x), std::max(a.y, b.y))), id);
+      }
+      channel_index.insert(segments);
+    }
+    edges.at(id).path = std::move(path);
+  }
+
+  route find_route(route_point source, route_point destination) const;
+  route find_route(route_point source, route_point destination, box const &region) const;
+
+  std::unordered_map<int64_t, route_rect> obstacles;
+  rtree obstacle_index;
+  std::unordered_map<int64_t, edge> edges;
+  rtree route_index;
+  rtree channel_index;
+  std::unordered_map<int64_t, std::vector<entry>> channels;
+  std::unordered_set<int64_t> dirty;
+};
+
+route edge_router::state::find_route(route_point source, route_point destination) const
+{
+  auto margin = constants::region_margin;
+  for(int attempt{}; attempt < constants::region_attempts; ++attempt)
+  {
+    box const region(point(std::min(source.x, destination.x) - margin, std::min(source.y, destination.y) - margin),
+                     point(std::max(source.x, destination.x) + margin, std::max(source.y, destination.y) + margin));
+    auto result = find_route(source, destination, region);
+    if(!result.empty())
+    {
+      return result;
+    }
+    margin *= constants::region_growth;
+  }
+  return{};
+}
+
+route edge_router::state::find_route(route_point source, route_point destination, box const &region) const
+{
+  // the sparse grid is spanned by the region, the endpoints, the obstacles and the channels
+  std::vector<double> xs{left(region), right(region), source.x, destination.x};
+  std::vector<double> ys{top(region), bottom(region), source.y, destination.y};
+
+  // everything is clipped to the region, as obstacles outside of it are unknown
+  auto clip = [&](box b)
+  {
+    bg::set<bg::min_corner, 0>(b, std::max(left(b), left(region)));
+    bg::set<bg::min_corner, 1>(b, std::max(top(b), top(region)));
+    bg::set<bg::max_corner, 0>(b, std::min(right(b), right(region)));
+    bg::set<bg::max_corner, 1>(b, std::min(bottom(b), bottom(region)));
+    xs.push_back(left(b));
+    xs.push_back(right(b));
+    ys.push_back(top(b));
+    ys.push_back(bottom(b));
+    return b;
+  };
+
+  std::vector<box> local_obstacles;
+  query(obstacle_index, region, [&](entry const &e)
+  {
+    auto b = e.first;
+    bg::set<bg::min_corner, 0>(b, left(b) - constants::clearance);
+    bg::set<bg::min_corner, 1>(b, top(b) - constants::clearance);
+    bg::set<bg::max_corner, 0>(b, right(b) + constants::clearance);
+    bg::set<bg::max_corner, 1>(b, bottom(b) + constants::clearance);
+    if(strictly_inside(b, source) || strictly_inside(b, destination))
+    {
+      local_obstacles.clear();
+      xs.clear();
+    }
+    if(!xs.empty())
+    {
+      local_obstacles.push_back(b);
+      clip(b);
+    }
+  });
+
+  if(xs.empty()) // one of the endpoints is covered by an obstacle
+  {
+    return{};
+  }
+
+  std::vector<box> local_channels;
+  query(channel_index, region, [&](entry const &e)
+  {
+    local_channels.push_back(clip(e.first));
+  });
+
+  for(auto v : {&xs, &ys})
+  {
+    std::sort(begin(*v), end(*v));
+    v->erase(std::unique(begin(*v), end(*v)), end(*v));
+  }
+
+  auto const nx = static_cast<int>(xs.size());
+  auto const ny = static_cast<int>(ys.size());
+  if(static_cast<size_t>(nx) * static_cast<size_t>(ny) > constants::max_grid_cells)
+  {
+    return{};
+  }
+
+  auto index_of = [](std::vector<double> const &v, double value)
+  {
+    return static_cast<int>(std::lower_bound(begin(v), end(v), value) - begin(v));
+  };
+  auto cell = [=](int i, int j)
+  {
+    return j * nx + i;
+  };
+
+  // grid edges are stored with their lower / left cell; horizontal ones go to i + 1, vertical ones to j + 1
+  std::vector<char> blocked_h(static_cast<size_t>(nx * ny)), blocked_v(static_cast<size_t>(nx * ny));
+  std::vector<char> shared_h(static_cast<size_t>(nx * ny)), shared_v(static_cast<size_t>(nx * ny));
+
+  for(auto &&b : local_obstacles)
+  {
+    // borders cut off by the region are blocked as well
+    auto const l = index_of(xs, std::max(left(b), left(region)));
+    auto const r = index_of(xs, std::min(right(b), right(region)));
+    auto const t = index_of(ys, std::max(top(b), top(region)));
+    auto const btm = index_of(ys, std::min(bottom(b), bottom(region)));
+    auto const first_i = (left(b) < left(region)) ? l : l + 1;
+    auto const last_i = (right(b) > right(region)) ? r : r - 1;
+    auto const first_j = (top(b) < top(region)) ? t : t + 1;
+    auto const last_j = (bottom(b) > bottom(region)) ? btm : btm - 1;
+    for(auto j = first_j; j <= last_j; ++j)
+    {
+      for(auto i = l; i < r; ++i)
+      {
+        blocked_h[cell(i, j)] = 1;
+      }
+    }
+    for(auto j = t; j < btm; ++j)
+    {
+      for(auto i = first_i; i <= last_i; ++i)
+      {
+        blocked_v[cell(i, j)] = 1;
+      }
+    }
+  }
+
+  for(auto &&b : local_channels)
+  {
+    auto const l = index_of(xs, left(b));
+    auto const r = index_of(xs, right(b));
+    auto const t = index_of(ys, top(b));
+    auto const btm = index_of(ys, bottom(b));
+    if(t == btm)
+    {
+      for(auto i = l; i < r; ++i)
+      {
+        shared_h[cell(i, t)] = 1;
+      }
+    }
+    else if(l == r)
+    {
+      for(auto j = t; j < btm; ++j)
+      {
+        shared_v[cell(l, j)] = 1;
+      }
+    }
+  }
+
+  auto const source_i = index_of(xs, source.x);
+  auto const source_j = index_of(ys, source.y);
+  auto const destination_i = index_of(xs, destination.x);
+  auto const destination_j = index_of(ys, destination.y);
+
+  // not admissible with discounted channels, but searches far fewer states than the exact bound
+  auto heuristic = [&](int i, int j)
+  {
+    return std::abs(xs[i] - destination.x) + std::abs(ys[j] - destination.y);
+  };
+
+  // states are (cell, direction of arrival); the extra state past the end is the terminal,
+  // entered from the destination cell with a penalty unless arriving in +x like the input port
+  auto const state_count = nx * ny * 4;
+  auto const terminal = state_count;
+  std::vector<double> cost(static_cast<size_t>(state_count + 1), std::numeric_limits<double>::infinity());
+  std::vector<int> previous(static_cast<size_t>(state_count + 1), -1);
+
+  using queue_item = std::pair<double, int>;
+  std::priority_queue<queue_item, std::vector<queue_item>, std::greater<queue_item>> open;
+
+  auto const start = cell(source_i, source_j) * 4; // leaves the output port in +x
+  cost[start] = 0;
+  open.push({heuristic(source_i, source_j), start});
+
+  while(!open.empty())
+  {
+    auto const [estimate, current] = open.top();
+    open.pop();
+
+    if(current == terminal)
+    {
+      break;
+    }
+
+    auto const direction = current % 4;
+    auto const i = (current / 4) % nx;
+    auto const j = (current / 4) / nx;
+    if(estimate > cost[current] + heuristic(i, j))
+    {
+      continue; // stale entry
+    }
+
+    if((i == destination_i) && (j == destination_j))
+    {
+      auto const c = cost[current] + ((direction == 0) ? 0.0 : constants::bend_penalty);
+      if(c < cost[terminal])
+      {
+        cost[terminal] = c;
+        previous[terminal] = current;
+        open.push({c, terminal});
+      }
+      continue;
+    }
+
+    for(int next_direction{}; next_direction < 4; ++next_direction)
+    {
+      if((next_direction ^ 1) == direction) // no u-turns
+      {
+        continue;
+      }
+
+      auto const ni = i + direction_dx[next_direction];
+      auto const nj = j + direction_dy[next_direction];
+      if((ni < 0) || (ni >= nx) || (nj < 0) || (nj >= ny))
+      {
+        continue;
+      }
+
+      auto const is_horizontal = (direction_dy[next_direction] == 0);
+      auto const edge_cell = is_horizontal ? cell(std::min(i, ni), j) : cell(i, std::min(j, nj));
+      if(is_horizontal ? blocked_h[edge_cell] : blocked_v[edge_cell])
+      {
+        continue;
+      }
+
+      auto const length = std::abs(xs[ni] - xs[i]) + std::abs(ys[nj] - ys[j]);
+      auto const is_shared = is_horizontal ? shared_h[edge_cell] : shared_v[edge_cell];
+      auto const c = cost[current]
+        + length * (is_shared ? constants::shared_channel_factor : 1.0)
+        + ((next_direction == direction) ? 0.0 : constants::bend_penalty);
+
+      auto const next = cell(ni, nj) * 4 + next_direction;
+      if(c < cost[next])
+      {
+        cost[next] = c;
+        previous[next] = current;
+        open.push({c + heuristic(ni, nj), next});
+      }
+    }
+  }
+
+  if(previous[terminal] < 0)
+  {
+    return{};
+  }
+
+  // walk back and keep the corners only
+  route result{destination};
+  auto last_direction = 0;
+  for(auto s = previous[terminal]; s != start; s = previous[s])
+  {
+    auto const direction = s % 4;
+    if(direction != last_direction)
+    {
+      auto const c = s / 4;
+      result.push_back({xs[c % nx], ys[c / nx]});
+      last_direction = direction;
+    }
+  }
+  if(last_direction != 0)
+  {
+    result.push_back(source);
+  }
+  if((result.back().x != source.x) || (result.back().y != source.y))
+  {
+    result.push_back(source);
+  }
+  std::reverse(begin(result), end(result));
+  result.erase(std::unique(begin(result), end(result), [](route_point a, route_point b)
+  {
+    return (a.x == b.x) && (a.y == b.y);
+  }), end(result));
+  return result;
+}
+
+edge_router::edge_router()
+  : d(std::make_unique<state>())
+{
+}
+
+edge_router::~edge_router() = default;
+
+void edge_router::set_obstacle(int64_t id, route_rect rect)
+{
+  remove_obstacle(id);
+  d->obstacles.emplace(id, rect);
+  d->obstacle_index.insert(entry{to_box(rect), id});
+  d->invalidate(to_box(rect));
+}
+
+void edge_router::remove_obstacle(int64_t id)
+{
+  if(auto it = d->obstacles.find(id); it != end(d->obstacles))
+  {
+    auto const b = to_box(it->second);
+    d->obstacle_index.remove(entry{b, id});
+    d->obstacles.erase(it);
+    d->invalidate(b);
+  }
+}
+
+void edge_router::set_edge(int64_t id, route_point source, route_point destination)
+{
+  auto &&e = d->edges[id];
+  e.source = source;
+  e.destination = destination;
+  d->dirty.insert(id);
+}
+
+void edge_router::remove_edge(int64_t id)
+{
+  if(d->edges.count(id))
+  {
+    d->clear_route(id);
+    d->edges.erase(id);
+    d->dirty.erase(id);
+  }
+}
+
+std::vector<std::pair<int64_t, route>> edge_router::update()
+{
+  std::vector<int64_t> ids(begin(d->dirty), end(d->dirty));
+  std::sort(begin(ids), end(ids));
+  d->dirty.clear();
+
+  // drop all affected routes first, so they do not attract each other into stale channels
+  for(auto &&id : ids)
+  {
+    d->clear_route(id);
+  }
+
+  std::vector<std::pair<int64_t, route>> result;
+  result.reserve(ids.size());
+  for(auto &&id : ids)
+  {
+    auto &&e = d->edges.at(id);
+    auto path = d->find_route(e.source, e.destination);
+    d->store_route(id, path);
+    result.emplace_back(id, std::move(path));
+  }
+  return result;
+}
+
+} // namespace skadi
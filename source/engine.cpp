@@ -0,0 +1,699 @@
+#include "engine.h"
+#include "output_cache.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <string>
+
+namespace skadi
+{
+
+namespace
+{
+  template<typename Range>
+  int find_port(Range const &ports, std::string const &name)
+  {
+    auto it = std::find_if(begin(ports), end(ports), [&](auto &&p) { return p.name == name; });
+    return (it != end(ports)) ? static_cast<int>(it - begin(ports)) : -1;
+  }
+
+  std::string describe(node_instance_id id)
+  {
+    return "node " + std::to_string(id.id);
+  }
+
+  // order dependent, so swapped inputs hash differently
+  std::optional<uint64_t> hash_inputs(port_range<value const> inputs)
+  {
+    uint64_t h = inputs.size();
+    for(auto &&v : inputs)
+    {
+      auto x = hash_value(v);
+      if(!x)
+      {
+        return {};
+      }
+      h ^= *x + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    }
+    return h;
+  }
+}
+
+execution_plan compile(graph const &g, type_registry const &registry)
+{
+  std::unordered_map<int64_t, node_type const *> types;
+  for(auto &&t : registry.node_types)
+  {
+    types.emplace(t.guid.guid, &t);
+  }
+
+  // nodes in graph order first, sorted below
+  std::vector<node_type const *> node_types;
+  std::unordered_map<int64_t, int> indices;
+  for(auto &&n : g.nodes)
+  {
+    auto it = types.find(n.type.guid);
+    if(it == end(types))
+    {
+      throw std::runtime_error(describe(n.uid) + ": unknown node_type " + std::to_string(n.type.guid));
+    }
+    if(!indices.emplace(n.uid.id, static_cast<int>(node_types.size())).second)
+    {
+      throw std::runtime_error(describe(n.uid) + ": duplicate node id");
+    }
+    node_types.push_back(it->second);
+  }
+
+  auto const node_count = static_cast<int>(g.nodes.size());
+  std::vector<std::vector<std::vector<execution_plan::port_ref>>> consumers(node_count);
+  std::vector<std::vector<bool>> connected(node_count);
+  for(int i{}; i < node_count; ++i)
+  {
+    consumers[i].resize(node_types[i]->outputs.size());
+    connected[i].resize(node_types[i]->inputs.size());
+  }
+
+  std::vector<int> in_degree(node_count);
+  for(auto &&c : g.connections)
+  {
+    auto source = indices.find(c.source.id);
+    auto destination = indices.find(c.destination.id);
+    if((source == end(indices)) || (destination == end(indices)))
+    {
+      throw std::runtime_error("connection " + std::to_string(c.uid.id) + ": unknown node");
+    }
+    auto const output = find_port(node_types[source->second]->outputs, c.signal);
+    auto const input = find_port(node_types[destination->second]->inputs, c.slot);
+    if((output < 0) || (input < 0))
+    {
+      throw std::runtime_error("connection " + std::to_string(c.uid.id) + ": unknown port");
+    }
+    if(connected[destination->second][input])
+    {
+      throw std::runtime_error(describe(c.destination) + ": input " + c.slot + " is connected more than once");
+    }
+    connected[destination->second][input] = true;
+    consumers[source->second][output].push_back({destination->second, input, 0});
+    ++in_degree[destination->second];
+  }
+
+  // Kahn's algorithm, taking nodes in graph order where there is a choice; the steps are
+  // laid out breadth first, which is also the order the scheduler runs them in
+  std::vector<int> order;
+  order.reserve(node_count);
+  for(int i{}; i < node_count; ++i)
+  {
+    if(in_degree[i] == 0)
+    {
+      order.push_back(i);
+    }
+  }
+  for(size_t next{}; next < order.size(); ++next)
+  {
+    for(auto &&port : consumers[order[next]])
+    {
+      for(auto &&ref : port)
+      {
+        if(--in_degree[ref.node] == 0)
+        {
+          order.push_back(ref.node);
+        }
+      }
+    }
+  }
+  if(static_cast<int>(order.size()) != node_count)
+  {
+    auto it = std::find_if(begin(in_degree), end(in_degree), [](int d) { return d > 0; });
+    throw std::runtime_error(describe(g.nodes[it - begin(in_degree)].uid) + ": part of a cycle");
+  }
+
+  std::vector<int> position(node_count);
+  for(int i{}; i < node_count; ++i)
+  {
+    position[order[i]] = i;
+  }
+
+  execution_plan plan{};
+  plan.steps.reserve(node_count);
+  for(auto &&i : order)
+  {
+    auto &&type = *node_types[i];
+    execution_plan::step step{g.nodes[i].uid, type.guid, nullptr, nullptr, false, static_cast<int>(type.inputs.size()),
+                              static_cast<int>(std::count(begin(connected[i]), end(connected[i]), true)),
+                              plan.input_count, plan.output_count, {}, std::move(consumers[i])};
+    plan.input_count += step.input_count;
+    plan.output_count += static_cast<int>(type.outputs.size());
+    for(auto &&output : type.outputs)
+    {
+      step.output_types.push_back(output.type);
+    }
+    for(auto &&port : step.consumers)
+    {
+      for(auto &&ref : port)
+      {
+        ref.node = position[ref.node];
+      }
+    }
+    plan.indices.emplace(step.id.id, static_cast<int>(plan.steps.size()));
+    plan.steps.push_back(std::move(step));
+  }
+
+  for(auto &&step : plan.steps)
+  {
+    for(auto &&port : step.consumers)
+    {
+      for(auto &&ref : port)
+      {
+        ref.input = plan.steps[ref.node].first_input + ref.port;
+      }
+    }
+  }
+  return plan;
+}
+
+execution_plan compile(graph const &g, type_registry const &registry, kernel_registry const &kernels)
+{
+  auto plan = compile(g, registry);
+  for(auto &&step : plan.steps)
+  {
+    step.run = kernels.find(step.type);
+    step.run_async = step.run ? nullptr : kernels.find_async(step.type);
+    if(!step.run && !step.run_async)
+    {
+      auto type = std::find_if(begin(registry.node_types), end(registry.node_types), [&](auto &&t) { return t.guid.guid == step.type.guid; });
+      throw std::runtime_error(describe(step.id) + ": no kernel for node_type " + type->name);
+    }
+    step.is_pure = kernels.is_pure(step.type);
+  }
+  return plan;
+}
+
+engine::engine(type_registry registry, kernel_registry kernels)
+  : registry(std::move(registry))
+  , kernels(std::move(kernels))
+  , cache()
+  , plan()
+  , is_plan_outdated(true)
+  , is_timing_enabled()
+{
+  for(auto &&t : this->registry.node_types)
+  {
+    types.emplace(t.guid.guid, &t);
+  }
+}
+
+void engine::load(graph const &g)
+{
+  nodes.clear();
+  connections.clear();
+  outdated.clear();
+  parameter_hashes.clear();
+  for(auto &&n : g.nodes)
+  {
+    nodes.emplace(n.uid.id, n);
+    outdated.insert(n.uid.id);
+  }
+  for(auto &&c : g.connections)
+  {
+    connections.emplace(c.uid.id, c);
+  }
+
+  // nothing is kept from the previous graph
+  plan = {};
+  inputs.clear();
+  outputs.clear();
+  is_plan_outdated = true;
+}
+
+void engine::add_node(node n)
+{
+  nodes[n.uid.id] = n;
+  outdated.insert(n.uid.id);
+  if(is_plan_outdated)
+  {
+    return;
+  }
+
+  // without connections a node can go anywhere in the order, so it goes last
+  auto type = types.find(n.type.guid);
+  auto run = kernels.find(n.type);
+  auto run_async = run ? nullptr : kernels.find_async(n.type);
+  if((type == end(types)) || (!run && !run_async) || (find_step(n.uid) >= 0))
+  {
+    is_plan_outdated = true;
+    return;
+  }
+
+  execution_plan::step step{n.uid, n.type, run, run_async, kernels.is_pure(n.type), static_cast<int>(type->second->inputs.size()), 0,
+                            plan.input_count, plan.output_count, {}, {}};
+  for(auto &&output : type->second->outputs)
+  {
+    step.output_types.push_back(output.type);
+  }
+  step.consumers.resize(step.output_types.size());
+
+  plan.input_count += step.input_count;
+  plan.output_count += static_cast<int>(step.output_types.size());
+  plan.indices.emplace(n.uid.id, static_cast<int>(plan.steps.size()));
+  plan.steps.push_back(std::move(step));
+  inputs.resize(plan.input_count);
+  outputs.resize(plan.output_count);
+  input_connections.resize(plan.input_count, -1);
+  is_scheduled.resize(plan.steps.size());
+  waiting.resize(plan.steps.size());
+  durations.resize(plan.steps.size());
+}
+
+void engine::remove_node(node_instance_id id)
+{
+  if(!nodes.erase(id.id))
+  {
+    return;
+  }
+  outdated.erase(id.id);
+  parameter_hashes.erase(id.id);
+
+  std::vector<connection_instance_id> attached;
+  for(auto &&[uid, c] : connections)
+  {
+    if((c.source.id == id.id) || (c.destination.id == id.id))
+    {
+      attached.push_back(c.uid);
+    }
+  }
+  for(auto &&uid : attached)
+  {
+    disconnect(uid);
+  }
+
+  // the step stays behind without kernel and connections until the plan is compiled again
+  if(auto index = find_step(id); !is_plan_outdated && (index >= 0))
+  {
+    plan.steps[index].run = nullptr;
+    plan.steps[index].run_async = nullptr;
+    plan.indices.erase(id.id);
+  }
+}
+
+void engine::connect(connection c)
+{
+  disconnect(c.uid);
+  connections.emplace(c.uid.id, c);
+  outdated.insert(c.destination.id);
+  if(is_plan_outdated)
+  {
+    return;
+  }
+
+  // runs are ordered by themselves, so only errors need compiling again to be reported
+  auto const source = find_step(c.source);
+  auto const destination = find_step(c.destination);
+  auto const output = find_output(c);
+  auto const input = find_input(c);
+  if((source < 0) || (destination < 0) || (output < 0) || (input < 0) || (input_connections[input] >= 0))
+  {
+    is_plan_outdated = true;
+    return;
+  }
+
+  auto &&producer = plan.steps[source];
+  producer.consumers[output].push_back({destination, input - plan.steps[destination].first_input, input});
+  ++plan.steps[destination].connected_input_count;
+  input_connections[input] = c.uid.id;
+  inputs[input] = outputs[producer.first_output + output];
+}
+
+void engine::disconnect(connection_instance_id id)
+{
+  auto it = connections.find(id.id);
+  if(it == end(connections))
+  {
+    return;
+  }
+  auto const c = it->second;
+  connections.erase(it);
+  if(nodes.count(c.destination.id))
+  {
+    outdated.insert(c.destination.id);
+  }
+  if(is_plan_outdated)
+  {
+    return;
+  }
+
+  auto const source = find_step(c.source);
+  auto const destination = find_step(c.destination);
+  auto const output = find_output(c);
+  auto const input = find_input(c);
+  if((source < 0) || (destination < 0) || (output < 0) || (input < 0) || (input_connections[input] != id.id))
+  {
+    is_plan_outdated = true;
+    return;
+  }
+
+  auto &&refs = plan.steps[source].consumers[output];
+  refs.erase(std::remove_if(begin(refs), end(refs), [=](auto &&ref) { return ref.input == input; }), end(refs));
+  --plan.steps[destination].connected_input_count;
+  input_connections[input] = -1;
+  inputs[input] = {};
+}
+
+void engine::invalidate(node_instance_id id)
+{
+  if(nodes.count(id.id))
+  {
+    outdated.insert(id.id);
+  }
+}
+
+void engine::set_cache(output_cache *new_cache)
+{
+  cache = new_cache;
+}
+
+void engine::set_parameter_hash(node_instance_id id, uint64_t hash)
+{
+  if(!nodes.count(id.id))
+  {
+    return;
+  }
+  auto &&current = parameter_hashes[id.id];
+  if(current != hash)
+  {
+    current = hash;
+    outdated.insert(id.id);
+  }
+}
+
+void engine::run()
+{
+  for(auto &&i : collect_outdated())
+  {
+    run_step(i);
+  }
+  outdated.clear();
+}
+
+void engine::run(scheduler &pool)
+{
+  pool.run_async(plan, collect_outdated(), [this, &pool](int i)
+  {
+    return start_step(i, [&pool, i](std::exception_ptr error) { pool.complete(i, error); });
+  });
+  outdated.clear();
+}
+
+size_t engine::get_run_count() const
+{
+  return scheduled.size();
+}
+
+void engine::set_timing_enabled(bool is_enabled)
+{
+  is_timing_enabled = is_enabled;
+}
+
+std::chrono::nanoseconds engine::get_duration(node_instance_id id) const
+{
+  auto const index = find_step(id);
+  return ((index >= 0) && (static_cast<size_t>(index) < durations.size())) ? durations[index] : std::chrono::nanoseconds{};
+}
+
+execution_plan const &engine::get_plan() const
+{
+  return plan;
+}
+
+port_range<value const> engine::get_inputs(node_instance_id id) const
+{
+  auto &&step = plan.steps[plan.indices.at(id.id)];
+  return {inputs.data() + step.first_input, static_cast<size_t>(step.input_count)};
+}
+
+port_range<value const> engine::get_outputs(node_instance_id id) const
+{
+  auto &&step = plan.steps[plan.indices.at(id.id)];
+  return {outputs.data() + step.first_output, step.output_types.size()};
+}
+
+void engine::update_plan()
+{
+  if(!is_plan_outdated)
+  {
+    return;
+  }
+
+  graph g;
+  for(auto &&[id, n] : nodes)
+  {
+    g.nodes.push_back(n);
+  }
+  for(auto &&[id, c] : connections)
+  {
+    g.connections.push_back(c);
+  }
+  auto new_plan = compile(g, registry, kernels);
+
+  // outputs are kept by node, inputs follow from the outputs of their producers
+  std::vector<value> new_outputs(new_plan.output_count);
+  for(auto &&step : new_plan.steps)
+  {
+    auto old = plan.indices.find(step.id.id);
+    if(old == end(plan.indices))
+    {
+      outdated.insert(step.id.id);
+      continue;
+    }
+    std::copy_n(begin(outputs) + plan.steps[old->second].first_output, step.output_types.size(), begin(new_outputs) + step.first_output);
+  }
+
+  plan = std::move(new_plan);
+  outputs = std::move(new_outputs);
+  inputs.assign(plan.input_count, {});
+  input_connections.assign(plan.input_count, -1);
+  for(auto &&step : plan.steps)
+  {
+    for(size_t port{}; port < step.consumers.size(); ++port)
+    {
+      for(auto &&ref : step.consumers[port])
+      {
+        inputs[ref.input] = outputs[step.first_output + port];
+      }
+    }
+  }
+  for(auto &&[id, c] : connections)
+  {
+    input_connections[find_input(c)] = id;
+  }
+  is_scheduled.assign(plan.steps.size(), false);
+  waiting.assign(plan.steps.size(), 0);
+  durations.assign(plan.steps.size(), {});
+  is_plan_outdated = false;
+}
+
+std::vector<int> const &engine::collect_outdated()
+{
+  update_plan();
+
+  // everything downstream of an outdated node
+  std::vector<int> cone;
+  for(auto &&id : outdated)
+  {
+    auto index = plan.indices.at(id);
+    if(!is_scheduled[index])
+    {
+      is_scheduled[index] = true;
+      cone.push_back(index);
+    }
+  }
+  for(size_t next{}; next < cone.size(); ++next)
+  {
+    for(auto &&port : plan.steps[cone[next]].consumers)
+    {
+      for(auto &&ref : port)
+      {
+        ++waiting[ref.node];
+        if(!is_scheduled[ref.node])
+        {
+          is_scheduled[ref.node] = true;
+          cone.push_back(ref.node);
+        }
+      }
+    }
+  }
+
+  // Edits in place do not keep the plan in topological order, so the cone is ordered by
+  // itself. Everything feeding it from outside has run already.
+  scheduled.clear();
+  for(auto &&index : cone)
+  {
+    if(waiting[index] == 0)
+    {
+      scheduled.push_back(index);
+    }
+  }
+  for(size_t next{}; next < scheduled.size(); ++next)
+  {
+    for(auto &&port : plan.steps[scheduled[next]].consumers)
+    {
+      for(auto &&ref : port)
+      {
+        if(--waiting[ref.node] == 0)
+        {
+          scheduled.push_back(ref.node);
+        }
+      }
+    }
+  }
+
+  for(auto &&index : cone)
+  {
+    is_scheduled[index] = false;
+  }
+  if(scheduled.size() != cone.size())
+  {
+    auto cycle = std::find_if(begin(cone), end(cone), [&](int index) { return waiting[index] > 0; });
+    auto const id = plan.steps[*cycle].id;
+    for(auto &&index : cone)
+    {
+      waiting[index] = 0;
+    }
+    scheduled.clear();
+    throw std::runtime_error(describe(id) + ": part of a cycle");
+  }
+  return scheduled;
+}
+
+void engine::run_step(int index)
+{
+  std::promise<void> finished;
+  auto result = finished.get_future();
+  if(!start_step(index, [&](std::exception_ptr error)
+  {
+    if(error)
+    {
+      finished.set_exception(error);
+    }
+    else
+    {
+      finished.set_value();
+    }
+  }))
+  {
+    result.get();
+  }
+}
+
+bool engine::start_step(int index, std::function<void(std::exception_ptr)> const &done)
+{
+  auto &&step = plan.steps[index];
+  port_range<value const> arguments{inputs.data() + step.first_input, static_cast<size_t>(step.input_count)};
+  port_range<value> results{outputs.data() + step.first_output, step.output_types.size()};
+
+  std::optional<cache_key> key;
+  if(cache && step.is_pure)
+  {
+    if(auto h = hash_inputs(arguments))
+    {
+      auto parameters = parameter_hashes.find(step.id.id);
+      key = cache_key{step.type.guid, (parameters != end(parameter_hashes)) ? parameters->second : 0, *h};
+    }
+  }
+
+  auto const start = (key || is_timing_enabled) ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+  bool const is_cached = key && cache->find(*key, results);
+  if(!is_cached)
+  {
+    try
+    {
+      if(step.run_async)
+      {
+        // the outputs are taken over from the thread completing the kernel
+        (*step.run_async)(arguments, results, [this, index, key, start, done](std::exception_ptr error)
+        {
+          if(error)
+          {
+            try
+            {
+              std::rethrow_exception(error);
+            }
+            catch(std::exception &e)
+            {
+              error = std::make_exception_ptr(std::runtime_error(describe(plan.steps[index].id) + ": " + e.what()));
+            }
+            catch(...)
+            {
+            }
+          }
+          else
+          {
+            finish_step(index, key, start, false);
+          }
+          done(error);
+        });
+        return false;
+      }
+      (*step.run)(arguments, results);
+    }
+    catch(std::exception &e)
+    {
+      throw std::runtime_error(describe(step.id) + ": " + e.what());
+    }
+  }
+
+  finish_step(index, key, start, is_cached);
+  return true;
+}
+
+void engine::finish_step(int index, std::optional<cache_key> const &key, std::chrono::steady_clock::time_point start, bool is_cached)
+{
+  auto &&step = plan.steps[index];
+  port_range<value> results{outputs.data() + step.first_output, step.output_types.size()};
+
+  for(size_t port{}; port < results.size(); ++port)
+  {
+    results[port].type = step.output_types[port];
+    for(auto &&ref : step.consumers[port])
+    {
+      inputs[ref.input] = results[port];
+    }
+  }
+  auto const duration = (key || is_timing_enabled) ? std::chrono::steady_clock::now() - start : std::chrono::nanoseconds{};
+  if(key && !is_cached)
+  {
+    cache->insert(*key, {results.begin(), results.size()}, duration);
+  }
+  if(is_timing_enabled)
+  {
+    durations[index] = duration;
+  }
+}
+
+int engine::find_step(node_instance_id id) const
+{
+  auto it = plan.indices.find(id.id);
+  return (it != end(plan.indices)) ? it->second : -1;
+}
+
+int engine::find_input(connection const &c) const
+{
+  auto const index = find_step(c.destination);
+  if(index < 0)
+  {
+    return -1;
+  }
+  auto &&step = plan.steps[index];
+  auto const port = find_port(types.at(step.type.guid)->inputs, c.slot);
+  return (port >= 0) ? step.first_input + port : -1;
+}
+
+int engine::find_output(connection const &c) const
+{
+  auto const index = find_step(c.source);
+  return (index >= 0) ? find_port(types.at(plan.steps[index].type.guid)->outputs, c.signal) : -1;
+}
+
+} // namespace skadi
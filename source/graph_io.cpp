@@ -101,6 +101,20 @@ picojson::value save(type_registry r)
   }
   o["data_types"] = picojson::value(data_types);
 
+  // optional, so registries without conversions are saved as before
+  if(!r.conversions.empty())
+  {
+    picojson::array conversions;
+    for(auto &&c : r.conversions)
+    {
+      picojson::object conversion;
+      conversion["from"] = picojson::value(c.from.guid);
+      conversion["to"] = picojson::value(c.to.guid);
+      conversions.emplace_back(conversion);
+    }
+    o["conversions"] = picojson::value(conversions);
+  }
+
   return picojson::value(o);
 }
 
@@ -120,6 +134,15 @@ type_registry load_type_registry(picojson::value v)
     r.data_types.emplace_back(load_data_type(t));
   }
 
+  if(o.count("conversions"))
+  {
+    for(auto &&value : o["conversions"].get<picojson::array>())
+    {
+      auto c = value.get<picojson::object>();
+      r.conversions.push_back({{c["from"].get<int64_t>()}, {c["to"].get<int64_t>()}});
+    }
+  }
+
   return r;
 }
 
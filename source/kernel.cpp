@@ -0,0 +1,295 @@
+#include "kernel.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace skadi
+{
+
+namespace
+{
+  template<typename T>
+  T get_number(value const &v)
+  {
+    if(auto i = std::get_if<int64_t>(&v.data))
+    {
+      return static_cast<T>(*i);
+    }
+    if(auto f = std::get_if<double>(&v.data))
+    {
+      return static_cast<T>(*f);
+    }
+    return T{};
+  }
+
+  node_type const *find_node_type(type_registry const &registry, std::string const &name)
+  {
+    auto it = std::find_if(begin(registry.node_types), end(registry.node_types), [&](auto &&t) { return t.name == name; });
+    return (it != end(registry.node_types)) ? &*it : nullptr;
+  }
+
+  // which outputs of a node type are ints, the others are produced as floats
+  std::vector<bool> get_int_outputs(type_registry const &registry, node_type const &type)
+  {
+    std::vector<bool> result;
+    for(auto &&output : type.outputs)
+    {
+      auto it = std::find_if(begin(registry.data_types), end(registry.data_types), [&](auto &&t) { return t.guid.guid == output.type.guid; });
+      result.push_back((it != end(registry.data_types)) && (it->name == "int"));
+    }
+    return result;
+  }
+
+  void set_number(value &v, bool is_int, double number)
+  {
+    if(is_int)
+    {
+      v.data = static_cast<int64_t>(number);
+    }
+    else
+    {
+      v.data = number;
+    }
+  }
+
+  template<typename T>
+  void fill_row_numbers(column &c, batch_range range)
+  {
+    auto &&rows = set_rows<T>(c, range.row_count);
+    for(size_t r{}; r < rows.size(); ++r)
+    {
+      rows[r] = static_cast<T>(range.first_row + static_cast<int64_t>(r));
+    }
+  }
+
+  // the first input is converted into the sum, the others are added to it
+  template<typename T, typename U>
+  void add_rows(std::vector<T> &sum, std::vector<U> const &rows, bool is_first)
+  {
+    auto const count = std::min(sum.size(), rows.size());
+    if(is_first)
+    {
+      std::transform(begin(rows), begin(rows) + count, begin(sum), [](U x) { return static_cast<T>(x); });
+    }
+    else
+    {
+      for(size_t r{}; r < count; ++r)
+      {
+        sum[r] += static_cast<T>(rows[r]);
+      }
+    }
+  }
+
+  template<typename T>
+  void sum_columns(column &sum, size_t row_count, port_range<column const *const> inputs)
+  {
+    auto &&rows = set_rows<T>(sum, row_count);
+    bool is_first = true;
+    for(auto &&input : inputs)
+    {
+      if(auto i = input ? std::get_if<std::vector<int64_t>>(&input->data) : nullptr)
+      {
+        add_rows(rows, *i, is_first);
+        is_first = false;
+      }
+      else if(auto f = input ? std::get_if<std::vector<double>>(&input->data) : nullptr)
+      {
+        add_rows(rows, *f, is_first);
+        is_first = false;
+      }
+    }
+    if(is_first)
+    {
+      std::fill(begin(rows), end(rows), T{});
+    }
+  }
+}
+
+bool is_empty(value const &v)
+{
+  return std::holds_alternative<std::monostate>(v.data);
+}
+
+std::optional<uint64_t> hash_value(value const &v)
+{
+  // splitmix64 finalizer over the type, the representation and the bits of the number
+  auto const mix = [](uint64_t h, uint64_t x)
+  {
+    h ^= x + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+  };
+
+  auto h = mix(static_cast<uint64_t>(v.type.guid), v.data.index());
+  if(auto i = std::get_if<int64_t>(&v.data))
+  {
+    return mix(h, static_cast<uint64_t>(*i));
+  }
+  if(auto f = std::get_if<double>(&v.data))
+  {
+    uint64_t bits{};
+    std::memcpy(&bits, f, sizeof(bits));
+    return mix(h, bits);
+  }
+  if(is_empty(v))
+  {
+    return h;
+  }
+  return {};
+}
+
+int64_t get_int(value const &v)
+{
+  return get_number<int64_t>(v);
+}
+
+double get_float(value const &v)
+{
+  return get_number<double>(v);
+}
+
+size_t get_row_count(column const &c)
+{
+  if(auto i = std::get_if<std::vector<int64_t>>(&c.data))
+  {
+    return i->size();
+  }
+  if(auto f = std::get_if<std::vector<double>>(&c.data))
+  {
+    return f->size();
+  }
+  return 0;
+}
+
+void kernel_registry::add(node_type_id id, kernel k, bool is_pure)
+{
+  auto &&e = kernels[id.guid];
+  e.run = std::move(k);
+  e.is_pure = is_pure;
+}
+
+void kernel_registry::add_async(node_type_id id, async_kernel k, bool is_pure)
+{
+  auto &&e = kernels[id.guid];
+  e.run_async = std::move(k);
+  e.is_pure = is_pure;
+}
+
+void kernel_registry::add_batch(node_type_id id, batch_kernel k, bool is_elementwise)
+{
+  auto &&e = kernels[id.guid];
+  e.run_batch = std::move(k);
+  e.is_elementwise = is_elementwise;
+}
+
+kernel const *kernel_registry::find(node_type_id id) const
+{
+  auto it = kernels.find(id.guid);
+  return ((it != end(kernels)) && it->second.run) ? &it->second.run : nullptr;
+}
+
+async_kernel const *kernel_registry::find_async(node_type_id id) const
+{
+  auto it = kernels.find(id.guid);
+  return ((it != end(kernels)) && it->second.run_async) ? &it->second.run_async : nullptr;
+}
+
+batch_kernel const *kernel_registry::find_batch(node_type_id id) const
+{
+  auto it = kernels.find(id.guid);
+  return ((it != end(kernels)) && it->second.run_batch) ? &it->second.run_batch : nullptr;
+}
+
+bool kernel_registry::is_pure(node_type_id id) const
+{
+  auto it = kernels.find(id.guid);
+  return (it != end(kernels)) && (it->second.run || it->second.run_async) && it->second.is_pure;
+}
+
+bool kernel_registry::is_elementwise(node_type_id id) const
+{
+  auto it = kernels.find(id.guid);
+  return (it != end(kernels)) && it->second.run_batch && it->second.is_elementwise;
+}
+
+void add_builtin_kernels(kernel_registry &kernels, type_registry const &registry)
+{
+  // emits a constant, so a graph gives the same results on every run
+  if(auto type = find_node_type(registry, "source"))
+  {
+    kernels.add(type->guid, [is_int = get_int_outputs(registry, *type)](auto &&, auto &&outputs)
+    {
+      for(size_t i{}; i < outputs.size(); ++i)
+      {
+        set_number(outputs[i], is_int[i], 1.0);
+      }
+    });
+    // streams are numbered by row
+    kernels.add_batch(type->guid, [is_int = get_int_outputs(registry, *type)](batch_range range, auto &&, auto &&outputs)
+    {
+      for(size_t i{}; i < outputs.size(); ++i)
+      {
+        if(is_int[i])
+        {
+          fill_row_numbers<int64_t>(outputs[i], range);
+        }
+        else
+        {
+          fill_row_numbers<double>(outputs[i], range);
+        }
+      }
+    }, true);
+  }
+
+  // the results of a graph are the inputs of its sinks, which are kept by the engine
+  if(auto type = find_node_type(registry, "sink"))
+  {
+    kernels.add(type->guid, [](auto &&, auto &&)
+    {
+    });
+    kernels.add_batch(type->guid, [](batch_range, auto &&, auto &&)
+    {
+    });
+  }
+
+  // the sum of all inputs on every output
+  if(auto type = find_node_type(registry, "test"))
+  {
+    kernels.add(type->guid, [is_int = get_int_outputs(registry, *type)](auto &&inputs, auto &&outputs)
+    {
+      double sum{};
+      for(auto &&input : inputs)
+      {
+        sum += get_float(input);
+      }
+      for(size_t i{}; i < outputs.size(); ++i)
+      {
+        set_number(outputs[i], is_int[i], sum);
+      }
+    });
+    // summed in the representation of the output, the other outputs are copies of the first
+    kernels.add_batch(type->guid, [is_int = get_int_outputs(registry, *type)](batch_range range, auto &&inputs, auto &&outputs)
+    {
+      for(size_t i{}; i < outputs.size(); ++i)
+      {
+        if((i > 0) && (is_int[i] == is_int[0]))
+        {
+          outputs[i].data = outputs[0].data;
+        }
+        else if(is_int[i])
+        {
+          sum_columns<int64_t>(outputs[i], range.row_count, inputs);
+        }
+        else
+        {
+          sum_columns<double>(outputs[i], range.row_count, inputs);
+        }
+      }
+    }, true);
+  }
+}
+
+} // namespace skadi
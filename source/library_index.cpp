@@ -0,0 +1,476 @@
+#include "library_index.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <numeric>
+
+namespace skadi
+{
+
+namespace constants
+{
+  static int const score_match = 16;
+  static int const score_consecutive = 24;
+  static int const score_boundary = 20;
+  static int const score_prefix = 40;
+  static int const score_gap = 1;
+  static int const score_category_penalty = 32;
+  static int const score_none = -(1 << 28);
+
+  static size_t const cancel_check_interval = 1024;
+
+  static uint8_t const text_start = 2;
+  static uint8_t const word_start = 1;
+}
+
+namespace
+{
+  std::string to_lower(std::string s)
+  {
+    std::transform(begin(s), end(s), begin(s), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+  }
+
+  uint32_t trigram(char const *s)
+  {
+    return (static_cast<uint32_t>(static_cast<unsigned char>(s[0])) << 16)
+         | (static_cast<uint32_t>(static_cast<unsigned char>(s[1])) << 8)
+         | static_cast<uint32_t>(static_cast<unsigned char>(s[2]));
+  }
+
+  bool is_cancelled(std::atomic<bool> const *cancel, size_t i)
+  {
+    return cancel && (i % constants::cancel_check_interval == 0) && cancel->load(std::memory_order_relaxed);
+  }
+
+  // one bit per letter and digit, the other characters share the remaining bits
+  uint64_t character_bit(unsigned char c)
+  {
+    if(c >= 'a' && c <= 'z')
+    {
+      return uint64_t(1) << (c - 'a');
+    }
+    if(c >= '0' && c <= '9')
+    {
+      return uint64_t(1) << (26 + c - '0');
+    }
+    return uint64_t(1) << (36 + c % 28);
+  }
+
+  uint64_t character_mask(std::string_view s)
+  {
+    uint64_t mask{};
+    for(unsigned char c : s)
+    {
+      mask |= character_bit(c);
+    }
+    return mask;
+  }
+
+  // wildcard match with backtracking to the last '*'; the pattern behaves as if it started
+  // with '*' and the rest of the text is irrelevant once it is matched
+  bool match_wildcard(std::string_view text, std::string const &pattern)
+  {
+    size_t t{};
+    size_t p{};
+    size_t star{};
+    size_t star_text{};
+    for(;;)
+    {
+      if(p == pattern.size())
+      {
+        return true;
+      }
+      else if(pattern[p] == '*')
+      {
+        star = ++p;
+        star_text = t;
+      }
+      else if(t < text.size() && (pattern[p] == '?' || pattern[p] == text[t]))
+      {
+        ++t;
+        ++p;
+      }
+      else if(star_text < text.size())
+      {
+        p = star;
+        t = ++star_text;
+      }
+      else
+      {
+        return false;
+      }
+    }
+  }
+
+  bool match_subsequence(std::string_view text, std::string const &pattern)
+  {
+    size_t t{};
+    for(auto c : pattern)
+    {
+      t = text.find(c, t);
+      if(t == std::string_view::npos)
+      {
+        return false;
+      }
+      ++t;
+    }
+    return true;
+  }
+
+  // the literal runs of a pattern, which every match contains
+  std::vector<std::string> literals(std::string const &pattern)
+  {
+    std::vector<std::string> result(1);
+    for(auto c : pattern)
+    {
+      if(c == '*' || c == '?')
+      {
+        if(!result.back().empty())
+        {
+          result.emplace_back();
+        }
+      }
+      else
+      {
+        result.back().push_back(c);
+      }
+    }
+    return result;
+  }
+
+  // the characters a match has to contain in order; spaces only separate words
+  std::string fuzzy_pattern(std::string const &query)
+  {
+    std::string result;
+    std::copy_if(begin(query), end(query), std::back_inserter(result), [](char c) { return c != '*' && c != '?' && c != ' '; });
+    return to_lower(result);
+  }
+}
+
+void library_index::column::add(std::string const &text)
+{
+  offsets.push_back(static_cast<uint32_t>(chars.size()));
+  auto const lower = to_lower(text);
+  chars += lower;
+  masks.push_back(character_mask(lower));
+
+  for(size_t i{}; i < text.size(); ++i)
+  {
+    unsigned char const c = text[i];
+    unsigned char const previous = i ? text[i - 1] : 0;
+    if(i == 0)
+    {
+      boundaries.push_back(constants::text_start);
+    }
+    else if((!std::isalnum(previous) && std::isalnum(c))
+         || (std::islower(previous) && std::isupper(c))
+         || (std::isalpha(previous) && std::isdigit(c)))
+    {
+      boundaries.push_back(constants::word_start);
+    }
+    else
+    {
+      boundaries.push_back(0);
+    }
+  }
+}
+
+std::string_view library_index::column::get(int i) const
+{
+  auto const first = offsets[i];
+  auto const last = (static_cast<size_t>(i) + 1 < offsets.size()) ? offsets[i + 1] : static_cast<uint32_t>(chars.size());
+  return std::string_view(chars).substr(first, last - first);
+}
+
+library_index::library_index(std::vector<library_entry> e)
+  : entries(std::move(e))
+{
+  for(int i{}; i < static_cast<int>(entries.size()); ++i)
+  {
+    names.add(entries[i].name);
+    categories.add(entries[i].category);
+  }
+
+  for(int i{}; i < static_cast<int>(entries.size()); ++i)
+  {
+    for(auto &&text : {names.get(i), categories.get(i)})
+    {
+      for(size_t j{}; j + 3 <= text.size(); ++j)
+      {
+        // entries are added in order, so the lists stay sorted and a check of the back avoids duplicates
+        auto &&list = trigrams[trigram(text.data() + j)];
+        if(list.empty() || list.back() != i)
+        {
+          list.push_back(i);
+        }
+      }
+    }
+  }
+}
+
+size_t library_index::size() const
+{
+  return entries.size();
+}
+
+library_entry const &library_index::get_entry(int i) const
+{
+  return entries.at(i);
+}
+
+bool library_index::is_wildcard(std::string const &query)
+{
+  return query.find_first_of("*?") != std::string::npos;
+}
+
+std::vector<int> library_index::find(std::string const &query, std::atomic<bool> const *cancel) const
+{
+  return is_wildcard(query) ? find_wildcard(to_lower(query), cancel) : find_fuzzy(fuzzy_pattern(query), cancel);
+}
+
+std::vector<int> library_index::find_wildcard(std::string const &pattern, std::atomic<bool> const *cancel) const
+{
+  // every trigram of the literal runs has to occur in a matching entry
+  std::vector<std::vector<int> const *> lists;
+  for(auto &&literal : literals(pattern))
+  {
+    for(size_t i{}; i + 3 <= literal.size(); ++i)
+    {
+      auto it = trigrams.find(trigram(literal.data() + i));
+      if(it == end(trigrams))
+      {
+        return{};
+      }
+      lists.push_back(&it->second);
+    }
+  }
+
+  std::vector<int> candidates;
+  if(lists.empty())
+  {
+    // too short to use the index
+    candidates.resize(entries.size());
+    std::iota(begin(candidates), end(candidates), 0);
+  }
+  else
+  {
+    std::sort(begin(lists), end(lists), [](auto &&lhs, auto &&rhs) { return lhs->size() < rhs->size(); });
+    candidates = *lists.front();
+    for(auto it = std::next(begin(lists)); it != end(lists) && !candidates.empty(); ++it)
+    {
+      std::vector<int> intersection;
+      std::set_intersection(begin(candidates), end(candidates), begin(**it), end(**it), std::back_inserter(intersection));
+      candidates.swap(intersection);
+    }
+  }
+
+  return filter(candidates, pattern, true, cancel);
+}
+
+std::vector<int> library_index::find_fuzzy(std::string const &pattern, std::atomic<bool> const *cancel) const
+{
+  // an entry has to contain all characters of the pattern; this loop has no branches and
+  // no dependencies between iterations, so the compiler vectorizes it
+  auto const mask = character_mask(pattern);
+  auto const count = entries.size();
+  std::vector<uint8_t> candidates(count);
+  for(size_t i{}; i < count; ++i)
+  {
+    candidates[i] = (mask & ~(names.masks[i] | categories.masks[i])) == 0;
+  }
+
+  std::vector<int> result;
+  for(size_t i{}; i < count; ++i)
+  {
+    if(is_cancelled(cancel, i))
+    {
+      return{};
+    }
+    if(candidates[i] && matches(static_cast<int>(i), pattern, false))
+    {
+      result.push_back(static_cast<int>(i));
+    }
+  }
+  return result;
+}
+
+std::vector<int> library_index::refine(std::string const &query, std::vector<int> const &candidates, std::atomic<bool> const *cancel) const
+{
+  auto const wildcard = is_wildcard(query);
+  return filter(candidates, wildcard ? to_lower(query) : fuzzy_pattern(query), wildcard, cancel);
+}
+
+std::vector<int> library_index::filter(std::vector<int> const &candidates, std::string const &pattern, bool wildcard, std::atomic<bool> const *cancel) const
+{
+  std::vector<int> result;
+  for(size_t i{}; i < candidates.size(); ++i)
+  {
+    if(is_cancelled(cancel, i))
+    {
+      return{};
+    }
+    if(matches(candidates[i], pattern, wildcard))
+    {
+      result.push_back(candidates[i]);
+    }
+  }
+  return result;
+}
+
+bool library_index::matches(int i, std::string const &pattern, bool wildcard) const
+{
+  if(wildcard)
+  {
+    return match_wildcard(names.get(i), pattern) || match_wildcard(categories.get(i), pattern);
+  }
+  return match_subsequence(names.get(i), pattern) || match_subsequence(categories.get(i), pattern);
+}
+
+void library_index::score(std::string const &query, std::vector<int> const &matches, std::vector<int> &scores, std::atomic<bool> const *cancel) const
+{
+  // the literal characters of a wildcard match appear in order, so both kinds of queries
+  // are ranked as fuzzy matches
+  auto const pattern = fuzzy_pattern(query);
+
+  std::vector<int> rows;
+  scores.resize(matches.size());
+  for(size_t i{}; i < matches.size(); ++i)
+  {
+    if(is_cancelled(cancel, i))
+    {
+      return;
+    }
+    auto const name_score = score(names, matches[i], pattern, rows);
+    auto const category_score = score(categories, matches[i], pattern, rows) - constants::score_category_penalty;
+    scores[i] = std::max({name_score, category_score, 0});
+  }
+}
+
+int library_index::score(column const &texts, int i, std::string const &pattern, std::vector<int> &rows) const
+{
+  // best alignment of the pattern in the text, one row per pattern character:
+  // matched[j] is the best score with the current character at j,
+  // best[j] the best score with the current character at or before j
+  auto const text = texts.get(i);
+  auto const boundaries = texts.boundaries.data() + texts.offsets[i];
+  auto const n = text.size();
+  if(pattern.empty() || pattern.size() > n)
+  {
+    return constants::score_none;
+  }
+
+  rows.assign(4 * n, constants::score_none);
+  auto matched = rows.data();
+  auto best = matched + n;
+  auto next_matched = best + n;
+  auto next_best = next_matched + n;
+
+  auto const bonus = [&](size_t j)
+  {
+    return (boundaries[j] == constants::text_start) ? constants::score_prefix
+         : (boundaries[j] == constants::word_start) ? constants::score_boundary
+         : 0;
+  };
+
+  for(size_t j{}; j < n; ++j)
+  {
+    auto const current = (text[j] == pattern[0]) ? constants::score_match + bonus(j) - static_cast<int>(j) * constants::score_gap : constants::score_none;
+    matched[j] = current;
+    best[j] = std::max(current, j ? best[j - 1] - constants::score_gap : constants::score_none);
+  }
+
+  for(size_t p = 1; p < pattern.size(); ++p)
+  {
+    // positions before p cannot hold the p-th character
+    auto const c = pattern[p];
+    std::fill(next_matched, next_matched + p, constants::score_none);
+    std::fill(next_best, next_best + p, constants::score_none);
+    for(size_t j = p; j < n; ++j)
+    {
+      auto current = constants::score_none;
+      if(text[j] == c)
+      {
+        current = constants::score_match + std::max(best[j - 1] + bonus(j), matched[j - 1] + constants::score_consecutive);
+      }
+      next_matched[j] = current;
+      next_best[j] = std::max(current, next_best[j - 1] - constants::score_gap);
+    }
+    std::swap(matched, next_matched);
+    std::swap(best, next_best);
+  }
+
+  // characters after the match do not count
+  return *std::max_element(matched, matched + n);
+}
+
+library_search::library_search(library_index const &index)
+  : index(index)
+  , result(index.find({}))
+{
+}
+
+std::vector<int> const &library_search::update(std::string const &new_query)
+{
+  std::atomic<bool> const never{};
+  update(new_query, never);
+  return result;
+}
+
+bool library_search::update(std::string const &new_query, std::atomic<bool> const &cancel)
+{
+  if(new_query == query)
+  {
+    return true;
+  }
+
+  // every match of a pattern contains a match of each of its substrings; a wildcard match
+  // also matches the fuzzy query of its literal characters
+  auto const is_refinement = !query.empty() && (new_query.find(query) != std::string::npos);
+  auto new_result = is_refinement ? index.refine(new_query, result, &cancel) : index.find(new_query, &cancel);
+
+  std::vector<int> new_scores;
+  if(!new_query.empty())
+  {
+    index.score(new_query, new_result, new_scores, &cancel);
+  }
+
+  if(cancel)
+  {
+    return false;
+  }
+
+  query = new_query;
+  result = std::move(new_result);
+  scores = std::move(new_scores);
+  return true;
+}
+
+std::vector<int> const &library_search::get_result() const
+{
+  return result;
+}
+
+std::vector<int> library_search::get_best(size_t count) const
+{
+  if(scores.empty())
+  {
+    return{};
+  }
+
+  std::vector<int> order(result.size());
+  std::iota(begin(order), end(order), 0);
+  count = std::min(count, order.size());
+  std::partial_sort(begin(order), begin(order) + count, end(order), [&](int lhs, int rhs)
+  {
+    return (scores[lhs] != scores[rhs]) ? scores[lhs] > scores[rhs] : lhs < rhs;
+  });
+
+  std::vector<int> best;
+  best.reserve(count);
+  std::transform(begin(order), begin(order) + count, std::back_inserter(best), [&](int i) { return result[i]; });
+  return best;
+}
+
+} // namespace skadi
@@ -0,0 +1,608 @@
+#include "optimizer.h"
+#include "engine.h"
+
+#include <array>
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace skadi
+{
+
+namespace constants
+{
+  // fused chains compute their intermediate columns in tiles of rows which fit into this
+  // together, the size of a typical L1 data cache; numbers take 8 bytes per row
+  static size_t const tile_bytes = size_t{32} << 10;
+  static size_t const min_tile_rows = 64;
+  // batches whose columns fit into this, a share of a typical L2 cache, are not cut into
+  // tiles; copying their rows into tiles and back costs more than the L1 saves
+  static size_t const whole_batch_bytes = size_t{256} << 10;
+}
+
+namespace
+{
+  std::unordered_map<int64_t, node_type const *> index_types(type_registry const &registry)
+  {
+    std::unordered_map<int64_t, node_type const *> types;
+    for(auto &&t : registry.node_types)
+    {
+      types.emplace(t.guid.guid, &t);
+    }
+    return types;
+  }
+
+  int64_t get_unused_guid(type_registry const &registry)
+  {
+    int64_t guid{};
+    for(auto &&t : registry.node_types)
+    {
+      guid = std::max(guid, t.guid.guid + 1);
+    }
+    return guid;
+  }
+
+  void remove_nodes(graph &g, std::unordered_set<int64_t> const &ids)
+  {
+    g.nodes.erase(std::remove_if(begin(g.nodes), end(g.nodes), [&](auto &&n) { return ids.count(n.uid.id) > 0; }), end(g.nodes));
+    g.connections.erase(std::remove_if(begin(g.connections), end(g.connections), [&](auto &&c)
+    {
+      return ids.count(c.source.id) || ids.count(c.destination.id);
+    }), end(g.connections));
+  }
+
+  bool is_number(value const &v)
+  {
+    return std::holds_alternative<int64_t>(v.data) || std::holds_alternative<double>(v.data);
+  }
+
+  void broadcast(value const &v, size_t row_count, column &c)
+  {
+    if(auto i = std::get_if<int64_t>(&v.data))
+    {
+      auto &&rows = set_rows<int64_t>(c, row_count);
+      std::fill(begin(rows), end(rows), *i);
+    }
+    else
+    {
+      auto &&rows = set_rows<double>(c, row_count);
+      std::fill(begin(rows), end(rows), get_float(v));
+    }
+  }
+
+  // count rows of from starting at first, into to
+  void copy_rows(column const &from, size_t first, size_t count, column &to)
+  {
+    std::visit([&](auto &&rows)
+    {
+      using rows_type = std::decay_t<decltype(rows)>;
+      if constexpr(!std::is_same_v<rows_type, std::monostate>)
+      {
+        auto &&result = set_rows<typename rows_type::value_type>(to, count);
+        std::copy_n(begin(rows) + first, count, begin(result));
+      }
+      else
+      {
+        to.data = std::monostate{};
+      }
+    }, from.data);
+    to.type = from.type;
+  }
+
+  // all rows of from, into to starting at first; to has row_count rows
+  void place_rows(column const &from, size_t first, size_t row_count, column &to)
+  {
+    std::visit([&](auto &&rows)
+    {
+      using rows_type = std::decay_t<decltype(rows)>;
+      if constexpr(!std::is_same_v<rows_type, std::monostate>)
+      {
+        using T = typename rows_type::value_type;
+        if(!std::holds_alternative<std::vector<T>>(to.data) || (get_row_count(to) != row_count))
+        {
+          set_rows<T>(to, row_count);
+        }
+        auto &&result = std::get<std::vector<T>>(to.data);
+        std::copy_n(begin(rows), std::min(rows.size(), row_count - first), begin(result) + first);
+      }
+    }, from.data);
+  }
+
+  struct fused_stage
+  {
+    kernel run;
+    batch_kernel run_batch;
+    std::vector<int> sources; // per input, the output of the previous stage or -1
+    std::vector<data_type_id> output_types;
+  };
+
+  void run_chain(std::vector<fused_stage> const &stages, port_range<value const> inputs, port_range<value> outputs)
+  {
+    std::vector<value> previous(inputs.begin(), inputs.end());
+    std::vector<value> stage_inputs;
+    std::vector<value> stage_outputs;
+    for(size_t k{}; k < stages.size(); ++k)
+    {
+      auto &&stage = stages[k];
+      if(k > 0)
+      {
+        stage_inputs.assign(stage.sources.size(), {});
+        for(size_t p{}; p < stage.sources.size(); ++p)
+        {
+          if(stage.sources[p] >= 0)
+          {
+            stage_inputs[p] = previous[stage.sources[p]];
+          }
+        }
+        std::swap(previous, stage_inputs);
+      }
+      if(k + 1 == stages.size())
+      {
+        stage.run({previous.data(), previous.size()}, outputs);
+        return;
+      }
+      stage_outputs.assign(stage.output_types.size(), {});
+      stage.run({previous.data(), previous.size()}, {stage_outputs.data(), stage_outputs.size()});
+      for(size_t p{}; p < stage_outputs.size(); ++p)
+      {
+        stage_outputs[p].type = stage.output_types[p];
+      }
+      std::swap(previous, stage_outputs);
+    }
+  }
+
+  // two sets of tile columns which the stages alternate between, and the inputs of the
+  // chain cut into tiles
+  struct chain_scratch
+  {
+    std::array<std::vector<column>, 2> tiles;
+    std::vector<std::vector<column const *>> tile_inputs;
+    std::vector<column> input_tiles;
+  };
+
+  // a stage only reads the columns of the one before, so the inputs of the chain and the
+  // outputs of two stages are all that has to stay in the cache at a time
+  size_t get_row_bytes(std::vector<fused_stage> const &stages)
+  {
+    size_t outputs{};
+    for(auto &&stage : stages)
+    {
+      outputs = std::max(outputs, stage.output_types.size());
+    }
+    return sizeof(double) * std::max(stages.front().sources.size() + 2 * outputs, size_t{1});
+  }
+
+  size_t get_tile_rows(size_t row_bytes, size_t row_count)
+  {
+    if(row_count * row_bytes <= constants::whole_batch_bytes)
+    {
+      return std::max(row_count, size_t{1});
+    }
+    return std::max(constants::min_tile_rows, constants::tile_bytes / row_bytes);
+  }
+
+  void run_chain_batch(std::vector<fused_stage> const &stages, size_t row_bytes, batch_range range, port_range<column const *const> inputs, port_range<column> outputs)
+  {
+    // reused by the batches computed on the same thread, so the columns keep their buffers;
+    // a stack, as stages may be fused chains themselves
+    thread_local std::deque<chain_scratch> scratch_stack;
+    thread_local size_t depth{};
+    if(depth == scratch_stack.size())
+    {
+      scratch_stack.emplace_back();
+    }
+    auto &&scratch = scratch_stack[depth];
+    struct depth_guard
+    {
+      depth_guard() { ++depth; }
+      ~depth_guard() { --depth; }
+    } guard;
+
+    auto &&tiles = scratch.tiles;
+    auto &&tile_inputs = scratch.tile_inputs;
+    auto &&input_tiles = scratch.input_tiles;
+    tile_inputs.resize(stages.size());
+    input_tiles.resize(inputs.size());
+    for(size_t k{}; k < stages.size(); ++k)
+    {
+      auto &&set = tiles[k % 2];
+      set.resize(std::max(set.size(), stages[k].output_types.size()));
+      tile_inputs[k].assign(stages[k].sources.size(), nullptr);
+      for(size_t p{}; (k > 0) && (p < stages[k].sources.size()); ++p)
+      {
+        if(stages[k].sources[p] >= 0)
+        {
+          tile_inputs[k][p] = &tiles[(k - 1) % 2][stages[k].sources[p]];
+        }
+      }
+    }
+
+    // tiles of equal size, so the last one is not a small remainder
+    auto const tile_rows = get_tile_rows(row_bytes, range.row_count);
+    auto const tile_count = (range.row_count + tile_rows - 1) / tile_rows;
+    auto const rows_per_tile = (tile_count > 0) ? (range.row_count + tile_count - 1) / tile_count : 0;
+    auto const last = stages.size() - 1;
+    for(size_t first{}; first < range.row_count; first += rows_per_tile)
+    {
+      auto const count = std::min(rows_per_tile, range.row_count - first);
+      bool const is_whole = (count == range.row_count);
+      batch_range const tile{range.first_row + static_cast<int64_t>(first), count};
+
+      for(size_t p{}; p < inputs.size(); ++p)
+      {
+        if(is_whole || !inputs[p])
+        {
+          tile_inputs[0][p] = inputs[p];
+        }
+        else
+        {
+          copy_rows(*inputs[p], first, count, input_tiles[p]);
+          tile_inputs[0][p] = &input_tiles[p];
+        }
+      }
+
+      for(size_t k{}; k <= last; ++k)
+      {
+        auto &&stage = stages[k];
+        port_range<column> results = ((k == last) && is_whole)
+          ? outputs
+          : port_range<column>{tiles[k % 2].data(), stage.output_types.size()};
+        stage.run_batch(tile, {tile_inputs[k].data(), tile_inputs[k].size()}, results);
+        for(size_t p{}; p < results.size(); ++p)
+        {
+          results[p].type = stage.output_types[p];
+        }
+      }
+
+      if(!is_whole)
+      {
+        for(size_t p{}; p < outputs.size(); ++p)
+        {
+          place_rows(tiles[last % 2][p], first, range.row_count, outputs[p]);
+        }
+      }
+    }
+  }
+}
+
+optimized_graph optimize(graph const &g, type_registry const &registry, kernel_registry const &kernels, execution_target target, optimizer_passes passes)
+{
+  // checked first, so the passes can rely on a valid graph
+  compile(g, registry);
+
+  optimized_graph o{g, registry, kernels, 0, 0, 0};
+  if(passes.eliminate_dead_nodes)
+  {
+    eliminate_dead_nodes(o);
+  }
+  if(passes.fold_constants)
+  {
+    fold_constants(o, target);
+  }
+  if(passes.fuse_chains)
+  {
+    fuse_chains(o, target);
+  }
+  return o;
+}
+
+void eliminate_dead_nodes(optimized_graph &o)
+{
+  auto const types = index_types(o.registry);
+  std::unordered_map<int64_t, std::vector<int64_t>> producers;
+  for(auto &&c : o.content.connections)
+  {
+    producers[c.destination.id].push_back(c.source.id);
+  }
+
+  // everything upstream of a sink
+  std::unordered_set<int64_t> live;
+  std::vector<int64_t> pending;
+  for(auto &&n : o.content.nodes)
+  {
+    auto type = types.find(n.type.guid);
+    if((type != end(types)) && type->second->outputs.empty() && live.insert(n.uid.id).second)
+    {
+      pending.push_back(n.uid.id);
+    }
+  }
+  while(!pending.empty())
+  {
+    auto const id = pending.back();
+    pending.pop_back();
+    for(auto &&source : producers[id])
+    {
+      if(live.insert(source).second)
+      {
+        pending.push_back(source);
+      }
+    }
+  }
+
+  std::unordered_set<int64_t> dead;
+  for(auto &&n : o.content.nodes)
+  {
+    if(!live.count(n.uid.id))
+    {
+      dead.insert(n.uid.id);
+    }
+  }
+  remove_nodes(o.content, dead);
+  o.removed_count += dead.size();
+}
+
+void fold_constants(optimized_graph &o, execution_target target)
+{
+  auto const plan = compile(o.content, o.registry);
+  auto const step_count = plan.steps.size();
+
+  // in topological order, so producers are decided before their consumers
+  std::vector<bool> is_constant(step_count);
+  std::vector<bool> has_variable_input(step_count);
+  for(size_t i{}; i < step_count; ++i)
+  {
+    auto &&step = plan.steps[i];
+    bool const is_source = (step.input_count == 0);
+    is_constant[i] = !step.output_types.empty() && o.kernels.is_pure(step.type) && !has_variable_input[i]
+      && !(is_source && (target == execution_target::batches));
+    for(auto &&port : step.consumers)
+    {
+      for(auto &&ref : port)
+      {
+        if(!is_constant[i])
+        {
+          has_variable_input[ref.node] = true;
+        }
+      }
+    }
+  }
+  if(std::none_of(begin(is_constant), end(is_constant), [](bool b) { return b; }))
+  {
+    return;
+  }
+
+  graph constant_graph;
+  for(auto &&n : o.content.nodes)
+  {
+    if(is_constant[plan.indices.at(n.uid.id)])
+    {
+      constant_graph.nodes.push_back(n);
+    }
+  }
+  for(auto &&c : o.content.connections)
+  {
+    if(is_constant[plan.indices.at(c.destination.id)])
+    {
+      constant_graph.connections.push_back(c);
+    }
+  }
+  engine constants_engine(o.registry, o.kernels);
+  constants_engine.load(constant_graph);
+  constants_engine.run();
+
+  // Constants feeding other nodes are kept as nodes; columns can only be filled with
+  // numbers, so other values are computed by their node after all, which may make the
+  // constants feeding it boundaries in turn.
+  auto const is_boundary = [&](size_t i)
+  {
+    return std::any_of(begin(plan.steps[i].consumers), end(plan.steps[i].consumers), [&](auto &&port)
+    {
+      return std::any_of(begin(port), end(port), [&](auto &&ref) { return !is_constant[ref.node]; });
+    });
+  };
+  for(bool is_changed = (target == execution_target::batches); is_changed;)
+  {
+    is_changed = false;
+    for(size_t i{}; i < step_count; ++i)
+    {
+      if(is_constant[i] && is_boundary(i))
+      {
+        auto const outputs = constants_engine.get_outputs(plan.steps[i].id);
+        if(!std::all_of(outputs.begin(), outputs.end(), is_number))
+        {
+          is_constant[i] = false;
+          is_changed = true;
+        }
+      }
+    }
+  }
+
+  // new types are added at the end, the registry is referenced until then
+  auto const types = index_types(o.registry);
+  auto next_guid = get_unused_guid(o.registry);
+  std::vector<node_type> constant_types;
+  std::unordered_set<int64_t> folded;
+  std::vector<std::pair<int64_t, node_type_id>> replaced;
+  for(size_t i{}; i < step_count; ++i)
+  {
+    if(!is_constant[i])
+    {
+      continue;
+    }
+    auto &&step = plan.steps[i];
+    ++o.folded_count;
+    if(!is_boundary(i))
+    {
+      folded.insert(step.id.id);
+      continue;
+    }
+
+    auto &&type = *types.at(step.type.guid);
+    auto const outputs = constants_engine.get_outputs(step.id);
+    std::vector<value> values(outputs.begin(), outputs.end());
+    node_type_id const id{next_guid++};
+    constant_types.push_back({id, type.name + " (constant)", type.category, {}, type.outputs});
+    o.kernels.add(id, [values](auto &&, auto &&results)
+    {
+      std::copy(begin(values), end(values), results.begin());
+    });
+    o.kernels.add_batch(id, [values](batch_range range, auto &&, auto &&results)
+    {
+      for(size_t p{}; p < results.size(); ++p)
+      {
+        broadcast(values[p], range.row_count, results[p]);
+      }
+    }, true);
+    replaced.emplace_back(step.id.id, id);
+  }
+
+  o.registry.node_types.insert(end(o.registry.node_types), begin(constant_types), end(constant_types));
+
+  // constants lose their inputs, the rest of them goes
+  std::unordered_map<int64_t, node_type_id> new_types(begin(replaced), end(replaced));
+  for(auto &&n : o.content.nodes)
+  {
+    if(auto it = new_types.find(n.uid.id); it != end(new_types))
+    {
+      n.type = it->second;
+    }
+  }
+  auto &&connections = o.content.connections;
+  connections.erase(std::remove_if(begin(connections), end(connections), [&](auto &&c)
+  {
+    return new_types.count(c.destination.id) > 0;
+  }), end(connections));
+  remove_nodes(o.content, folded);
+}
+
+void fuse_chains(optimized_graph &o, execution_target target)
+{
+  auto const plan = compile(o.content, o.registry);
+  auto const step_count = static_cast<int>(plan.steps.size());
+
+  std::vector<bool> is_fusable(step_count);
+  for(int i{}; i < step_count; ++i)
+  {
+    auto &&step = plan.steps[i];
+    is_fusable[i] = !step.output_types.empty()
+      && ((target == execution_target::values) ? (o.kernels.find(step.type) != nullptr) : o.kernels.is_elementwise(step.type));
+  }
+
+  // the node a node is chained to, if it only feeds that one and that one is only fed by it
+  std::vector<int> next(step_count, -1);
+  std::vector<bool> has_previous(step_count);
+  for(int i{}; i < step_count; ++i)
+  {
+    int consumer = -1;
+    int count{};
+    bool is_single = is_fusable[i];
+    for(auto &&port : plan.steps[i].consumers)
+    {
+      for(auto &&ref : port)
+      {
+        is_single = is_single && ((consumer < 0) || (consumer == ref.node));
+        consumer = ref.node;
+        ++count;
+      }
+    }
+    if(is_single && (consumer >= 0) && is_fusable[consumer] && (plan.steps[consumer].connected_input_count == count))
+    {
+      next[i] = consumer;
+      has_previous[consumer] = true;
+    }
+  }
+
+  auto const types = index_types(o.registry);
+  auto next_guid = get_unused_guid(o.registry);
+  std::vector<node_type> chain_types;
+  std::unordered_set<int64_t> merged;
+  std::unordered_map<int64_t, std::pair<int64_t, node_type_id>> heads; // head id -> chain id, type
+  for(int head{}; head < step_count; ++head)
+  {
+    if(has_previous[head] || (next[head] < 0))
+    {
+      continue;
+    }
+
+    std::vector<fused_stage> stages;
+    std::string name;
+    bool is_pure = true;
+    int last = head;
+    for(int i = head; i >= 0; i = next[i])
+    {
+      auto &&step = plan.steps[i];
+      fused_stage stage{};
+      if(target == execution_target::values)
+      {
+        stage.run = *o.kernels.find(step.type);
+      }
+      else
+      {
+        stage.run_batch = *o.kernels.find_batch(step.type);
+      }
+      stage.sources.assign(step.input_count, -1);
+      stage.output_types = step.output_types;
+      if(i != head)
+      {
+        auto &&previous = plan.steps[last];
+        for(size_t q{}; q < previous.consumers.size(); ++q)
+        {
+          for(auto &&ref : previous.consumers[q])
+          {
+            stage.sources[ref.port] = static_cast<int>(q);
+          }
+        }
+        merged.insert(plan.steps[last].id.id);
+      }
+      stages.push_back(std::move(stage));
+      is_pure = is_pure && o.kernels.is_pure(step.type);
+      name += (name.empty() ? "" : " > ") + types.at(step.type.guid)->name;
+      last = i;
+    }
+
+    auto &&head_type = *types.at(plan.steps[head].type.guid);
+    auto &&last_type = *types.at(plan.steps[last].type.guid);
+    node_type_id const id{next_guid++};
+    chain_types.push_back({id, name, head_type.category, head_type.inputs, last_type.outputs});
+    if(target == execution_target::values)
+    {
+      o.kernels.add(id, [stages](auto &&inputs, auto &&outputs) { run_chain(stages, inputs, outputs); }, is_pure);
+    }
+    else
+    {
+      auto const row_bytes = get_row_bytes(stages);
+      o.kernels.add_batch(id, [stages, row_bytes](batch_range range, auto &&inputs, auto &&outputs)
+      {
+        run_chain_batch(stages, row_bytes, range, inputs, outputs);
+      }, true);
+    }
+    heads.emplace(plan.steps[head].id.id, std::make_pair(plan.steps[last].id.id, id));
+    o.fused_count += stages.size();
+  }
+  if(heads.empty())
+  {
+    return;
+  }
+  o.registry.node_types.insert(end(o.registry.node_types), begin(chain_types), end(chain_types));
+
+  // chains take the place of their last node, and the inputs of their first
+  std::unordered_map<int64_t, node_type_id> new_types;
+  for(auto &&[head, chain] : heads)
+  {
+    new_types.emplace(chain.first, chain.second);
+  }
+  for(auto &&n : o.content.nodes)
+  {
+    if(auto it = new_types.find(n.uid.id); it != end(new_types))
+    {
+      n.type = it->second;
+    }
+  }
+  auto &&connections = o.content.connections;
+  connections.erase(std::remove_if(begin(connections), end(connections), [&](auto &&c)
+  {
+    return merged.count(c.source.id) > 0;
+  }), end(connections));
+  for(auto &&c : connections)
+  {
+    if(auto it = heads.find(c.destination.id); it != end(heads))
+    {
+      c.destination.id = it->second.first;
+    }
+  }
+  remove_nodes(o.content, merged);
+}
+
+} // namespace skadi
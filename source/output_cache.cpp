@@ -0,0 +1,403 @@
+#include "output_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace skadi
+{
+
+namespace constants
+{
+  static uint32_t const log_magic = 0x31434b53; // "SKC1"
+  static char const *const log_name = "outputs.skc";
+  static char const *const compacted_log_name = "outputs.skc.tmp";
+  static size_t const entry_overhead = 96; // list node, index slot and vector header
+  // records are the key, the number of values and a guid, tag and payload per value
+  static std::streamoff const record_header_size = 8 + 8 + 8 + 4;
+  static std::streamoff const record_value_size = 8 + 1 + 8;
+  // about the time it takes to append an entry to the log and read it back
+  static std::chrono::nanoseconds const min_spill_cost = std::chrono::microseconds(20);
+  // compacting leaves room for this share of the budget, so it is not repeated on every spill
+  static double const compacted_share = 0.75;
+}
+
+namespace
+{
+  uint64_t combine(cache_key const &key)
+  {
+    auto h = static_cast<uint64_t>(key.node_type) * 0x9e3779b97f4a7c15ull;
+    h ^= key.parameters + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    h ^= key.inputs + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    return h;
+  }
+
+  bool is_same(cache_key const &a, cache_key const &b)
+  {
+    return (a.node_type == b.node_type) && (a.parameters == b.parameters) && (a.inputs == b.inputs);
+  }
+
+  bool is_spillable(std::vector<value> const &values)
+  {
+    return std::all_of(begin(values), end(values), [](auto &&v) { return hash_value(v).has_value(); });
+  }
+
+  template<typename T>
+  void write(std::ostream &os, T const &v)
+  {
+    os.write(reinterpret_cast<char const *>(&v), sizeof(v));
+  }
+
+  template<typename T>
+  bool read(std::istream &is, T &v)
+  {
+    return static_cast<bool>(is.read(reinterpret_cast<char *>(&v), sizeof(v)));
+  }
+
+  bool read(std::istream &is, cache_key &key)
+  {
+    return read(is, key.node_type) && read(is, key.parameters) && read(is, key.inputs);
+  }
+}
+
+output_cache::output_cache(size_t memory_budget, std::filesystem::path spill_directory, size_t disk_budget)
+  : memory_budget(memory_budget)
+  , disk_budget(static_cast<std::streamoff>(disk_budget))
+  , is_spilling(!spill_directory.empty())
+  , memory()
+  , log_size()
+  , log_clock()
+  , hits()
+  , disk_hits()
+  , misses()
+  , evictions()
+{
+  if(is_spilling)
+  {
+    std::filesystem::create_directories(spill_directory);
+    open_log(spill_directory / constants::log_name);
+  }
+}
+
+output_cache::~output_cache()
+{
+  if(is_spilling)
+  {
+    for(auto &&e : entries)
+    {
+      spill(e);
+    }
+  }
+}
+
+bool output_cache::find(cache_key const &key, port_range<value> outputs)
+{
+  auto const h = combine(key);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(h);
+    if((it != end(index)) && is_same(it->second->key, key) && (it->second->outputs.size() == outputs.size()))
+    {
+      entries.splice(begin(entries), entries, it->second);
+      std::copy(begin(it->second->outputs), end(it->second->outputs), outputs.begin());
+      ++hits;
+      return true;
+    }
+  }
+
+  if(is_spilling)
+  {
+    if(auto loaded = load(key); loaded && (loaded->size() == outputs.size()))
+    {
+      std::copy(begin(*loaded), end(*loaded), outputs.begin());
+      ++hits;
+      ++disk_hits;
+
+      // back into memory, it is likely to be used again; it is in the log already
+      std::vector<entry> evicted;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto const size = constants::entry_overhead + loaded->size() * sizeof(value);
+        add({key, std::move(*loaded), size, constants::min_spill_cost}, evicted);
+      }
+      for(auto &&e : evicted)
+      {
+        spill(e);
+      }
+      return true;
+    }
+  }
+
+  ++misses;
+  return false;
+}
+
+void output_cache::insert(cache_key const &key, port_range<value const> outputs, std::chrono::nanoseconds cost)
+{
+  auto const size = constants::entry_overhead + outputs.size() * sizeof(value);
+  if(size > memory_budget)
+  {
+    return;
+  }
+
+  std::vector<entry> evicted;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    add({key, {outputs.begin(), outputs.end()}, size, cost}, evicted);
+  }
+  if(is_spilling)
+  {
+    for(auto &&e : evicted)
+    {
+      spill(e);
+    }
+  }
+}
+
+output_cache::statistics output_cache::get_statistics() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return {hits, disk_hits, misses, evictions, memory, entries.size()};
+}
+
+void output_cache::clear()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+  index.clear();
+  memory = 0;
+}
+
+void output_cache::add(entry e, std::vector<entry> &evicted)
+{
+  auto const h = combine(e.key);
+  if(auto it = index.find(h); it != end(index))
+  {
+    memory -= it->second->size;
+    entries.erase(it->second);
+    index.erase(it);
+  }
+
+  memory += e.size;
+  entries.push_front(std::move(e));
+  index[h] = begin(entries);
+
+  while(memory > memory_budget)
+  {
+    auto &&last = entries.back();
+    memory -= last.size;
+    index.erase(combine(last.key));
+    evicted.push_back(std::move(last));
+    entries.pop_back();
+    ++evictions;
+  }
+}
+
+void output_cache::open_log(std::filesystem::path const &path)
+{
+  if(!std::filesystem::exists(path))
+  {
+    std::ofstream os(path, std::ios::binary);
+    write(os, constants::log_magic);
+  }
+
+  log.open(path, std::ios::binary | std::ios::in | std::ios::out);
+  uint32_t magic{};
+  if(!log || !read(log, magic) || (magic != constants::log_magic))
+  {
+    throw std::runtime_error("output_cache: cannot open " + path.string());
+  }
+
+  // index the records; a record cut short by a crash is dropped from the end
+  log_path = path;
+  auto const size = static_cast<std::streamoff>(std::filesystem::file_size(path));
+  std::streamoff offset = sizeof(magic);
+  size_t record_count{};
+  while(offset < size)
+  {
+    cache_key key{};
+    uint32_t count{};
+    log.seekg(offset);
+    if(!read(log, key) || !read(log, count))
+    {
+      break;
+    }
+    auto const next = offset + constants::record_header_size + count * constants::record_value_size;
+    if(next > size)
+    {
+      break;
+    }
+    // later records supersede earlier ones with the same hash, and count as used later
+    spilled[combine(key)] = {offset, next - offset, ++log_clock};
+    ++record_count;
+    offset = next;
+  }
+  log.clear();
+  if(offset < size)
+  {
+    log.close();
+    std::filesystem::resize_file(path, static_cast<uintmax_t>(offset));
+    log.open(path, std::ios::binary | std::ios::in | std::ios::out);
+  }
+  log_size = offset;
+
+  if((log_size > disk_budget) || (record_count > spilled.size()))
+  {
+    compact(static_cast<std::streamoff>(disk_budget * constants::compacted_share));
+  }
+}
+
+void output_cache::spill(entry const &e)
+{
+  if((e.cost < constants::min_spill_cost) || !is_spillable(e.outputs))
+  {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(log_mutex);
+  // outputs of pure kernels do not change, so a record is never rewritten
+  auto const h = combine(e.key);
+  if(spilled.count(h) || !log)
+  {
+    return;
+  }
+
+  log.seekp(0, std::ios::end);
+  auto const offset = static_cast<std::streamoff>(log.tellp());
+  write(log, e.key.node_type);
+  write(log, e.key.parameters);
+  write(log, e.key.inputs);
+  write(log, static_cast<uint32_t>(e.outputs.size()));
+  for(auto &&v : e.outputs)
+  {
+    uint64_t payload{};
+    if(auto i = std::get_if<int64_t>(&v.data))
+    {
+      payload = static_cast<uint64_t>(*i);
+    }
+    else if(auto f = std::get_if<double>(&v.data))
+    {
+      std::memcpy(&payload, f, sizeof(payload));
+    }
+    write(log, v.type.guid);
+    write(log, static_cast<uint8_t>(v.data.index()));
+    write(log, payload);
+  }
+  log.flush();
+  if(!log)
+  {
+    return;
+  }
+  log_size = offset + constants::record_header_size + static_cast<std::streamoff>(e.outputs.size()) * constants::record_value_size;
+  spilled[h] = {offset, log_size - offset, ++log_clock};
+
+  if(log_size > disk_budget)
+  {
+    compact(static_cast<std::streamoff>(disk_budget * constants::compacted_share));
+  }
+}
+
+std::optional<std::vector<value>> output_cache::load(cache_key const &key)
+{
+  std::lock_guard<std::mutex> lock(log_mutex);
+  auto it = spilled.find(combine(key));
+  if(it == end(spilled))
+  {
+    return {};
+  }
+
+  it->second.last_use = ++log_clock;
+  cache_key stored{};
+  uint32_t count{};
+  log.seekg(it->second.offset);
+  if(!read(log, stored) || !is_same(stored, key) || !read(log, count))
+  {
+    log.clear();
+    return {};
+  }
+
+  std::vector<value> values(count);
+  for(auto &&v : values)
+  {
+    uint8_t tag{};
+    uint64_t payload{};
+    if(!read(log, v.type.guid) || !read(log, tag) || !read(log, payload) || (tag > 2))
+    {
+      log.clear();
+      return {};
+    }
+    if(tag == 1)
+    {
+      v.data = static_cast<int64_t>(payload);
+    }
+    else if(tag == 2)
+    {
+      double f{};
+      std::memcpy(&f, &payload, sizeof(f));
+      v.data = f;
+    }
+  }
+  return values;
+}
+
+void output_cache::compact(std::streamoff target)
+{
+  std::vector<std::pair<uint64_t, record>> kept(begin(spilled), end(spilled));
+  std::sort(begin(kept), end(kept), [](auto &&a, auto &&b) { return a.second.last_use > b.second.last_use; });
+  auto size = static_cast<std::streamoff>(sizeof(constants::log_magic));
+  auto const last = std::find_if(begin(kept), end(kept), [&](auto &&r)
+  {
+    size += r.second.size;
+    return size > target;
+  });
+  kept.erase(last, end(kept));
+  // least recently used first, which is the order they are indexed in when the log is opened
+  std::reverse(begin(kept), end(kept));
+
+  // the old log stays until the new one is complete
+  auto const compacted_path = log_path.parent_path() / constants::compacted_log_name;
+  std::unordered_map<uint64_t, record> compacted;
+  {
+    std::ofstream os(compacted_path, std::ios::binary | std::ios::trunc);
+    write(os, constants::log_magic);
+    std::streamoff offset = sizeof(constants::log_magic);
+    std::vector<char> buffer;
+    for(auto &&[h, r] : kept)
+    {
+      buffer.resize(static_cast<size_t>(r.size));
+      log.seekg(r.offset);
+      if(!log.read(buffer.data(), r.size))
+      {
+        log.clear();
+        continue;
+      }
+      os.write(buffer.data(), r.size);
+      compacted[h] = {offset, r.size, r.last_use};
+      offset += r.size;
+    }
+    os.flush();
+    if(!os)
+    {
+      std::error_code ignored;
+      std::filesystem::remove(compacted_path, ignored);
+      return;
+    }
+  }
+
+  log.close();
+  std::error_code error;
+  std::filesystem::rename(compacted_path, log_path, error);
+  if(error)
+  {
+    std::filesystem::remove(compacted_path, error);
+  }
+  else
+  {
+    spilled = std::move(compacted);
+  }
+  log.open(log_path, std::ios::binary | std::ios::in | std::ios::out);
+  log.seekp(0, std::ios::end);
+  log_size = log ? static_cast<std::streamoff>(log.tellp()) : 0;
+}
+
+} // namespace skadi
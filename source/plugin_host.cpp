@@ -0,0 +1,431 @@
+#include "graph_io.h"
+#include "plugin_api.h"
+#include "plugin_host.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_set>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+namespace skadi
+{
+
+namespace constants
+{
+  static char const *const manifest_suffix = ".plugin.json";
+}
+
+struct plugin_kernel
+{
+  node_type_id type;
+  skadi_kernel_function run;
+  void *user_data;
+  bool is_pure;
+};
+
+struct plugin_host::plugin
+{
+  std::filesystem::path manifest;
+  std::filesystem::path library;
+  type_registry types;
+
+  void *handle;
+  // what the library registered when it was loaded
+  type_registry registered;
+  std::vector<plugin_kernel> kernels;
+};
+
+namespace
+{
+  void *open_library(std::filesystem::path const &path)
+  {
+#if defined(_WIN32)
+    return LoadLibraryW(path.c_str());
+#else
+    return dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+  }
+
+  void *find_symbol(void *library, char const *name)
+  {
+#if defined(_WIN32)
+    return reinterpret_cast<void *>(GetProcAddress(static_cast<HMODULE>(library), name));
+#else
+    return dlsym(library, name);
+#endif
+  }
+
+  void close_library(void *library)
+  {
+#if defined(_WIN32)
+    FreeLibrary(static_cast<HMODULE>(library));
+#else
+    dlclose(library);
+#endif
+  }
+
+  std::string last_library_error()
+  {
+#if defined(_WIN32)
+    return "error " + std::to_string(GetLastError());
+#else
+    auto error = dlerror();
+    return error ? error : "unknown error";
+#endif
+  }
+
+  bool is_manifest(std::filesystem::path const &path)
+  {
+    std::string const name = path.filename().string();
+    std::string const suffix = constants::manifest_suffix;
+    return (name.size() > suffix.size()) && (name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0);
+  }
+
+  struct registration
+  {
+    type_registry types;
+    std::vector<plugin_kernel> kernels;
+  };
+
+  void add_data_type(void *context, skadi_data_type const *type)
+  {
+    static_cast<registration *>(context)->types.data_types.push_back({{type->guid}, type->name});
+  }
+
+  void add_node_type(void *context, skadi_node_type const *type)
+  {
+    node_type t{{type->guid}, type->name, type->category, {}, {}};
+    for(int32_t i{}; i < type->input_count; ++i)
+    {
+      t.inputs.push_back({{type->inputs[i].type}, type->inputs[i].name});
+    }
+    for(int32_t i{}; i < type->output_count; ++i)
+    {
+      t.outputs.push_back({{type->outputs[i].type}, type->outputs[i].name});
+    }
+    static_cast<registration *>(context)->types.node_types.push_back(std::move(t));
+  }
+
+  void add_kernel(void *context, int64_t node_type, skadi_kernel_function run, void *user_data, int32_t is_pure)
+  {
+    static_cast<registration *>(context)->kernels.push_back({{node_type}, run, user_data, is_pure != 0});
+  }
+
+  skadi_value to_plugin(value const &v)
+  {
+    skadi_value result{v.type.guid, SKADI_VALUE_EMPTY, 0, 0.0};
+    if(auto i = std::get_if<int64_t>(&v.data))
+    {
+      result.kind = SKADI_VALUE_INT;
+      result.int_value = *i;
+    }
+    else if(auto f = std::get_if<double>(&v.data))
+    {
+      result.kind = SKADI_VALUE_FLOAT;
+      result.float_value = *f;
+    }
+    else if(!is_empty(v))
+    {
+      result.kind = SKADI_VALUE_DATA;
+    }
+    return result;
+  }
+
+  void from_plugin(skadi_value const &v, value &result)
+  {
+    switch(v.kind)
+    {
+    case SKADI_VALUE_INT:
+      result.data = v.int_value;
+      break;
+    case SKADI_VALUE_FLOAT:
+      result.data = v.float_value;
+      break;
+    default:
+      result.data = std::monostate{};
+      break;
+    }
+  }
+
+  kernel wrap(plugin_kernel const &k)
+  {
+    return [k](port_range<value const> inputs, port_range<value> outputs)
+    {
+      // reused by the nodes computed on the same thread
+      thread_local std::vector<skadi_value> values;
+      values.clear();
+      for(auto &&v : inputs)
+      {
+        values.push_back(to_plugin(v));
+      }
+      for(auto &&v : outputs)
+      {
+        values.push_back({v.type.guid, SKADI_VALUE_EMPTY, 0, 0.0});
+      }
+
+      auto const input_count = static_cast<int32_t>(inputs.size());
+      auto const output_count = static_cast<int32_t>(outputs.size());
+      if(auto const code = k.run(k.user_data, values.data(), input_count, values.data() + input_count, output_count); code != 0)
+      {
+        throw std::runtime_error("plugin kernel failed with code " + std::to_string(code));
+      }
+      for(int32_t i{}; i < output_count; ++i)
+      {
+        from_plugin(values[input_count + i], outputs[i]);
+      }
+    };
+  }
+}
+
+plugin_host::plugin_host() = default;
+
+plugin_host::~plugin_host()
+{
+  for(auto &&p : plugins)
+  {
+    if(p->handle)
+    {
+      close_library(p->handle);
+    }
+  }
+}
+
+std::vector<std::string> plugin_host::discover(std::filesystem::path const &directory)
+{
+  std::vector<std::filesystem::path> manifests;
+  std::error_code error;
+  for(auto &&entry : std::filesystem::directory_iterator(directory, error))
+  {
+    if(entry.is_regular_file() && is_manifest(entry.path()))
+    {
+      manifests.push_back(entry.path());
+    }
+  }
+  if(error)
+  {
+    return {directory.string() + ": " + error.message()};
+  }
+  // deterministic, independent of the file system order
+  std::sort(begin(manifests), end(manifests));
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  std::unordered_set<int64_t> data_types;
+  for(auto &&t : types.data_types)
+  {
+    data_types.insert(t.guid.guid);
+  }
+
+  std::vector<std::string> problems;
+  for(auto &&manifest : manifests)
+  {
+    auto p = std::make_unique<plugin>();
+    p->manifest = manifest;
+    p->handle = nullptr;
+    try
+    {
+      std::ifstream fs(manifest);
+      picojson::value v;
+      fs >> v;
+      if(auto err = picojson::get_last_error(); !err.empty())
+      {
+        throw std::runtime_error(err);
+      }
+      auto o = v.get<picojson::object>();
+      p->library = manifest.parent_path() / o["library"].get<std::string>();
+      p->types = load_type_registry(o["type_registry"]);
+    }
+    catch(std::runtime_error &e)
+    {
+      problems.push_back(manifest.string() + ": " + e.what());
+      continue;
+    }
+
+    auto duplicate = std::find_if(begin(p->types.node_types), end(p->types.node_types), [&](auto &&t) { return node_plugins.count(t.guid.guid) > 0; });
+    if(duplicate != end(p->types.node_types))
+    {
+      problems.push_back(manifest.string() + ": node type " + std::to_string(duplicate->guid.guid) + " is provided by another plugin");
+      continue;
+    }
+
+    for(auto &&t : p->types.node_types)
+    {
+      node_plugins.emplace(t.guid.guid, p.get());
+      types.node_types.push_back(t);
+    }
+    // data types may be shared between plugins
+    for(auto &&t : p->types.data_types)
+    {
+      if(data_types.insert(t.guid.guid).second)
+      {
+        types.data_types.push_back(t);
+      }
+    }
+    plugins.push_back(std::move(p));
+  }
+  return problems;
+}
+
+type_registry const &plugin_host::get_types() const
+{
+  return types;
+}
+
+void plugin_host::add_types(type_registry &registry) const
+{
+  std::unordered_set<int64_t> data_types;
+  for(auto &&t : registry.data_types)
+  {
+    data_types.insert(t.guid.guid);
+  }
+  std::unordered_set<int64_t> node_types;
+  for(auto &&t : registry.node_types)
+  {
+    node_types.insert(t.guid.guid);
+  }
+
+  for(auto &&t : types.data_types)
+  {
+    if(!data_types.count(t.guid.guid))
+    {
+      registry.data_types.push_back(t);
+    }
+  }
+  for(auto &&t : types.node_types)
+  {
+    if(!node_types.count(t.guid.guid))
+    {
+      registry.node_types.push_back(t);
+    }
+  }
+}
+
+bool plugin_host::is_provided(node_type_id id) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return node_plugins.count(id.guid) > 0;
+}
+
+bool plugin_host::is_loaded(node_type_id id) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = node_plugins.find(id.guid);
+  return (it != end(node_plugins)) && it->second->handle;
+}
+
+void plugin_host::load(node_type_id id)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = node_plugins.find(id.guid);
+  if(it == end(node_plugins))
+  {
+    throw std::runtime_error("no plugin provides node type " + std::to_string(id.guid));
+  }
+  if(!it->second->handle)
+  {
+    load(*it->second);
+  }
+}
+
+size_t plugin_host::get_plugin_count() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return plugins.size();
+}
+
+size_t plugin_host::get_loaded_count() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return std::count_if(begin(plugins), end(plugins), [](auto &&p) { return p->handle != nullptr; });
+}
+
+void plugin_host::add_kernels(kernel_registry &kernels) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  for(auto &&p : plugins)
+  {
+    for(auto &&k : p->kernels)
+    {
+      kernels.add(k.type, wrap(k), k.is_pure);
+    }
+  }
+}
+
+void plugin_host::load(plugin &p)
+{
+  auto const fail = [&](std::string const &reason)
+  {
+    throw std::runtime_error(p.library.string() + ": " + reason);
+  };
+
+  auto handle = open_library(p.library);
+  if(!handle)
+  {
+    fail(last_library_error());
+  }
+
+  try
+  {
+    auto version = reinterpret_cast<skadi_plugin_version_function>(find_symbol(handle, SKADI_PLUGIN_VERSION_SYMBOL));
+    auto register_types = reinterpret_cast<skadi_plugin_register_function>(find_symbol(handle, SKADI_PLUGIN_REGISTER_SYMBOL));
+    if(!version || !register_types)
+    {
+      fail("not a skadi plugin");
+    }
+    if(version() != SKADI_PLUGIN_API_VERSION)
+    {
+      fail("built for plugin API version " + std::to_string(version()) + " instead of " + std::to_string(SKADI_PLUGIN_API_VERSION));
+    }
+
+    registration registered;
+    skadi_registrar registrar{&registered, &add_data_type, &add_node_type, &add_kernel};
+    if(register_types(&registrar) != 0)
+    {
+      fail("registering the types failed");
+    }
+
+    // the manifest is what the rest of skadi has seen, so the library has to match it
+    for(auto &&t : p.types.node_types)
+    {
+      auto it = std::find_if(begin(registered.types.node_types), end(registered.types.node_types), [&](auto &&r) { return r.guid.guid == t.guid.guid; });
+      if(it == end(registered.types.node_types))
+      {
+        fail("node type " + t.name + " is in the manifest but not registered");
+      }
+      if((it->inputs.size() != t.inputs.size()) || (it->outputs.size() != t.outputs.size()))
+      {
+        fail("the ports of node type " + t.name + " differ from the manifest");
+      }
+    }
+    for(auto &&k : registered.kernels)
+    {
+      auto const is_listed = std::any_of(begin(p.types.node_types), end(p.types.node_types), [&](auto &&t) { return t.guid.guid == k.type.guid; });
+      if(!is_listed)
+      {
+        fail("kernel for node type " + std::to_string(k.type.guid) + ", which is not in the manifest");
+      }
+      if(!k.run)
+      {
+        fail("null kernel for node type " + std::to_string(k.type.guid));
+      }
+    }
+
+    p.registered = std::move(registered.types);
+    p.kernels = std::move(registered.kernels);
+  }
+  catch(...)
+  {
+    close_library(handle);
+    throw;
+  }
+
+  p.handle = handle;
+}
+
+} // namespace skadi
@@ -0,0 +1,259 @@
+#include "reactor.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+namespace skadi
+{
+
+#if defined(__linux__)
+
+namespace constants
+{
+  static int const max_events = 64;
+}
+
+namespace
+{
+  std::runtime_error make_error(std::string const &what)
+  {
+    return std::runtime_error("reactor: " + what + " failed: " + std::strerror(errno));
+  }
+}
+
+reactor::reactor()
+  : poll_fd(epoll_create1(EPOLL_CLOEXEC))
+  , stop_fd(-1)
+{
+  if(poll_fd < 0)
+  {
+    throw make_error("epoll_create1");
+  }
+
+  stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.fd = stop_fd;
+  if((stop_fd < 0) || (epoll_ctl(poll_fd, EPOLL_CTL_ADD, stop_fd, &event) != 0))
+  {
+    auto const error = make_error("eventfd");
+    if(stop_fd >= 0)
+    {
+      close(stop_fd);
+    }
+    close(poll_fd);
+    throw error;
+  }
+
+  thread = std::thread([this] { serve(); });
+}
+
+reactor::~reactor()
+{
+  uint64_t const one{1};
+  while((write(stop_fd, &one, sizeof(one)) < 0) && (errno == EINTR))
+  {
+  }
+  thread.join();
+
+  for(auto &&[fd, w] : watches)
+  {
+    if(w.is_timer)
+    {
+      close(fd);
+    }
+  }
+  close(stop_fd);
+  close(poll_fd);
+}
+
+void reactor::when_readable(int fd, std::function<void()> callback)
+{
+  watch(fd, EPOLLIN, {std::move(callback), false});
+}
+
+void reactor::when_writable(int fd, std::function<void()> callback)
+{
+  watch(fd, EPOLLOUT, {std::move(callback), false});
+}
+
+void reactor::after(std::chrono::nanoseconds delay, std::function<void()> callback)
+{
+  auto const fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  if(fd < 0)
+  {
+    throw make_error("timerfd_create");
+  }
+
+  // a zero expiration would disarm the timer
+  auto const count = std::max(delay.count(), std::chrono::nanoseconds::rep{1});
+  itimerspec timer{};
+  timer.it_value.tv_sec = static_cast<time_t>(count / 1000000000);
+  timer.it_value.tv_nsec = static_cast<long>(count % 1000000000);
+  if(timerfd_settime(fd, 0, &timer, nullptr) != 0)
+  {
+    auto const error = make_error("timerfd_settime");
+    close(fd);
+    throw error;
+  }
+
+  try
+  {
+    watch(fd, EPOLLIN, {std::move(callback), true});
+  }
+  catch(...)
+  {
+    close(fd);
+    throw;
+  }
+}
+
+size_t reactor::get_waiting_count() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return watches.size();
+}
+
+void reactor::watch(int fd, uint32_t events, watch_record w)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if(error)
+  {
+    std::rethrow_exception(error);
+  }
+  auto [it, is_new] = watches.emplace(fd, std::move(w));
+  if(!is_new)
+  {
+    throw std::runtime_error("reactor: file descriptor " + std::to_string(fd) + " is waited for already");
+  }
+
+  // one shot, so the callback is called once; descriptors waited for before are only
+  // disabled, not removed, and are enabled again
+  epoll_event event{};
+  event.events = events | EPOLLONESHOT;
+  event.data.fd = fd;
+  if((epoll_ctl(poll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+     && ((errno != EEXIST) || (epoll_ctl(poll_fd, EPOLL_CTL_MOD, fd, &event) != 0)))
+  {
+    auto const error = make_error("epoll_ctl");
+    watches.erase(it);
+    throw error;
+  }
+}
+
+void reactor::serve()
+{
+  epoll_event events[constants::max_events];
+  std::vector<std::function<void()>> ready;
+  for(;;)
+  {
+    auto const count = epoll_wait(poll_fd, events, constants::max_events, -1);
+    if(count < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+      // nothing could catch an exception on this thread; the waiting callbacks are called
+      // so nobody waits forever, and later waits throw the error
+      fail(std::make_exception_ptr(make_error("epoll_wait")));
+      return;
+    }
+
+    ready.clear();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for(int i{}; i < count; ++i)
+      {
+        auto const fd = events[i].data.fd;
+        if(fd == stop_fd)
+        {
+          return;
+        }
+        auto it = watches.find(fd);
+        if(it == end(watches))
+        {
+          continue;
+        }
+        if(it->second.is_timer)
+        {
+          close(fd);
+        }
+        ready.push_back(std::move(it->second.callback));
+        watches.erase(it);
+      }
+    }
+
+    // outside of the lock, so callbacks may wait again
+    for(auto &&callback : ready)
+    {
+      callback();
+    }
+  }
+}
+
+void reactor::fail(std::exception_ptr failure)
+{
+  std::vector<std::function<void()>> waiting;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    error = failure;
+    for(auto &&[fd, w] : watches)
+    {
+      if(w.is_timer)
+      {
+        close(fd);
+      }
+      waiting.push_back(std::move(w.callback));
+    }
+    watches.clear();
+  }
+
+  for(auto &&callback : waiting)
+  {
+    callback();
+  }
+}
+
+#else
+
+reactor::reactor()
+  : poll_fd(-1)
+  , stop_fd(-1)
+{
+  throw std::runtime_error("reactor: needs epoll, which is not available on this platform");
+}
+
+reactor::~reactor() = default;
+
+void reactor::when_readable(int, std::function<void()>)
+{
+}
+
+void reactor::when_writable(int, std::function<void()>)
+{
+}
+
+void reactor::after(std::chrono::nanoseconds, std::function<void()>)
+{
+}
+
+size_t reactor::get_waiting_count() const
+{
+  return 0;
+}
+
+#endif
+
+} // namespace skadi
@@ -0,0 +1,90 @@
+#include "registry_diff.h"
+
+#include <algorithm>
+#include <tuple>
+#include <unordered_map>
+
+namespace skadi
+{
+
+namespace
+{
+  bool operator==(data_type const &lhs, data_type const &rhs)
+  {
+    return (lhs.guid.guid == rhs.guid.guid) && (lhs.name == rhs.name);
+  }
+
+  template<typename T>
+  bool same_ports(std::vector<T> const &lhs, std::vector<T> const &rhs)
+  {
+    return std::equal(begin(lhs), end(lhs), begin(rhs), end(rhs), [](T const &l, T const &r)
+    {
+      return (l.type.guid == r.type.guid) && (l.name == r.name);
+    });
+  }
+
+  bool operator==(node_type const &lhs, node_type const &rhs)
+  {
+    return (lhs.guid.guid == rhs.guid.guid)
+      && std::tie(lhs.name, lhs.category) == std::tie(rhs.name, rhs.category)
+      && same_ports(lhs.inputs, rhs.inputs)
+      && same_ports(lhs.outputs, rhs.outputs);
+  }
+
+  template<typename T, typename Id>
+  void diff_types(std::vector<T> const &from, std::vector<T> const &to,
+                  std::vector<T> &added, std::vector<T> &changed, std::vector<Id> &removed)
+  {
+    std::unordered_map<int64_t, T const *> old_types;
+    for(auto &&type : from)
+    {
+      old_types.emplace(type.guid.guid, &type);
+    }
+
+    for(auto &&type : to)
+    {
+      auto it = old_types.find(type.guid.guid);
+      if(it == end(old_types))
+      {
+        added.push_back(type);
+        continue;
+      }
+      if(!(*it->second == type))
+      {
+        changed.push_back(type);
+      }
+      old_types.erase(it);
+    }
+
+    // keep the order of the old registry
+    for(auto &&type : from)
+    {
+      if(old_types.count(type.guid.guid))
+      {
+        removed.push_back(type.guid);
+      }
+    }
+  }
+}
+
+bool registry_diff::empty() const
+{
+  return added_data_types.empty() && changed_data_types.empty() && removed_data_types.empty()
+    && added_node_types.empty() && changed_node_types.empty() && removed_node_types.empty()
+    && !are_conversions_changed;
+}
+
+registry_diff diff_registries(type_registry const &from, type_registry const &to)
+{
+  registry_diff result{};
+  diff_types(from.data_types, to.data_types, result.added_data_types, result.changed_data_types, result.removed_data_types);
+  diff_types(from.node_types, to.node_types, result.added_node_types, result.changed_node_types, result.removed_node_types);
+  result.are_conversions_changed = !std::equal(begin(from.conversions), end(from.conversions), begin(to.conversions), end(to.conversions),
+    [](conversion const &l, conversion const &r)
+  {
+    return (l.from.guid == r.from.guid) && (l.to.guid == r.to.guid);
+  });
+  return result;
+}
+
+} // namespace skadi
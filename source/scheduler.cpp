@@ -0,0 +1,393 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace skadi
+{
+
+namespace constants
+{
+  static int const spin_limit = 64; // failed steal rounds before yielding
+  // idle workers sleep at most this long while steps are going on asynchronously, as work
+  // pushed by other workers does not wake them
+  static std::chrono::microseconds const resume_poll(200);
+}
+
+// Chase-Lev style queue: the owner pushes at the bottom, everybody takes from the top.
+// Owners take their oldest step too, since plans are laid out breadth first and running
+// them in that order touches memory sequentially; newest first was several times slower
+// on wide graphs. A run pushes every step once, so one slot per step never wraps.
+struct alignas(64) scheduler::work_queue
+{
+  std::unique_ptr<std::atomic<int>[]> items;
+  size_t capacity{};
+  alignas(64) std::atomic<int> top{};
+  alignas(64) std::atomic<int> bottom{};
+
+  void reset(size_t size)
+  {
+    if(capacity < size)
+    {
+      items.reset(new std::atomic<int>[size]);
+      capacity = size;
+    }
+    top.store(0, std::memory_order_relaxed);
+    bottom.store(0, std::memory_order_relaxed);
+  }
+
+  // owner only
+  void push(int item)
+  {
+    auto const b = bottom.load(std::memory_order_relaxed);
+    items[b].store(item, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_release);
+  }
+
+  // -1 if empty or lost to another thread
+  int take()
+  {
+    auto t = top.load(std::memory_order_acquire);
+    auto const b = bottom.load(std::memory_order_acquire);
+    if(t >= b)
+    {
+      return -1;
+    }
+
+    auto const item = items[t].load(std::memory_order_relaxed);
+    if(!top.compare_exchange_strong(t, t + 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+    {
+      return -1;
+    }
+    return item;
+  }
+};
+
+scheduler::scheduler(int thread_count)
+  : thread_count((thread_count > 0) ? thread_count : std::max(1, static_cast<int>(std::thread::hardware_concurrency())))
+  , capacity()
+  , plan()
+  , start_step()
+  , remaining()
+  , outstanding()
+  , is_aborted()
+  , generation()
+  , active_workers()
+  , is_stopping()
+  , resumed_count()
+{
+  for(int i{}; i < this->thread_count; ++i)
+  {
+    queues.push_back(std::make_unique<work_queue>());
+  }
+  for(int i = 1; i < this->thread_count; ++i)
+  {
+    threads.emplace_back(&scheduler::serve, this, i);
+  }
+}
+
+scheduler::~scheduler()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    is_stopping = true;
+  }
+  wakeup.notify_all();
+  for(auto &&thread : threads)
+  {
+    thread.join();
+  }
+}
+
+int scheduler::get_thread_count() const
+{
+  return thread_count;
+}
+
+void scheduler::run(execution_plan const &plan, std::vector<int> const &steps, std::function<void(int)> const &run_step)
+{
+  run_async(plan, steps, [&](int step)
+  {
+    run_step(step);
+    return true;
+  });
+}
+
+void scheduler::run_async(execution_plan const &plan, std::vector<int> const &steps, std::function<bool(int)> const &start_step)
+{
+  auto const step_count = steps.size();
+  if(step_count == 0)
+  {
+    return;
+  }
+
+  if(capacity < plan.steps.size())
+  {
+    pending.reset(new std::atomic<int>[plan.steps.size()]);
+    capacity = plan.steps.size();
+  }
+  for(auto &&queue : queues)
+  {
+    queue->reset(step_count);
+  }
+
+  // only inputs from the given steps are waited for, the others are there already
+  if(step_count == plan.steps.size())
+  {
+    for(auto &&i : steps)
+    {
+      pending[i].store(plan.steps[i].connected_input_count, std::memory_order_relaxed);
+    }
+  }
+  else
+  {
+    for(auto &&i : steps)
+    {
+      pending[i].store(0, std::memory_order_relaxed);
+    }
+    for(auto &&i : steps)
+    {
+      for(auto &&port : plan.steps[i].consumers)
+      {
+        for(auto &&ref : port)
+        {
+          pending[ref.node].fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    }
+  }
+
+  // steps which are not waiting for anything are ready right away and spread over all workers
+  int next_queue{};
+  for(auto &&i : steps)
+  {
+    if(pending[i].load(std::memory_order_relaxed) == 0)
+    {
+      queues[next_queue]->push(i);
+      next_queue = (next_queue + 1) % thread_count;
+    }
+  }
+
+  this->plan = &plan;
+  this->start_step = &start_step;
+  remaining.store(static_cast<int>(step_count), std::memory_order_relaxed);
+  outstanding.store(0, std::memory_order_relaxed);
+  is_aborted.store(false, std::memory_order_relaxed);
+  error = nullptr;
+  resumed.clear();
+  resumed_count.store(0, std::memory_order_relaxed);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++generation;
+    active_workers = thread_count - 1;
+  }
+  wakeup.notify_all();
+
+  work(0);
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    // the outputs of steps going on are written until they complete, even after a failure
+    done.wait(lock, [&] { return (active_workers == 0) && (outstanding.load(std::memory_order_acquire) == 0); });
+  }
+
+  this->plan = nullptr;
+  this->start_step = nullptr;
+  if(error)
+  {
+    std::rethrow_exception(error);
+  }
+}
+
+void scheduler::work(int worker)
+{
+  auto &&own = *queues[worker];
+  uint32_t random = 2654435761u * static_cast<uint32_t>(worker + 1);
+  int idle_rounds{};
+  // steps done since remaining was last updated, which is shared by all workers
+  int done_steps{};
+  while(!is_aborted.load(std::memory_order_relaxed))
+  {
+    auto step = own.take();
+    if((step < 0) && (resumed_count.load(std::memory_order_acquire) > 0))
+    {
+      step = take_resumed();
+    }
+    if(step < 0)
+    {
+      // consumers are pushed before their producer counts as done, so remaining never
+      // drops to zero while there is still something to run
+      if(done_steps > 0)
+      {
+        remaining.fetch_sub(done_steps, std::memory_order_release);
+        done_steps = 0;
+      }
+      if(remaining.load(std::memory_order_acquire) == 0)
+      {
+        break;
+      }
+      step = steal(worker, random);
+    }
+    if(step < 0)
+    {
+      if((++idle_rounds > constants::spin_limit) && (outstanding.load(std::memory_order_relaxed) > 0))
+      {
+        // probably waiting for I/O, so the core is left to others until a step completes
+        std::unique_lock<std::mutex> lock(resumed_mutex);
+        resumed_ready.wait_for(lock, constants::resume_poll, [&]
+        {
+          return (resumed_count.load(std::memory_order_relaxed) > 0) || is_aborted.load(std::memory_order_relaxed);
+        });
+      }
+      else if(idle_rounds > constants::spin_limit)
+      {
+        std::this_thread::yield();
+      }
+      continue;
+    }
+
+    idle_rounds = 0;
+    if(execute(worker, step))
+    {
+      ++done_steps;
+    }
+  }
+}
+
+bool scheduler::execute(int worker, int step)
+{
+  try
+  {
+    if(!(*start_step)(step))
+    {
+      // counted once it completes, which may have happened already; run does not return
+      // before this worker is done, so outstanding is back at zero by then
+      outstanding.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+  catch(...)
+  {
+    fail(std::current_exception());
+    return false;
+  }
+
+  auto &&own = *queues[worker];
+  for(auto &&port : plan->steps[step].consumers)
+  {
+    for(auto &&ref : port)
+    {
+      // nobody else delivers to a consumer with a single input
+      if((plan->steps[ref.node].connected_input_count == 1) || (pending[ref.node].fetch_sub(1, std::memory_order_acq_rel) == 1))
+      {
+        own.push(ref.node);
+      }
+    }
+  }
+  return true;
+}
+
+void scheduler::complete(int step, std::exception_ptr step_error)
+{
+  if(step_error)
+  {
+    fail(step_error);
+  }
+  else
+  {
+    std::lock_guard<std::mutex> lock(resumed_mutex);
+    for(auto &&port : plan->steps[step].consumers)
+    {
+      for(auto &&ref : port)
+      {
+        if((plan->steps[ref.node].connected_input_count == 1) || (pending[ref.node].fetch_sub(1, std::memory_order_acq_rel) == 1))
+        {
+          resumed.push_back(ref.node);
+          resumed_count.fetch_add(1, std::memory_order_release);
+        }
+      }
+    }
+  }
+  // consumers first, so remaining does not drop to zero while they are still to run
+  remaining.fetch_sub(1, std::memory_order_release);
+  resumed_ready.notify_all();
+
+  // notified under the lock, as run may return and the scheduler be gone right after
+  std::lock_guard<std::mutex> lock(mutex);
+  outstanding.fetch_sub(1, std::memory_order_release);
+  done.notify_all();
+}
+
+void scheduler::fail(std::exception_ptr step_error)
+{
+  std::lock_guard<std::mutex> lock(error_mutex);
+  if(!error)
+  {
+    error = step_error;
+  }
+  is_aborted.store(true, std::memory_order_relaxed);
+}
+
+int scheduler::take_resumed()
+{
+  std::lock_guard<std::mutex> lock(resumed_mutex);
+  if(resumed.empty())
+  {
+    return -1;
+  }
+  auto const step = resumed.back();
+  resumed.pop_back();
+  resumed_count.fetch_sub(1, std::memory_order_relaxed);
+  return step;
+}
+
+int scheduler::steal(int worker, uint32_t &random)
+{
+  // xorshift, to spread the thieves over the victims
+  random ^= random << 13;
+  random ^= random >> 17;
+  random ^= random << 5;
+
+  auto const start = static_cast<int>(random % static_cast<uint32_t>(thread_count));
+  for(int i{}; i < thread_count; ++i)
+  {
+    auto const victim = (start + i) % thread_count;
+    if(victim == worker)
+    {
+      continue;
+    }
+    if(auto step = queues[victim]->take(); step >= 0)
+    {
+      return step;
+    }
+  }
+  return -1;
+}
+
+void scheduler::serve(int worker)
+{
+  uint64_t seen{};
+  for(;;)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeup.wait(lock, [&] { return is_stopping || (generation != seen); });
+      if(is_stopping)
+      {
+        return;
+      }
+      seen = generation;
+    }
+
+    work(worker);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      --active_workers;
+    }
+    done.notify_one();
+  }
+}
+
+} // namespace skadi
@@ -0,0 +1,179 @@
+#include "stream_engine.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace skadi
+{
+
+namespace
+{
+  std::string describe(node_instance_id id)
+  {
+    return "node " + std::to_string(id.id);
+  }
+
+  template<typename T>
+  size_t get_capacity(column const &c)
+  {
+    auto rows = std::get_if<std::vector<T>>(&c.data);
+    return rows ? rows->capacity() * sizeof(T) : 0;
+  }
+}
+
+stream_engine::stream_engine(type_registry registry, kernel_registry kernels, size_t batch_size)
+  : registry(std::move(registry))
+  , kernels(std::move(kernels))
+  , batch_size(std::max(batch_size, size_t{1}))
+  , plan()
+  , lane_plan()
+  , row_count()
+  , next_batch()
+  , is_aborted()
+{
+}
+
+void stream_engine::load(graph const &g)
+{
+  auto new_plan = compile(g, registry);
+  std::vector<batch_kernel const *> new_kernels;
+  for(auto &&step : new_plan.steps)
+  {
+    auto run = kernels.find_batch(step.type);
+    if(!run)
+    {
+      auto type = std::find_if(begin(registry.node_types), end(registry.node_types), [&](auto &&t) { return t.guid.guid == step.type.guid; });
+      throw std::runtime_error(describe(step.id) + ": no batch kernel for node_type " + type->name);
+    }
+    new_kernels.push_back(run);
+  }
+
+  plan = std::move(new_plan);
+  batch_kernels = std::move(new_kernels);
+  lanes.clear();
+}
+
+void stream_engine::run(int64_t count)
+{
+  add_lanes(1);
+  for(int64_t first{}; first < count; first += static_cast<int64_t>(batch_size))
+  {
+    run_batch(lanes[0], {first, static_cast<size_t>(std::min<int64_t>(batch_size, count - first))});
+  }
+}
+
+void stream_engine::run(int64_t count, scheduler &pool, int lane_count)
+{
+  auto const batch_count = (count + static_cast<int64_t>(batch_size) - 1) / static_cast<int64_t>(batch_size);
+  lane_count = (lane_count > 0) ? lane_count : pool.get_thread_count();
+  lane_count = static_cast<int>(std::min<int64_t>(lane_count, batch_count));
+  if(lane_count <= 0)
+  {
+    return;
+  }
+  add_lanes(lane_count);
+
+  // every lane takes the next batch until there are none left, so lanes balance themselves
+  lane_plan.steps.resize(lane_count);
+  std::vector<int> steps(lane_count);
+  for(int i{}; i < lane_count; ++i)
+  {
+    steps[i] = i;
+  }
+  row_count = count;
+  next_batch = 0;
+  is_aborted = false;
+  pool.run(lane_plan, steps, [this](int i) { run_lane(i); });
+}
+
+size_t stream_engine::get_batch_size() const
+{
+  return batch_size;
+}
+
+size_t stream_engine::get_buffer_memory() const
+{
+  size_t memory{};
+  for(auto &&l : lanes)
+  {
+    for(auto &&c : l.outputs)
+    {
+      memory += get_capacity<int64_t>(c) + get_capacity<double>(c);
+    }
+  }
+  return memory;
+}
+
+void stream_engine::add_lanes(int count)
+{
+  while(static_cast<int>(lanes.size()) < count)
+  {
+    lanes.emplace_back();
+    auto &&l = lanes.back();
+    l.outputs.resize(plan.output_count);
+    l.inputs.assign(plan.input_count, nullptr);
+    for(auto &&step : plan.steps)
+    {
+      for(size_t port{}; port < step.consumers.size(); ++port)
+      {
+        for(auto &&ref : step.consumers[port])
+        {
+          l.inputs[ref.input] = &l.outputs[step.first_output + port];
+        }
+      }
+    }
+  }
+}
+
+void stream_engine::run_batch(lane &l, batch_range range)
+{
+  for(size_t i{}; i < plan.steps.size(); ++i)
+  {
+    auto &&step = plan.steps[i];
+    port_range<column> results{l.outputs.data() + step.first_output, step.output_types.size()};
+    try
+    {
+      (*batch_kernels[i])(range, {l.inputs.data() + step.first_input, static_cast<size_t>(step.input_count)}, results);
+    }
+    catch(std::exception &e)
+    {
+      throw std::runtime_error(describe(step.id) + ": " + e.what());
+    }
+
+    for(size_t port{}; port < results.size(); ++port)
+    {
+      if(get_row_count(results[port]) != range.row_count)
+      {
+        throw std::runtime_error(describe(step.id) + ": " + std::to_string(get_row_count(results[port])) + " rows instead of "
+                                 + std::to_string(range.row_count));
+      }
+      results[port].type = step.output_types[port];
+    }
+  }
+}
+
+void stream_engine::run_lane(int index)
+{
+  auto const size = static_cast<int64_t>(batch_size);
+  while(!is_aborted.load(std::memory_order_relaxed))
+  {
+    auto const first = next_batch.fetch_add(1, std::memory_order_relaxed) * size;
+    if(first >= row_count)
+    {
+      return;
+    }
+    try
+    {
+      run_batch(lanes[index], {first, static_cast<size_t>(std::min(size, row_count - first))});
+    }
+    catch(...)
+    {
+      is_aborted = true;
+      throw;
+    }
+  }
+}
+
+} // namespace skadi
@@ -0,0 +1,308 @@
+#include "topological_order.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace skadi
+{
+
+namespace constants
+{
+  // positions of removed nodes are reused once there are more of them than of nodes
+  static size_t const min_compacted_holes = 1024;
+}
+
+namespace
+{
+  // edges may be there more than once, only one of them is removed
+  void erase_one(std::vector<int> &slots, int slot)
+  {
+    auto it = std::find(begin(slots), end(slots), slot);
+    if(it != end(slots))
+    {
+      *it = slots.back();
+      slots.pop_back();
+    }
+  }
+}
+
+topological_order::topological_order()
+  : hole_count()
+  , epoch()
+  , visited_count()
+{
+}
+
+void topological_order::add_node(int64_t id)
+{
+  int slot{};
+  if(free_slots.empty())
+  {
+    slot = static_cast<int>(nodes.size());
+    nodes.emplace_back();
+    marks.push_back(0);
+    parents.push_back(-1);
+  }
+  else
+  {
+    slot = free_slots.back();
+    free_slots.pop_back();
+  }
+
+  if(!slots.emplace(id, slot).second)
+  {
+    free_slots.push_back(slot);
+    throw std::runtime_error("topological_order: node " + std::to_string(id) + " exists already");
+  }
+
+  // new nodes have no edges, so the end is as good as any position
+  nodes[slot] = {id, order.size(), {}, {}};
+  order.push_back(slot);
+}
+
+void topological_order::remove_node(int64_t id)
+{
+  auto const slot = get_slot(id);
+  if(slot < 0)
+  {
+    return;
+  }
+
+  auto &&n = nodes[slot];
+  for(auto &&successor : n.successors)
+  {
+    erase_one(nodes[successor].predecessors, slot);
+  }
+  for(auto &&predecessor : n.predecessors)
+  {
+    erase_one(nodes[predecessor].successors, slot);
+  }
+  n.successors.clear();
+  n.predecessors.clear();
+
+  order[n.position] = -1;
+  ++hole_count;
+  slots.erase(id);
+  free_slots.push_back(slot);
+
+  if((hole_count >= constants::min_compacted_holes) && (2 * hole_count > order.size()))
+  {
+    compact();
+  }
+}
+
+bool topological_order::has_node(int64_t id) const
+{
+  return get_slot(id) >= 0;
+}
+
+bool topological_order::add_edge(int64_t source, int64_t destination, std::vector<int64_t> *path)
+{
+  auto const x = get_slot(source);
+  auto const y = get_slot(destination);
+  if((x < 0) || (y < 0))
+  {
+    throw std::runtime_error("topological_order: unknown node " + std::to_string((x < 0) ? source : destination));
+  }
+
+  if(closes_cycle(source, destination, path))
+  {
+    return false;
+  }
+
+  auto const lower = nodes[y].position;
+  auto const upper = nodes[x].position;
+  if(lower < upper)
+  {
+    // closes_cycle found what follows the destination before the source already; the
+    // source and what precedes it after the destination go in front of these, in the
+    // positions of both sets
+    forward.swap(visited);
+    search(x, lower, -1, false);
+    visited_count = forward.size() + visited.size();
+
+    auto const by_position = [this](int lhs, int rhs) { return nodes[lhs].position < nodes[rhs].position; };
+    std::sort(begin(visited), end(visited), by_position);
+    std::sort(begin(forward), end(forward), by_position);
+
+    positions.clear();
+    for(auto &&slot : visited)
+    {
+      positions.push_back(nodes[slot].position);
+    }
+    for(auto &&slot : forward)
+    {
+      positions.push_back(nodes[slot].position);
+    }
+    std::sort(begin(positions), end(positions));
+
+    auto position = begin(positions);
+    for(auto &&moved : {&visited, &forward})
+    {
+      for(auto &&slot : *moved)
+      {
+        nodes[slot].position = *position;
+        order[*position] = slot;
+        ++position;
+      }
+    }
+  }
+
+  nodes[x].successors.push_back(y);
+  nodes[y].predecessors.push_back(x);
+  return true;
+}
+
+void topological_order::remove_edge(int64_t source, int64_t destination)
+{
+  auto const x = get_slot(source);
+  auto const y = get_slot(destination);
+  if((x < 0) || (y < 0))
+  {
+    return;
+  }
+
+  // the order stays valid without the edge
+  erase_one(nodes[x].successors, y);
+  erase_one(nodes[y].predecessors, x);
+}
+
+bool topological_order::closes_cycle(int64_t source, int64_t destination, std::vector<int64_t> *path) const
+{
+  auto const x = get_slot(source);
+  auto const y = get_slot(destination);
+  if((x < 0) || (y < 0))
+  {
+    throw std::runtime_error("topological_order: unknown node " + std::to_string((x < 0) ? source : destination));
+  }
+
+  visited.clear();
+  visited_count = 0;
+  if(x == y)
+  {
+    if(path)
+    {
+      *path = {source};
+    }
+    return true;
+  }
+
+  // a path back to the source can only go through nodes between both in the order
+  if(nodes[y].position > nodes[x].position)
+  {
+    return false;
+  }
+  if(!search(y, nodes[x].position, x, true))
+  {
+    visited_count = visited.size();
+    return false;
+  }
+
+  visited_count = visited.size();
+  if(path)
+  {
+    get_path(y, x, *path);
+  }
+  return true;
+}
+
+bool topological_order::precedes(int64_t lhs, int64_t rhs) const
+{
+  auto const l = get_slot(lhs);
+  auto const r = get_slot(rhs);
+  if((l < 0) || (r < 0))
+  {
+    throw std::runtime_error("topological_order: unknown node " + std::to_string((l < 0) ? lhs : rhs));
+  }
+  return nodes[l].position < nodes[r].position;
+}
+
+size_t topological_order::get_node_count() const
+{
+  return slots.size();
+}
+
+size_t topological_order::get_visited_count() const
+{
+  return visited_count;
+}
+
+int topological_order::get_slot(int64_t id) const
+{
+  auto it = slots.find(id);
+  return (it != end(slots)) ? it->second : -1;
+}
+
+bool topological_order::search(int first, size_t bound, int target, bool is_forward) const
+{
+  next_epoch();
+  visited.clear();
+  pending.clear();
+
+  marks[first] = epoch;
+  parents[first] = -1;
+  pending.push_back(first);
+  while(!pending.empty())
+  {
+    auto const current = pending.back();
+    pending.pop_back();
+    visited.push_back(current);
+
+    auto &&neighbours = is_forward ? nodes[current].successors : nodes[current].predecessors;
+    for(auto &&next : neighbours)
+    {
+      if(next == target)
+      {
+        parents[next] = current;
+        return true;
+      }
+      auto const position = nodes[next].position;
+      bool const is_between = is_forward ? (position < bound) : (position > bound);
+      if(is_between && (marks[next] != epoch))
+      {
+        marks[next] = epoch;
+        parents[next] = current;
+        pending.push_back(next);
+      }
+    }
+  }
+  return false;
+}
+
+void topological_order::get_path(int first, int target, std::vector<int64_t> &path) const
+{
+  path.clear();
+  for(auto slot = target; slot != first; slot = parents[slot])
+  {
+    path.push_back(nodes[slot].id);
+  }
+  path.push_back(nodes[first].id);
+  std::reverse(begin(path), end(path));
+}
+
+void topological_order::next_epoch() const
+{
+  if(++epoch == 0)
+  {
+    std::fill(begin(marks), end(marks), 0);
+    epoch = 1;
+  }
+}
+
+void topological_order::compact()
+{
+  size_t position{};
+  for(auto &&slot : order)
+  {
+    if(slot >= 0)
+    {
+      nodes[slot].position = position;
+      order[position++] = slot;
+    }
+  }
+  order.resize(position);
+  hole_count = 0;
+}
+
+} // namespace skadi
@@ -0,0 +1,183 @@
+#include "type_system.h"
+
+#include <deque>
+#include <optional>
+
+namespace skadi
+{
+
+namespace constants
+{
+  static std::string const wildcard_name = "any";
+}
+
+type_system::type_system(type_registry const &registry)
+  : type_count()
+{
+  std::vector<std::string> names;
+  for(auto &&type : registry.data_types)
+  {
+    if(!indices.emplace(type.guid.guid, static_cast<int>(indices.size())).second)
+    {
+      registry_errors.push_back("duplicate data type " + std::to_string(type.guid.guid));
+      continue;
+    }
+    names.push_back(type.name);
+  }
+  type_count = indices.size();
+  matrix.assign(type_count * type_count, 0);
+
+  std::vector<std::vector<int>> conversions(type_count);
+  for(auto &&c : registry.conversions)
+  {
+    auto const from = get_index(c.from);
+    auto const to = get_index(c.to);
+    if((from < 0) || (to < 0))
+    {
+      registry_errors.push_back("conversion between unknown data types " + std::to_string(c.from.guid) + " and " + std::to_string(c.to.guid));
+      continue;
+    }
+    conversions[from].push_back(to);
+  }
+
+  // everything reachable over conversions, a search per type is cheaper than the cubic
+  // closure for the few conversions there usually are
+  std::deque<int> pending;
+  for(size_t from{}; from < type_count; ++from)
+  {
+    auto row = matrix.data() + from * type_count;
+    row[from] = 1;
+    pending.push_back(static_cast<int>(from));
+    while(!pending.empty())
+    {
+      auto const current = pending.front();
+      pending.pop_front();
+      for(auto &&to : conversions[current])
+      {
+        if(!row[to])
+        {
+          row[to] = 1;
+          pending.push_back(to);
+        }
+      }
+    }
+  }
+
+  for(size_t wildcard{}; wildcard < type_count; ++wildcard)
+  {
+    if(names[wildcard] != constants::wildcard_name)
+    {
+      continue;
+    }
+    for(size_t other{}; other < type_count; ++other)
+    {
+      matrix[wildcard * type_count + other] = 1;
+      matrix[other * type_count + wildcard] = 1;
+    }
+  }
+
+  for(auto &&type : registry.node_types)
+  {
+    auto &&ports = node_types[type.guid.guid];
+    auto const add_ports = [&](auto &&type_ports, auto &&indices_by_name, std::string const &kind)
+    {
+      for(auto &&port : type_ports)
+      {
+        auto const index = get_index(port.type);
+        if(index < 0)
+        {
+          registry_errors.push_back(kind + " " + port.name + " of " + type.name + " has the unknown data type " + std::to_string(port.type.guid));
+        }
+        indices_by_name.emplace(port.name, index);
+      }
+    };
+    add_ports(type.inputs, ports.inputs, "input");
+    add_ports(type.outputs, ports.outputs, "output");
+  }
+}
+
+bool type_system::is_known(data_type_id type) const
+{
+  return get_index(type) >= 0;
+}
+
+bool type_system::is_compatible(data_type_id from, data_type_id to) const
+{
+  return is_index_compatible(get_index(from), get_index(to));
+}
+
+std::vector<std::string> const &type_system::get_registry_errors() const
+{
+  return registry_errors;
+}
+
+std::vector<type_error> type_system::check(graph const &g) const
+{
+  std::unordered_map<int64_t, port_types const *> node_ports;
+  node_ports.reserve(g.nodes.size());
+  for(auto &&n : g.nodes)
+  {
+    auto it = node_types.find(n.type.guid);
+    node_ports.emplace(n.uid.id, (it != end(node_types)) ? &it->second : nullptr);
+  }
+
+  std::vector<type_error> result;
+  for(auto &&c : g.connections)
+  {
+    // index of the data type of a port, or the reason there is none
+    auto const find_port = [&](node_instance_id node, std::string const &name, bool is_input) -> std::optional<int>
+    {
+      auto const describe = [&] { return std::string(is_input ? "input " : "output ") + name + " of node " + std::to_string(node.id); };
+      auto it = node_ports.find(node.id);
+      if(it == end(node_ports))
+      {
+        result.push_back({c.uid, "unknown node " + std::to_string(node.id)});
+        return{};
+      }
+      if(!it->second)
+      {
+        result.push_back({c.uid, "unknown node type of node " + std::to_string(node.id)});
+        return{};
+      }
+      auto &&ports = is_input ? it->second->inputs : it->second->outputs;
+      auto port = ports.find(name);
+      if(port == end(ports))
+      {
+        result.push_back({c.uid, "unknown " + describe()});
+        return{};
+      }
+      if(port->second < 0)
+      {
+        result.push_back({c.uid, describe() + " has an unknown data type"});
+        return{};
+      }
+      return port->second;
+    };
+
+    auto const from = find_port(c.source, c.signal, false);
+    auto const to = find_port(c.destination, c.slot, true);
+    if(from && to && !is_index_compatible(*from, *to))
+    {
+      result.push_back({c.uid, "output " + c.signal + " of node " + std::to_string(c.source.id)
+        + " is not accepted by input " + c.slot + " of node " + std::to_string(c.destination.id)});
+    }
+  }
+  return result;
+}
+
+int type_system::get_index(data_type_id type) const
+{
+  auto it = indices.find(type.guid);
+  return (it != end(indices)) ? it->second : -1;
+}
+
+bool type_system::is_index_compatible(int from, int to) const
+{
+  if((from < 0) || (to < 0))
+  {
+    return false;
+  }
+  return matrix[static_cast<size_t>(from) * type_count + static_cast<size_t>(to)] != 0;
+}
+
+} // namespace skadi
@@ -1,16 +1,16 @@
 #include "ui_connection.h"
 #include "ui_node.h"
+#include "ui_profiler.h"
+#include "ui_scene.h"
 
-#include <numeric>
+#include <algorithm>
 #include <stdexcept>
 
-#include "QtGui/QCursor"
 #include "QtGui/QKeyEvent"
 #include "QtGui/QPainter"
 #include "QtWidgets/QGraphicsScene"
 #include "QtWidgets/QGraphicsSceneHoverEvent"
 #include "QtWidgets/QGraphicsSceneMouseEvent"
-#include "QtWidgets/QGraphicsView"
 #include "QtWidgets/QStyleOptionGraphicsItem"
 
 namespace skadi
@@ -27,7 +27,10 @@ namespace constants
   static qreal const line_width_default = 3;
   static qreal const line_width_hilight = 6;
   static QColor const incomplete_color(100, 100, 100);
+  static QColor const type_error_color(220, 40, 40);
+  static QColor const cycle_color(255, 60, 60);
   static int const shape_stroker_width = 15;
+  static qreal const snap_radius = 40;
 }
 
 
@@ -39,18 +42,20 @@ ui_connection::ui_connection(ui_node *source, int source_port,
   , destination_port(destination_port)
   , is_hovered()
   , was_dragged()
+  , is_dirty()
 {
   if(!source)
   {
     throw std::invalid_argument("ui_connection: source cannot be null");
   }
 
+  loose_end = source->get_output_position(source_port);
   update_positions();
 
-  connect(source, &ui_node::positionChanged, this, &ui_connection::update_positions);
+  connect(source, &ui_node::positionChanged, this, &ui_connection::invalidate_positions);
   if(destination)
   {
-    connect(destination, &ui_node::positionChanged, this, &ui_connection::update_positions);
+    connect(destination, &ui_node::positionChanged, this, &ui_connection::invalidate_positions);
   }
 
   setFlag(QGraphicsItem::ItemIsMovable, true);
@@ -71,6 +76,12 @@ ui_connection::~ui_connection()
   }
 }
 
+void ui_connection::set_source_port(int new_source_port)
+{
+  source_port = new_source_port;
+  invalidate_positions();
+}
+
 void ui_connection::set_destination(ui_node *new_destination, int new_destination_port)
 {
   auto old_destination = destination;
@@ -82,11 +93,11 @@ void ui_connection::set_destination(ui_node *new_destination, int new_destinatio
   {
     if(destination)
     {
-      connect(destination, &ui_node::positionChanged, this, &ui_connection::update_positions);
+      connect(destination, &ui_node::positionChanged, this, &ui_connection::invalidate_positions);
     }
     if(old_destination)
     {
-      disconnect(old_destination, &ui_node::positionChanged, this, &ui_connection::update_positions);
+      disconnect(old_destination, &ui_node::positionChanged, this, &ui_connection::invalidate_positions);
       old_destination->update();
     }
   }
@@ -102,54 +113,101 @@ std::pair<ui_node *, int> ui_connection::get_destination() const
   return{destination, destination_port};
 }
 
+void ui_connection::invalidate_positions()
+{
+  // coalesce updates: a multi-node drag moves both endpoints of an edge, so the scene
+  // recomputes the geometry of all dirty connections once before the next frame
+  auto parent = dynamic_cast<ui_scene *>(scene());
+  if(nullptr == parent)
+  {
+    update_positions();
+  }
+  else if(!is_dirty)
+  {
+    is_dirty = true;
+    parent->invalidate_connection(this);
+  }
+}
+
 void ui_connection::update_positions()
 {
+  is_dirty = false;
+  ui_profiler::instance().increment(ui_profiler::counter::position_updates);
+
   if(!scene())
   {
     return;
   }
 
-  auto scene_to_connection = sceneTransform().inverted();
-  auto views = scene()->views();
-  if(views.empty())
+  auto scene_source = source->get_output_position(source_port);
+  auto scene_destination = (nullptr == destination)
+    ? loose_end
+    : destination->get_input_position(destination_port);
+
+  // complete connections are routed around nodes in the background, see set_route
+  auto parent = dynamic_cast<ui_scene *>(scene());
+  if(parent && destination)
   {
-    return;
+    parent->route_connection(this,
+                             scene_source + QPointF{constants::insertion_width, 0},
+                             scene_destination - QPointF{constants::insertion_width, 0});
   }
-  auto view = views.front();
 
-  auto source_position = scene_to_connection.map(source->get_output_position(source_port));
-  auto destination_position = scene_to_connection.map((nullptr == destination)
-    ? view->mapToScene(view->mapFromGlobal(QCursor::pos()))
-    : destination->get_input_position(destination_port)
-    );
+  auto scene_to_connection = sceneTransform().inverted();
+  source_anchor = scene_to_connection.map(scene_source);
+  destination_anchor = scene_to_connection.map(scene_destination);
+  build_path();
+}
 
-  auto source_position_offset = source_position + QPointF{constants::insertion_width, 0};
-  auto destination_position_offset = destination_position - QPointF{constants::insertion_width, 0};
+void ui_connection::set_route(QPolygonF const &scene_route)
+{
+  route = sceneTransform().inverted().map(scene_route);
+  build_path();
+}
 
-  auto diff = destination_position_offset - source_position_offset;
-  auto mid = source_position_offset + 0.5 * diff;
+void ui_connection::build_path()
+{
+  auto source_position_offset = source_anchor + QPointF{constants::insertion_width, 0};
+  auto destination_position_offset = destination_anchor - QPointF{constants::insertion_width, 0};
 
-  path = QPainterPath{source_position};
-  path.lineTo(source_position_offset);
-  if(abs(diff.x()) > abs(diff.y()))
+  path = QPainterPath{source_anchor};
+
+  // routes which were computed for other endpoints are outdated, e.g. while dragging
+  bool const is_routed = destination && (route.size() >= 2)
+    && (route.front() == source_position_offset) && (route.back() == destination_position_offset);
+  if(is_routed)
   {
-    path.lineTo({mid.x(), source_position_offset.y()});
-    path.lineTo({mid.x(), destination_position_offset.y()});
+    for(auto &&p : route)
+    {
+      path.lineTo(p);
+    }
   }
   else
   {
-    path.lineTo({source_position_offset.x(), mid.y()});
-    path.lineTo({destination_position_offset.x(), mid.y()});
+    auto diff = destination_position_offset - source_position_offset;
+    auto mid = source_position_offset + 0.5 * diff;
+
+    path.lineTo(source_position_offset);
+    if(abs(diff.x()) > abs(diff.y()))
+    {
+      path.lineTo({mid.x(), source_position_offset.y()});
+      path.lineTo({mid.x(), destination_position_offset.y()});
+    }
+    else
+    {
+      path.lineTo({source_position_offset.x(), mid.y()});
+      path.lineTo({destination_position_offset.x(), mid.y()});
+    }
+    path.lineTo(destination_position_offset);
   }
-  path.lineTo(destination_position_offset);
-  path.lineTo(destination_position);
+  path.lineTo(destination_anchor);
 
   prepareGeometryChange();
 }
 
 int ui_connection::type() const
 {
-  return (UserType + 2);
+  return Type;
 }
 
 QRectF ui_connection::boundingRect() const
@@ -166,6 +224,9 @@ QPainterPath ui_connection::shape() const
 
 void ui_connection::paint(QPainter *painter, QStyleOptionGraphicsItem const *option, QWidget *)
 {
+  ui_profiler::scoped_timer timer(ui_profiler::timer::connection_paint);
+  ui_profiler::instance().increment(ui_profiler::counter::items_painted);
+
   if(path.isEmpty())
   {
     return;
@@ -177,7 +238,12 @@ void ui_connection::paint(QPainter *painter, QStyleOptionGraphicsItem const *opt
 
   bool is_complete = (destination != nullptr);
 
+  auto parent = dynamic_cast<ui_scene *>(scene());
   auto color = source->get_output_color(source_port);
+  if(parent && parent->is_invalid(this))
+  {
+    color = constants::type_error_color;
+  }
   if(isSelected())
   {
     color = color.darker(constants::selected_color_factor);
@@ -192,11 +258,12 @@ void ui_connection::paint(QPainter *painter, QStyleOptionGraphicsItem const *opt
   if(is_complete)
   {
     // draw hilighting if needed
-    if(isSelected() || is_hovered)
+    bool const is_on_cycle = parent && parent->is_on_rejected_cycle(this);
+    if(isSelected() || is_hovered || is_on_cycle)
     {
       auto p = pen;
       p.setWidthF(constants::line_width_hilight);
-      p.setColor(isSelected() ? constants::selected_color : constants::hover_color);
+      p.setColor(is_on_cycle ? constants::cycle_color : isSelected() ? constants::selected_color : constants::hover_color);
       painter->setPen(p);
       painter->setBrush(Qt::NoBrush);
       painter->drawPath(path);
@@ -259,6 +326,11 @@ void ui_connection::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
 {
   QGraphicsItem::mouseMoveEvent(event);
 
+  auto parent = dynamic_cast<ui_scene *>(scene());
+  if(!was_dragged && parent)
+  {
+    parent->begin_drag(source, source_port);
+  }
   update_destination(event);
   was_dragged = true;
 
@@ -272,10 +344,18 @@ void ui_connection::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
   if(was_dragged)
   {
     update_destination(event);
+    if(auto parent = dynamic_cast<ui_scene *>(scene()))
+    {
+      parent->end_drag();
+    }
     if(nullptr == destination)
     {
       deleteLater();
     }
+    else if(auto parent = dynamic_cast<ui_scene *>(scene()))
+    {
+      parent->commit_connection(this);
+    }
   }
   was_dragged = false;
   ungrabMouse();
@@ -286,18 +366,42 @@ void ui_connection::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
 void ui_connection::update_destination(QGraphicsSceneMouseEvent *event)
 {
   auto pos = event->scenePos();
+  loose_end = pos;
+
+  // snap to the nearest input accepting the output close by, otherwise fall back to the node
+  // under the cursor
+  auto parent = dynamic_cast<ui_scene *>(scene());
+  std::pair<ui_node *, int> input{nullptr, -1};
+  if(parent)
+  {
+    input = parent->find_input(pos, constants::snap_radius, source, source_port);
+  }
 
-  auto node = find_node(pos);
-  auto port = 0;
-  if(node != nullptr)
+  auto &&[node, port] = input;
+  if(node == nullptr)
   {
-    port = node->get_input_index(pos);
-    if(port == -1) // destination doesn't have inputs, so we can't connect to it
+    node = find_node(pos);
+    if(node != nullptr)
     {
-      node = nullptr;
+      port = node->get_input_index(pos);
+      if(port == -1) // destination doesn't have inputs, so we can't connect to it
+      {
+        node = nullptr;
+      }
+      else if(parent && !parent->can_connect(source, source_port, node, port))
+      {
+        // the drop is rejected, the connection stays loose and is deleted on release
+        node = nullptr;
+      }
     }
   }
-  set_destination(node, port);
+  // destinations which would close a cycle are refused while dragging, the scene highlights
+  // it; connections set otherwise, e.g. loaded ones, are kept so they can be fixed
+  if(node && parent && !parent->check_cycle(source, node))
+  {
+    node = nullptr;
+  }
+  set_destination(node, std::max(port, 0));
 
   update_positions();
   event->accept();
@@ -305,17 +409,17 @@ void ui_connection::update_destination(QGraphicsSceneMouseEvent *event)
 
 ui_node *ui_connection::find_node(QPointF pos) const
 {
-  auto items = scene()->items(pos, Qt::IntersectsItemShape, Qt::DescendingOrder);
-  return std::accumulate(std::begin(items), std::end(items), static_cast<ui_node *>(nullptr),
-                         [&](ui_node *lhs, QGraphicsItem *rhs)
+  // bounding rects are good enough for nodes and much cheaper than exact shapes
+  ui_profiler::instance().increment(ui_profiler::counter::spatial_queries);
+  for(auto &&item : scene()->items(pos, Qt::IntersectsItemBoundingRect, Qt::DescendingOrder))
   {
-    auto node = dynamic_cast<ui_node *>(rhs);
-    if(node == source)
+    auto node = qgraphicsitem_cast<ui_node *>(item);
+    if((node != nullptr) && (node != source))
     {
-      node = nullptr;
+      return node;
     }
-    return ((lhs != nullptr) ? lhs : node);
-  });
+  }
+  return nullptr;
 }
 
 } // namespace skadi
@@ -0,0 +1,292 @@
+#include "ui_evaluator.h"
+#include "output_cache.h"
+#include "plugin_host.h"
+#include "ui_scene.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "QtCore/QElapsedTimer"
+
+namespace skadi
+{
+
+namespace constants
+{
+  static int const evaluation_delay = 100; // ms
+}
+
+ui_evaluator::ui_evaluator(ui_scene *scene, type_registry registry, kernel_registry kernels, QObject *parent)
+  : QObject(parent)
+  , scene(scene)
+  , plugins()
+  , is_reset(true)
+  , is_run_pending()
+  , is_publish_scheduled()
+  , is_stopping()
+  , registry(std::move(registry))
+  , kernels(std::move(kernels))
+  , engine_plugins()
+  , cache()
+  , plugin_count()
+{
+  make_engine();
+
+  debounce.setSingleShot(true);
+  debounce.setInterval(constants::evaluation_delay);
+  connect(&debounce, &QTimer::timeout, this, &ui_evaluator::start);
+
+  // the content is only read again after a reset, other edits are handed to the engine
+  connect(scene, &ui_scene::content_reset, this, [this]
+  {
+    is_reset = true;
+    schedule();
+  });
+  connect(scene, &ui_scene::node_added, this, [this](node n)
+  {
+    // the engine is made again with the kernels of the plugin, from all of the content
+    if(is_plugin_outdated(n.type))
+    {
+      is_reset = true;
+      schedule();
+    }
+    else
+    {
+      add_edit([n](engine &e) { e.add_node(n); });
+    }
+  });
+  connect(scene, &ui_scene::node_removed, this, [this](node_instance_id id)
+  {
+    add_edit([id](engine &e) { e.remove_node(id); });
+  });
+  connect(scene, &ui_scene::connection_added, this, [this](connection c)
+  {
+    add_edit([c](engine &e) { e.connect(c); });
+  });
+  connect(scene, &ui_scene::connection_removed, this, [this](connection_instance_id id)
+  {
+    add_edit([id](engine &e) { e.disconnect(id); });
+  });
+
+  worker = std::thread(&ui_evaluator::run, this);
+  schedule();
+}
+
+ui_evaluator::~ui_evaluator()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    is_stopping = true;
+  }
+  wakeup.notify_one();
+  worker.join();
+}
+
+void ui_evaluator::reset(type_registry new_registry, kernel_registry new_kernels)
+{
+  {
+    // along with the content, so the new engine never runs without it
+    std::lock_guard<std::mutex> lock(mutex);
+    pending_registry = std::move(new_registry);
+    pending_kernels = std::move(new_kernels);
+    take_content();
+  }
+  schedule();
+}
+
+void ui_evaluator::set_cache(output_cache *new_cache)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending_cache = new_cache;
+  }
+  schedule();
+}
+
+void ui_evaluator::set_plugins(plugin_host *new_plugins)
+{
+  plugins = new_plugins;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending_plugins = new_plugins;
+  }
+  is_reset = true;
+  schedule();
+}
+
+void ui_evaluator::start()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(is_reset)
+    {
+      take_content();
+    }
+    else
+    {
+      std::move(begin(edits), end(edits), std::back_inserter(pending_edits));
+      edits.clear();
+    }
+    is_run_pending = true;
+  }
+  wakeup.notify_one();
+}
+
+void ui_evaluator::publish()
+{
+  QString summary;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    summary.swap(finished_summary);
+    is_publish_scheduled = false;
+  }
+  emit evaluated(summary);
+}
+
+void ui_evaluator::schedule()
+{
+  debounce.start();
+}
+
+void ui_evaluator::add_edit(edit e)
+{
+  // the content read at the reset has it already
+  if(!is_reset)
+  {
+    edits.push_back(std::move(e));
+  }
+  schedule();
+}
+
+void ui_evaluator::take_content()
+{
+  pending_content = scene->get_content();
+  pending_edits.clear();
+  edits.clear();
+  is_reset = false;
+}
+
+bool ui_evaluator::is_plugin_outdated(node_type_id type) const
+{
+  return plugins && plugins->is_provided(type)
+         && (!plugins->is_loaded(type) || (plugins->get_loaded_count() != plugin_count));
+}
+
+void ui_evaluator::run()
+{
+  for(;;)
+  {
+    std::optional<type_registry> next_registry;
+    std::optional<kernel_registry> next_kernels;
+    std::optional<plugin_host *> next_plugins;
+    std::optional<output_cache *> next_cache;
+    std::optional<graph> content;
+    std::vector<edit> next_edits;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeup.wait(lock, [&] { return is_stopping || is_run_pending; });
+      if(is_stopping)
+      {
+        return;
+      }
+      next_registry.swap(pending_registry);
+      next_kernels.swap(pending_kernels);
+      next_plugins.swap(pending_plugins);
+      next_cache.swap(pending_cache);
+      content.swap(pending_content);
+      next_edits.swap(pending_edits);
+      is_run_pending = false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QString summary;
+    try
+    {
+      auto is_engine_outdated = false;
+      if(next_registry)
+      {
+        registry = std::move(*next_registry);
+        kernels = std::move(*next_kernels);
+        is_engine_outdated = true;
+      }
+      if(next_plugins)
+      {
+        engine_plugins = *next_plugins;
+      }
+      if(next_cache)
+      {
+        cache = *next_cache;
+      }
+
+      if(content)
+      {
+        if(engine_plugins)
+        {
+          for(auto &&n : content->nodes)
+          {
+            if(engine_plugins->is_provided(n.type))
+            {
+              engine_plugins->load(n.type);
+            }
+          }
+          is_engine_outdated = is_engine_outdated || (engine_plugins->get_loaded_count() != plugin_count);
+        }
+        if(is_engine_outdated)
+        {
+          make_engine();
+        }
+        graph_engine->load(*content);
+      }
+      if(next_cache)
+      {
+        graph_engine->set_cache(cache);
+      }
+      for(auto &&e : next_edits)
+      {
+        e(*graph_engine);
+      }
+
+      graph_engine->run(pool);
+      summary = QString("evaluated %1 nodes in %2 ms").arg(graph_engine->get_run_count()).arg(timer.elapsed());
+      if(cache)
+      {
+        auto const statistics = cache->get_statistics();
+        summary += QString(", cache: %1 hits, %2 misses").arg(statistics.hits).arg(statistics.misses);
+      }
+    }
+    catch(std::exception &e)
+    {
+      // nothing could catch it on the worker
+      summary = QString("evaluation failed: %1").arg(e.what());
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if(is_run_pending)
+    {
+      // outdated by edits meanwhile, the next run publishes
+      continue;
+    }
+    finished_summary = std::move(summary);
+    if(!is_publish_scheduled)
+    {
+      is_publish_scheduled = true;
+      QMetaObject::invokeMethod(this, "publish", Qt::QueuedConnection);
+    }
+  }
+}
+
+void ui_evaluator::make_engine()
+{
+  auto all_kernels = kernels;
+  plugin_count = 0;
+  if(engine_plugins)
+  {
+    engine_plugins->add_kernels(all_kernels);
+    plugin_count = engine_plugins->get_loaded_count();
+  }
+  graph_engine = std::make_unique<engine>(registry, std::move(all_kernels));
+  graph_engine->set_cache(cache);
+}
+
+} // namespace skadi
@@ -1,89 +1,77 @@
 #include "ui_library.h"
 
 #include <algorithm>
-#include <cassert>
+#include <map>
+#include <numeric>
 #include <optional>
-#include <memory>
+#include <string_view>
+#include <unordered_set>
 
 #include "QtCore/QMimeData"
 
 namespace skadi
 {
 
-struct ui_library_model::node_item
+namespace
 {
-  node_type_id guid;
-  std::string name;
-
-  bool operator<(node_item const &rhs) const
+  // the segment of a category at a depth, none if the category is not that deep
+  std::optional<std::string_view> category_segment(std::string const &category, size_t depth)
   {
-    return name < rhs.name;
+    std::string_view rest(category);
+    if(rest.empty())
+    {
+      return{};
+    }
+    for(; depth > 0; --depth)
+    {
+      auto const separator = rest.find('/');
+      if(separator == std::string_view::npos)
+      {
+        return{};
+      }
+      rest.remove_prefix(separator + 1);
+    }
+    return rest.substr(0, rest.find('/'));
   }
-};
 
-struct ui_library_model::category_item
-{
-  std::string name;
+  void insert_sorted(std::vector<int> &entries, int entry)
+  {
+    entries.insert(std::lower_bound(begin(entries), end(entries), entry), entry);
+  }
 
-  bool operator<(category_item const &rhs) const
+  void erase_sorted(std::vector<int> &entries, int entry)
   {
-    return name < rhs.name;
+    if(auto it = std::lower_bound(begin(entries), end(entries), entry); it != end(entries) && *it == entry)
+    {
+      entries.erase(it);
+    }
   }
-};
+}
 
-struct ui_library_model::index_data
+struct ui_library_model::item
 {
+  std::string name;
+  item *parent;
   int row;
-  int row_count;
-  int parent_row;
+  size_t depth; // of the category segments of the children
+  bool is_category;
+  bool is_fetched;
+  std::vector<int> entries;
+  std::vector<std::unique_ptr<item>> children;
 };
 
-ui_library_model::ui_library_model(type_registry const &registry)
+ui_library_model::ui_library_model(std::shared_ptr<type_registry const> registry)
+  : registry(std::move(registry))
+  , root(new item{{}, nullptr, 0, 0, true, false, {}, {}})
 {
-  std::vector<std::pair<category_item, node_item>> data;
-  for(auto &&node_type : registry.node_types)
-  {
-    data.emplace_back(category_item{node_type.category}, node_item{node_type.guid, node_type.name});
-  }
-
-  std::sort(begin(data), end(data));
-
-  std::optional<std::string> category;
-  int category_index{};
-  int node_index{};
-  int category_node_index = -1;
-  for(auto &&[category_item, node_item] : data)
-  {
-    if(category_item.name != category)
-    {
-      if(category_node_index >= 0)
-      {
-        index_map[category_node_index].row_count = node_index;
-      }
-      category_node_index = static_cast<int>(model.size());
-      node_index = {};
-
-      category = category_item.name;
-      index_reverse_map.emplace_back(static_cast<int>(model.size()));
-      index_map.push_back({category_index++, 0, -1});
-      model.emplace_back(std::move(category_item));
-    }
-
-    model.emplace_back(std::move(node_item));
-    index_map.push_back({node_index++, 0, category_node_index});
-  }
-
-  if(category_node_index >= 0)
-  {
-    index_map[category_node_index].row_count = node_index;
-  }
 }
 
 ui_library_model::~ui_library_model() = default;
 
 QVariant ui_library_model::data(QModelIndex const &index, int role) const
 {
-  if(!is_valid_index(index))
+  auto const i = get_item(index);
+  if(!i || i == root.get())
   {
     return{};
   }
@@ -91,7 +79,7 @@ QVariant ui_library_model::data(QModelIndex const &index, int role) const
   switch(role)
   {
   case Qt::DisplayRole:
-    return visit([](auto &&v) { return v.name; }, model[index.internalId()]).data();
+    return QString::fromStdString(i->name);
 
   default:
     return{};
@@ -100,77 +88,190 @@ QVariant ui_library_model::data(QModelIndex const &index, int role) const
 
 Qt::ItemFlags ui_library_model::flags(QModelIndex const &index) const
 {
-  if(is_valid_index(index))
+  auto const i = get_item(index);
+  if(!i || i == root.get())
   {
-    if(model[index.internalId()].index() == 0) // category
-    {
-      return Qt::ItemIsEnabled;
-    }
-    else // node
-    {
-      return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsDragEnabled;
-    }
+    return{};
+  }
+  else if(i->is_category)
+  {
+    return Qt::ItemIsEnabled;
   }
   else
   {
-    return{};
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsDragEnabled;
   }
 }
 
 QModelIndex ui_library_model::index(int row, int, QModelIndex const &parent) const
 {
-  if(row < 0)
+  auto const i = get_item(parent);
+  if(!i || row < 0 || row >= static_cast<int>(i->children.size()))
   {
-    // nothing to be done
+    return{};
   }
-  else if(!is_valid_index(parent))
+  return createIndex(row, 0, i->children[row].get());
+}
+
+QModelIndex ui_library_model::parent(QModelIndex const &index) const
+{
+  auto const i = get_item(index);
+  if(!i || !i->parent || i->parent == root.get())
   {
-    if(row < index_reverse_map.size())
-    {
-      return createIndex(row, 0, index_reverse_map[row]);
-    }
+    return{};
   }
-  else if(auto parent_row = parent.internalId(); row < index_map[parent_row].row_count)
+  return createIndex(i->parent->row, 0, i->parent);
+}
+
+int ui_library_model::rowCount(QModelIndex const &index) const
+{
+  auto const i = get_item(index);
+  return i ? static_cast<int>(i->children.size()) : 0;
+}
+
+int ui_library_model::columnCount(QModelIndex const &) const
+{
+  return 1;
+}
+
+bool ui_library_model::hasChildren(QModelIndex const &index) const
+{
+  // categories are never empty, whether they were fetched or not
+  auto const i = get_item(index);
+  return i && i->is_category;
+}
+
+bool ui_library_model::canFetchMore(QModelIndex const &index) const
+{
+  auto const i = get_item(index);
+  return i && i->is_category && !i->is_fetched;
+}
+
+void ui_library_model::fetchMore(QModelIndex const &index)
+{
+  if(auto i = get_item(index); i && i->is_category && !i->is_fetched)
   {
-    assert(row == index_map[parent_row + 1 + row].row);
-    return createIndex(row, 0, parent_row + row + 1);
+    fetch(i);
   }
-  return{};
 }
 
-QModelIndex ui_library_model::parent(QModelIndex const &index) const
+std::shared_ptr<type_registry const> ui_library_model::get_registry() const
 {
-  if(!is_valid_index(index))
+  return registry;
+}
+
+void ui_library_model::update_registry(std::shared_ptr<type_registry const> new_registry, registry_diff const &diff)
+{
+  std::unordered_map<int64_t, int> old_entries;
+  for(int i{}; i < static_cast<int>(registry->node_types.size()); ++i)
   {
-    return{};
+    old_entries.emplace(registry->node_types[i].guid.guid, i);
   }
 
-  auto const row = index_map[index.internalId()].parent_row;
-  if(row >= 0)
+  // a new name or category moves a node type, which is done by removing and adding it
+  std::vector<int64_t> removed;
+  std::vector<int64_t> added;
+  for(auto &&id : diff.removed_node_types)
   {
-    return createIndex(index_map[row].row, 0, row);
+    removed.push_back(id.guid);
   }
-  else
+  for(auto &&type : diff.added_node_types)
   {
-    return{};
+    added.push_back(type.guid.guid);
+  }
+  for(auto &&type : diff.changed_node_types)
+  {
+    auto &&old_type = registry->node_types[old_entries.at(type.guid.guid)];
+    if(old_type.name != type.name || old_type.category != type.category)
+    {
+      removed.push_back(type.guid.guid);
+      added.push_back(type.guid.guid);
+    }
   }
-}
 
-int ui_library_model::rowCount(QModelIndex const &index) const
-{
-  if(!is_valid_index(index))
+  for(auto guid : removed)
   {
-    return static_cast<int>(index_reverse_map.size());
+    remove_entry(old_entries.at(guid));
   }
-  else
+
+  // the remaining entries are renumbered to the positions in the new registry
+  std::unordered_set<int64_t> const moved(begin(removed), end(removed));
+  std::vector<int> remap(registry->node_types.size(), -1);
+  for(int i{}; i < static_cast<int>(new_registry->node_types.size()); ++i)
+  {
+    auto const guid = new_registry->node_types[i].guid.guid;
+    if(auto it = old_entries.find(guid); it != end(old_entries) && !moved.count(guid))
+    {
+      remap[it->second] = i;
+    }
+  }
+
+  std::vector<item *> items{root.get()};
+  while(!items.empty())
+  {
+    auto i = items.back();
+    items.pop_back();
+    for(auto &&entry : i->entries)
+    {
+      entry = remap[entry];
+    }
+    std::sort(begin(i->entries), end(i->entries));
+    for(auto &&child : i->children)
+    {
+      items.push_back(child.get());
+    }
+  }
+
+  registry = std::move(new_registry);
+
+  std::unordered_map<int64_t, int> new_entries;
+  for(int i{}; i < static_cast<int>(registry->node_types.size()); ++i)
+  {
+    new_entries.emplace(registry->node_types[i].guid.guid, i);
+  }
+  for(auto guid : added)
+  {
+    insert_entry(new_entries.at(guid));
+  }
+
+  emit registry_changed();
+}
+
+std::shared_ptr<library_index const> ui_library_model::make_search_index(type_registry const &registry)
+{
+  std::vector<library_entry> entries;
+  entries.reserve(registry.node_types.size());
+  for(auto &&type : registry.node_types)
   {
-    return index_map[index.internalId()].row_count;
+    entries.push_back({type.name, type.category});
   }
+  return std::make_shared<library_index const>(std::move(entries));
 }
 
-int ui_library_model::columnCount(QModelIndex const &) const
+std::vector<int> const &ui_library_model::get_entries(QModelIndex const &index) const
 {
-  return 1;
+  static std::vector<int> const none;
+  auto const i = get_item(index);
+  return i ? i->entries : none;
+}
+
+node_type const &ui_library_model::get_node_type(int entry) const
+{
+  return registry->node_types.at(entry);
+}
+
+int ui_library_model::get_node_type_count() const
+{
+  return static_cast<int>(registry->node_types.size());
+}
+
+QMimeData *ui_library_model::make_mime_data(node_type const &type)
+{
+  auto data = std::make_unique<QMimeData>();
+  data->setText(QString::fromStdString(type.name));
+  QByteArray guid(reinterpret_cast<char const *>(&type.guid), sizeof(type.guid));
+  data->setData("application/x-skadinodetype", guid);
+  return data.release();
 }
 
 Qt::DropActions skadi::ui_library_model::supportedDragActions() const
@@ -197,25 +298,200 @@ QMimeData *skadi::ui_library_model::mimeData(QModelIndexList const &indices) con
   {
     return nullptr;
   }
-  auto &&variant = model[indices[0].internalId()];
-  if(variant.index() != 1) // not a node_item
+  auto const i = get_item(indices[0]);
+  if(!i || i->is_category)
   {
     return nullptr;
   }
-  auto &&item = std::get<1>(variant);
+  return make_mime_data(registry->node_types[i->entries.front()]);
+}
 
-  auto data = std::make_unique<QMimeData>();
-  data->setText(QString::fromStdString(item.name));
-  QByteArray guid(reinterpret_cast<char const *>(&item.guid), sizeof(item.guid));
-  data->setData("application/x-skadinodetype", guid);
-  return data.release();
+ui_library_model::item *ui_library_model::get_item(QModelIndex const &index) const
+{
+  if(!index.isValid())
+  {
+    return root.get();
+  }
+  return (index.model() == this) ? static_cast<item *>(index.internalPointer()) : nullptr;
+}
+
+QModelIndex ui_library_model::get_index(item *i) const
+{
+  return (i == root.get()) ? QModelIndex() : createIndex(i->row, 0, i);
+}
+
+void ui_library_model::fetch(item *parent)
+{
+  // the root covers the whole registry; nothing is gathered before the first fetch
+  if(parent == root.get())
+  {
+    root->entries.resize(registry->node_types.size());
+    std::iota(begin(root->entries), end(root->entries), 0);
+  }
+
+  // subcategories first, then the node types of the category itself, both sorted by name
+  std::map<std::string_view, std::vector<int>> categories;
+  std::vector<int> nodes;
+  for(auto entry : parent->entries)
+  {
+    if(auto segment = category_segment(registry->node_types[entry].category, parent->depth))
+    {
+      categories[*segment].push_back(entry);
+    }
+    else
+    {
+      nodes.push_back(entry);
+    }
+  }
+  std::stable_sort(begin(nodes), end(nodes), [&](int lhs, int rhs)
+  {
+    return registry->node_types[lhs].name < registry->node_types[rhs].name;
+  });
+
+  std::vector<std::unique_ptr<item>> children;
+  for(auto &&[name, entries] : categories)
+  {
+    auto const row = static_cast<int>(children.size());
+    children.emplace_back(new item{std::string(name), parent, row, parent->depth + 1, true, false, std::move(entries), {}});
+  }
+  for(auto entry : nodes)
+  {
+    auto const row = static_cast<int>(children.size());
+    children.emplace_back(new item{registry->node_types[entry].name, parent, row, parent->depth + 1, false, true, {entry}, {}});
+    node_items[registry->node_types[entry].guid.guid] = children.back().get();
+  }
+
+  parent->is_fetched = true;
+  if(children.empty())
+  {
+    return;
+  }
+
+  beginInsertRows(get_index(parent), 0, static_cast<int>(children.size()) - 1);
+  parent->children = std::move(children);
+  endInsertRows();
+}
+
+void ui_library_model::insert_child(item *parent, int row, std::unique_ptr<item> child)
+{
+  beginInsertRows(get_index(parent), row, row);
+  parent->children.insert(begin(parent->children) + row, std::move(child));
+  for(auto i = static_cast<size_t>(row); i < parent->children.size(); ++i)
+  {
+    parent->children[i]->row = static_cast<int>(i);
+  }
+  endInsertRows();
+}
+
+void ui_library_model::remove_child(item *parent, int row)
+{
+  beginRemoveRows(get_index(parent), row, row);
+  auto child = std::move(parent->children[row]);
+  parent->children.erase(begin(parent->children) + row);
+  for(auto i = static_cast<size_t>(row); i < parent->children.size(); ++i)
+  {
+    parent->children[i]->row = static_cast<int>(i);
+  }
+  endRemoveRows();
+
+  // the fetched node items of the whole subtree disappear with it
+  std::vector<item *> items{child.get()};
+  while(!items.empty())
+  {
+    auto i = items.back();
+    items.pop_back();
+    if(!i->is_category)
+    {
+      node_items.erase(registry->node_types[i->entries.front()].guid.guid);
+    }
+    for(auto &&c : i->children)
+    {
+      items.push_back(c.get());
+    }
+  }
+}
+
+void ui_library_model::insert_entry(int entry)
+{
+  // nothing below an unfetched category exists yet, fetching picks the entry up
+  auto &&type = registry->node_types[entry];
+  for(auto parent = root.get(); parent->is_fetched;)
+  {
+    insert_sorted(parent->entries, entry);
+
+    auto const segment = category_segment(type.category, parent->depth);
+    if(!segment)
+    {
+      // node types follow the categories, both sorted by name
+      auto it = std::find_if(begin(parent->children), end(parent->children), [&](auto &&child)
+      {
+        return !child->is_category && (type.name < child->name);
+      });
+      auto child = std::make_unique<item>(item{type.name, parent, 0, parent->depth + 1, false, true, {entry}, {}});
+      node_items[type.guid.guid] = child.get();
+      insert_child(parent, static_cast<int>(it - begin(parent->children)), std::move(child));
+      return;
+    }
+
+    auto it = std::find_if(begin(parent->children), end(parent->children), [&](auto &&child)
+    {
+      return !child->is_category || (*segment <= child->name);
+    });
+    if(it == end(parent->children) || !(*it)->is_category || (*it)->name != *segment)
+    {
+      auto child = std::make_unique<item>(item{std::string(*segment), parent, 0, parent->depth + 1, true, false, {entry}, {}});
+      insert_child(parent, static_cast<int>(it - begin(parent->children)), std::move(child));
+      return;
+    }
+
+    auto child = it->get();
+    if(!child->is_fetched)
+    {
+      insert_sorted(child->entries, entry);
+      return;
+    }
+    parent = child;
+  }
 }
 
-bool ui_library_model::is_valid_index(QModelIndex const &index) const
+void ui_library_model::remove_entry(int entry)
 {
-  auto const row = index.internalId();
-  return (index.model() == this)
-    && (row >= 0) && (row < model.size());
+  auto &&type = registry->node_types[entry];
+  for(auto parent = root.get(); parent->is_fetched;)
+  {
+    erase_sorted(parent->entries, entry);
+
+    auto const segment = category_segment(type.category, parent->depth);
+    if(!segment)
+    {
+      if(auto it = node_items.find(type.guid.guid); it != end(node_items))
+      {
+        remove_child(parent, it->second->row);
+      }
+      return;
+    }
+
+    auto it = std::find_if(begin(parent->children), end(parent->children), [&](auto &&child)
+    {
+      return child->is_category && (child->name == *segment);
+    });
+    if(it == end(parent->children))
+    {
+      return;
+    }
+
+    auto child = it->get();
+    if(!child->is_fetched || child->entries.size() == 1)
+    {
+      erase_sorted(child->entries, entry);
+      if(child->entries.empty())
+      {
+        remove_child(parent, child->row);
+      }
+      return;
+    }
+    parent = child;
+  }
 }
 
 } // namespace skadi
@@ -0,0 +1,95 @@
+#include "ui_library.h"
+#include "ui_library_matches.h"
+#include "ui_tree_filter.h"
+
+#include "QtCore/QMimeData"
+
+namespace skadi
+{
+
+namespace constants
+{
+  static size_t const best_match_count = 8;
+}
+
+ui_library_matches::ui_library_matches(ui_library_model *library, ui_tree_filter *filter, QObject *parent)
+  : QAbstractListModel(parent)
+  , library(library)
+  , filter(filter)
+{
+  connect(filter, &ui_tree_filter::query_changed, this, &ui_library_matches::update_matches);
+}
+
+QVariant ui_library_matches::data(QModelIndex const &index, int role) const
+{
+  auto const type = get_node_type(index);
+  if(!type)
+  {
+    return{};
+  }
+
+  switch(role)
+  {
+  case Qt::DisplayRole:
+    return QString::fromStdString(type->name);
+
+  case Qt::ToolTipRole:
+    return QString::fromStdString(type->category);
+
+  default:
+    return{};
+  }
+}
+
+Qt::ItemFlags ui_library_matches::flags(QModelIndex const &index) const
+{
+  if(!get_node_type(index))
+  {
+    return{};
+  }
+  return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsDragEnabled;
+}
+
+int ui_library_matches::rowCount(QModelIndex const &parent) const
+{
+  return parent.isValid() ? 0 : static_cast<int>(matches.size());
+}
+
+Qt::DropActions ui_library_matches::supportedDragActions() const
+{
+  return Qt::CopyAction;
+}
+
+QStringList ui_library_matches::mimeTypes() const
+{
+  // the drag interface of the library model is only accessible through its base
+  return static_cast<QAbstractItemModel const *>(library)->mimeTypes();
+}
+
+QMimeData *ui_library_matches::mimeData(QModelIndexList const &indices) const
+{
+  if(indices.size() != 1)
+  {
+    return nullptr;
+  }
+  auto const type = get_node_type(indices[0]);
+  return type ? ui_library_model::make_mime_data(*type) : nullptr;
+}
+
+void ui_library_matches::update_matches()
+{
+  beginResetModel();
+  matches = filter->get_best_matches(constants::best_match_count);
+  endResetModel();
+}
+
+node_type const *ui_library_matches::get_node_type(QModelIndex const &index) const
+{
+  if(!index.isValid() || index.model() != this || index.row() >= static_cast<int>(matches.size()))
+  {
+    return nullptr;
+  }
+  return &library->get_node_type(matches[index.row()]);
+}
+
+} // namespace skadi
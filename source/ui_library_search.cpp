@@ -0,0 +1,143 @@
+#include "ui_library_search.h"
+
+namespace skadi
+{
+
+namespace constants
+{
+  static int const debounce_interval = 60; // ms
+  static size_t const best_count = 32;
+}
+
+ui_library_search::ui_library_search(index_factory make_index, QObject *parent)
+  : QObject(parent)
+  , pending_index(std::move(make_index))
+  , cancel()
+  , is_publish_scheduled()
+  , is_stopping()
+{
+  debounce.setSingleShot(true);
+  debounce.setInterval(constants::debounce_interval);
+  connect(&debounce, &QTimer::timeout, this, &ui_library_search::start);
+
+  worker = std::thread(&ui_library_search::run, this);
+}
+
+ui_library_search::~ui_library_search()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    is_stopping = true;
+    cancel = true;
+  }
+  wakeup.notify_one();
+  worker.join();
+}
+
+std::string const &ui_library_search::get_query() const
+{
+  return result_query;
+}
+
+std::vector<int> const &ui_library_search::get_result() const
+{
+  return result;
+}
+
+std::vector<int> const &ui_library_search::get_best() const
+{
+  return best;
+}
+
+void ui_library_search::reset(index_factory make_index)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending_index = std::move(make_index);
+    cancel = true;
+  }
+  wakeup.notify_one();
+}
+
+void ui_library_search::set_query(QString const &new_query)
+{
+  query = new_query.toStdString();
+  debounce.start();
+}
+
+void ui_library_search::start()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending = query;
+    cancel = true;
+  }
+  wakeup.notify_one();
+}
+
+void ui_library_search::publish()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    result_query.swap(finished_query);
+    result.swap(finished_result);
+    best.swap(finished_best);
+    is_publish_scheduled = false;
+  }
+  emit result_changed();
+}
+
+void ui_library_search::run()
+{
+  std::shared_ptr<library_index const> index;
+  std::unique_ptr<library_search> search;
+  std::string searched;
+  for(;;)
+  {
+    std::optional<index_factory> make_index;
+    std::string next;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeup.wait(lock, [&] { return is_stopping || pending || pending_index; });
+      if(is_stopping)
+      {
+        return;
+      }
+      make_index.swap(pending_index);
+      next = pending ? std::move(*pending) : searched;
+      pending.reset();
+      cancel = false;
+    }
+
+    if(make_index)
+    {
+      index = (*make_index)();
+      search = std::make_unique<library_search>(*index);
+    }
+
+    // a cancelled search leaves the previous result, so the next query can still refine it
+    if(!search->update(next, cancel))
+    {
+      continue;
+    }
+    searched = next;
+    auto next_best = search->get_best(constants::best_count);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if(pending)
+    {
+      // already stale
+      continue;
+    }
+    finished_query = std::move(next);
+    finished_result = search->get_result();
+    finished_best = std::move(next_best);
+    if(!is_publish_scheduled)
+    {
+      is_publish_scheduled = true;
+      QMetaObject::invokeMethod(this, "publish", Qt::QueuedConnection);
+    }
+  }
+}
+
+} // namespace skadi
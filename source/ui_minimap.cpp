@@ -0,0 +1,157 @@
+#include "ui_minimap.h"
+#include "ui_scene.h"
+#include "ui_view.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "QtGui/QMouseEvent"
+#include "QtGui/QPainter"
+
+namespace skadi
+{
+
+namespace constants
+{
+  static QColor const minimap_background_color(64, 64, 64);
+  static QColor const minimap_node_color(192, 192, 192);
+  static QColor const minimap_connection_color(130, 130, 130);
+  static QColor const minimap_viewport_color(255, 165, 0);
+  static qreal const minimap_margin = 0.1;
+  static QSize const minimap_size_hint(240, 180);
+}
+
+ui_minimap::ui_minimap(ui_scene *scene, ui_view *view, QWidget *parent)
+  : QWidget(parent)
+  , scene(scene)
+  , view(view)
+  , visible(view->get_visible_region())
+{
+  connect(scene, &QGraphicsScene::changed, this, &ui_minimap::scene_changed);
+  connect(view, &ui_view::visible_region_changed, this, &ui_minimap::visible_region_changed);
+}
+
+ui_minimap::~ui_minimap() = default;
+
+QSize ui_minimap::sizeHint() const
+{
+  return constants::minimap_size_hint;
+}
+
+void ui_minimap::scene_changed(QList<QRectF> const &regions)
+{
+  if(!mapped_bounds.contains(scene->content_bounds()))
+  {
+    reset_mapping();
+    return;
+  }
+
+  for(auto &&r : regions)
+  {
+    dirty += scene_to_image.mapRect(r).toAlignedRect().adjusted(-1, -1, 1, 1).intersected(cache.rect());
+  }
+  update();
+}
+
+void ui_minimap::visible_region_changed(QRectF region)
+{
+  visible = region;
+  update();
+}
+
+void ui_minimap::paintEvent(QPaintEvent *)
+{
+  if(cache.size() != size())
+  {
+    reset_mapping();
+  }
+  if(!dirty.isEmpty())
+  {
+    redraw(dirty);
+    dirty = {};
+  }
+
+  QPainter painter(this);
+  painter.drawImage(0, 0, cache);
+  painter.setPen(constants::minimap_viewport_color);
+  painter.setBrush(Qt::NoBrush);
+  painter.drawRect(scene_to_image.mapRect(visible));
+}
+
+void ui_minimap::resizeEvent(QResizeEvent *event)
+{
+  QWidget::resizeEvent(event);
+  reset_mapping();
+}
+
+void ui_minimap::mousePressEvent(QMouseEvent *event)
+{
+  center_view(event->pos());
+  event->accept();
+}
+
+void ui_minimap::mouseMoveEvent(QMouseEvent *event)
+{
+  if(event->buttons() & Qt::LeftButton)
+  {
+    center_view(event->pos());
+  }
+  event->accept();
+}
+
+void ui_minimap::reset_mapping()
+{
+  auto bounds = scene->content_bounds();
+  if(bounds.isEmpty())
+  {
+    bounds = visible;
+  }
+  auto const dx = constants::minimap_margin * bounds.width();
+  auto const dy = constants::minimap_margin * bounds.height();
+  mapped_bounds = bounds.adjusted(-dx, -dy, dx, dy);
+
+  // fit the bounds into the widget, keeping the aspect ratio
+  auto const scale = std::min(width() / std::max(mapped_bounds.width(), 1.0),
+                              height() / std::max(mapped_bounds.height(), 1.0));
+  scene_to_image = QTransform::fromTranslate(-mapped_bounds.center().x(), -mapped_bounds.center().y())
+                 * QTransform::fromScale(scale, scale)
+                 * QTransform::fromTranslate(0.5 * width(), 0.5 * height());
+
+  cache = QImage(size(), QImage::Format_ARGB32_Premultiplied);
+  dirty = QRegion(cache.rect());
+  update();
+}
+
+void ui_minimap::redraw(QRegion const &region)
+{
+  if(cache.isNull())
+  {
+    return;
+  }
+
+  QPainter painter(&cache);
+  painter.setClipRegion(region);
+  painter.fillRect(region.boundingRect(), constants::minimap_background_color);
+
+  auto const area = scene_to_image.inverted().mapRect(QRectF(region.boundingRect()));
+  std::vector<QRectF> node_rects;
+  std::vector<QLineF> connection_lines;
+  scene->get_overview(area, node_rects, connection_lines);
+
+  painter.setTransform(scene_to_image);
+
+  QPen pen(constants::minimap_connection_color, 0.0);
+  painter.setPen(pen);
+  painter.drawLines(connection_lines.data(), static_cast<int>(connection_lines.size()));
+
+  painter.setPen(Qt::NoPen);
+  painter.setBrush(constants::minimap_node_color);
+  painter.drawRects(node_rects.data(), static_cast<int>(node_rects.size()));
+}
+
+void ui_minimap::center_view(QPoint pos)
+{
+  view->centerOn(scene_to_image.inverted().map(QPointF(pos)));
+}
+
+} // namespace skadi
@@ -1,5 +1,6 @@
 #include "ui_connection.h"
 #include "ui_node.h"
+#include "ui_profiler.h"
 #include "ui_scene.h"
 
 #include <numeric>
@@ -26,6 +27,8 @@ namespace constants
   static QColor const boundary_color_default(192, 192, 192);
   static QColor const boundary_color_hovered(255, 200, 30);
   static QColor const boundary_color_selected(210, 165, 0);
+  // on the cycle a dragged connection would close
+  static QColor const boundary_color_cycle(255, 60, 60);
   static qreal const boundary_radius = 3;
 
   static QColor const caption_color(255, 255, 255);
@@ -33,6 +36,11 @@ namespace constants
   static QColor const port_font_color_default(255, 255, 255);
   static QColor const port_font_color_empty(160, 160, 160);
 
+  // inputs while a connection is dragged
+  static QColor const port_color_accepting(90, 230, 90);
+  static qreal const port_radius_accepting = 7;
+  static int const port_rejecting_factor = 300;
+
   static qreal const pen_width_default = 2;
   static qreal const pen_width_hovered = 3;
 
@@ -119,11 +127,13 @@ int ui_node::get_input_index(QPointF pos) const
     return abs(p1.y() - p2.y());
   };
 
+  // compare in item coordinates, so the scene transform is only applied once
+  auto const local_pos = mapFromScene(pos);
   auto result = 0;
-  auto result_dist = dist(pos, get_input_position(0));
+  auto result_dist = dist(local_pos, get_input_offset(0));
   for(int i = 1; i < input_count; ++i)
   {
-    auto d = dist(pos, get_input_position(i));
+    auto d = dist(local_pos, get_input_offset(i));
     if(d < result_dist)
     {
       result = i;
@@ -136,18 +146,12 @@ int ui_node::get_input_index(QPointF pos) const
 
 QPointF ui_node::get_input_position(int idx) const
 {
-  auto offset = input_offset;
-  offset.rx() -= constants::text_horizontal_spacing + constants::connection_radius;
-  offset.ry() += idx * (font_metrics.height() + constants::text_vertical_spacing) - 0.25 * font_metrics.height();
-  return sceneTransform().map(offset);
+  return sceneTransform().map(get_input_offset(idx));
 }
 
 QPointF ui_node::get_output_position(int idx) const
 {
-  auto offset = output_offset;
-  offset.rx() += constants::text_horizontal_spacing + constants::connection_radius;
-  offset.ry() += idx * (font_metrics.height() + constants::text_vertical_spacing) - 0.25 * font_metrics.height();
-  return sceneTransform().map(offset);
+  return sceneTransform().map(get_output_offset(idx));
 }
 
 QColor ui_node::get_output_color(int idx) const
@@ -160,17 +164,32 @@ node_type const &ui_node::get_type_info() const
   return type_info;
 }
 
+void ui_node::set_type_info(node_type const &new_type_info)
+{
+  type_info = new_type_info;
+  is_hovered = false;
+  calculate_layout();
+  update();
+}
+
 void ui_node::keyPressEvent(QKeyEvent *event)
 {
   if(event->key() == Qt::Key_Delete)
   {
-    deleteLater();
+    if(auto scene = dynamic_cast<ui_scene *>(this->scene()))
+    {
+      scene->delete_node(this);
+    }
+    else
+    {
+      deleteLater();
+    }
   }
 }
 
 int ui_node::type() const
 {
-  return (UserType + 1);
+  return Type;
 }
 
 QRectF ui_node::boundingRect() const
@@ -188,6 +207,9 @@ QRectF ui_node::boundingRect() const
 
 void ui_node::paint(QPainter *painter, QStyleOptionGraphicsItem const *option, QWidget *)
 {
+  ui_profiler::scoped_timer timer(ui_profiler::timer::node_paint);
+  ui_profiler::instance().increment(ui_profiler::counter::items_painted);
+
   parent = dynamic_cast<ui_scene *>(scene());
   
   painter->setClipRect(option->exposedRect);
@@ -200,8 +222,9 @@ void ui_node::paint(QPainter *painter, QStyleOptionGraphicsItem const *option, Q
 
   { // draw bounds
     auto pen = painter->pen();
-    pen.setColor(isSelected() ? constants::boundary_color_selected : is_hovered ? constants::boundary_color_hovered : constants::boundary_color_default);
-    pen.setWidthF(is_hovered ? constants::pen_width_hovered : constants::pen_width_default);
+    bool const is_on_cycle = parent->is_on_rejected_cycle(this);
+    pen.setColor(is_on_cycle ? constants::boundary_color_cycle : isSelected() ? constants::boundary_color_selected : is_hovered ? constants::boundary_color_hovered : constants::boundary_color_default);
+    pen.setWidthF((is_hovered || is_on_cycle) ? constants::pen_width_hovered : constants::pen_width_default);
     painter->setPen(pen);
 
     painter->setBrush(create_gradient(bounding_rect));
@@ -238,10 +261,13 @@ void ui_node::paint(QPainter *painter, QStyleOptionGraphicsItem const *option, Q
     auto pen = painter->pen();
     pen.setWidth(constants::pen_width_default);
 
+    auto const [drag_node, drag_port] = parent->get_drag_source();
+
     int port_index{};
     for(auto &&p : type_info.inputs)
     {
-      bool is_port_connected = parent->is_input_connected(this, port_index++);
+      auto const port = port_index++;
+      bool is_port_connected = parent->is_input_connected(this, port);
 
       pen.setColor(is_port_connected ? constants::port_font_color_default : constants::port_font_color_empty);
       painter->setPen(pen);
@@ -252,10 +278,20 @@ void ui_node::paint(QPainter *painter, QStyleOptionGraphicsItem const *option, Q
       offset.ry() -= port_offset;
 
       auto color = generate_color(p.type);
+      auto radius = constants::connection_radius;
       pen.setColor(isSelected() ? constants::boundary_color_selected : constants::boundary_color_default);
+      if(drag_node && (drag_node != this) && parent->can_connect(drag_node, drag_port, this, port))
+      {
+        pen.setColor(constants::port_color_accepting);
+        radius = constants::port_radius_accepting;
+      }
+      else if(drag_node)
+      {
+        color = color.darker(constants::port_rejecting_factor);
+      }
       painter->setPen(pen);
       painter->setBrush(color);
-      painter->drawEllipse(offset, constants::connection_radius, constants::connection_radius);
+      painter->drawEllipse(offset, radius, radius);
 
       offset.rx() += constants::text_horizontal_spacing + constants::connection_radius;
       offset.ry() += port_offset + font_metrics.height() + constants::text_vertical_spacing;
@@ -333,6 +369,25 @@ void ui_node::calculate_layout()
   output_offset = {width - constants::text_horizontal_spacing, caption_height + text_height};
 
   prepareGeometryChange();
+
+  // port positions depend on the layout as well
+  emit positionChanged();
+}
+
+QPointF ui_node::get_input_offset(int idx) const
+{
+  auto offset = input_offset;
+  offset.rx() -= constants::text_horizontal_spacing + constants::connection_radius;
+  offset.ry() += idx * (font_metrics.height() + constants::text_vertical_spacing) - 0.25 * font_metrics.height();
+  return offset;
+}
+
+QPointF ui_node::get_output_offset(int idx) const
+{
+  auto offset = output_offset;
+  offset.rx() += constants::text_horizontal_spacing + constants::connection_radius;
+  offset.ry() += idx * (font_metrics.height() + constants::text_vertical_spacing) - 0.25 * font_metrics.height();
+  return offset;
 }
 
 int ui_node::get_output_index(QPointF pos) const
@@ -348,11 +403,12 @@ int ui_node::get_output_index(QPointF pos) const
     return (p1 - p2).manhattanLength();
   };
 
+  auto const local_pos = mapFromScene(pos);
   auto result = 0;
-  auto result_dist = dist(pos, get_output_position(0));
+  auto result_dist = dist(local_pos, get_output_offset(0));
   for(int i = 1; i < output_count; ++i)
   {
-    auto d = dist(pos, get_output_position(i));
+    auto d = dist(local_pos, get_output_offset(i));
     if(d < result_dist)
     {
       result = i;
@@ -0,0 +1,153 @@
+#include "ui_profiler.h"
+#include "picojson.h"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace skadi
+{
+
+namespace constants
+{
+  static size_t const profiler_history_size = 3600;
+}
+
+ui_profiler::scoped_timer::scoped_timer(timer t)
+  : t(t)
+  , is_active(ui_profiler::instance().is_enabled())
+{
+  if(is_active)
+  {
+    start = std::chrono::steady_clock::now();
+  }
+}
+
+ui_profiler::scoped_timer::~scoped_timer()
+{
+  if(is_active)
+  {
+    auto const stop = std::chrono::steady_clock::now();
+    ui_profiler::instance().add_time(t, std::chrono::duration<double, std::milli>(stop - start).count());
+  }
+}
+
+ui_profiler &ui_profiler::instance()
+{
+  static ui_profiler profiler;
+  return profiler;
+}
+
+ui_profiler::ui_profiler()
+  : enabled()
+  , current()
+  , last_frame(std::chrono::steady_clock::now())
+{
+}
+
+bool ui_profiler::is_enabled() const
+{
+  return enabled;
+}
+
+void ui_profiler::set_enabled(bool value)
+{
+  enabled = value;
+  current = {};
+  last_frame = std::chrono::steady_clock::now();
+}
+
+void ui_profiler::add_time(timer t, double milliseconds)
+{
+  if(enabled)
+  {
+    current.timers[static_cast<size_t>(t)] += milliseconds;
+  }
+}
+
+void ui_profiler::increment(counter c, int64_t value)
+{
+  if(enabled)
+  {
+    current.counters[static_cast<size_t>(c)] += value;
+  }
+}
+
+void ui_profiler::end_frame(double frame_time)
+{
+  if(!enabled)
+  {
+    return;
+  }
+
+  auto const now = std::chrono::steady_clock::now();
+  current.frame_time = frame_time;
+  current.frame_interval = std::chrono::duration<double, std::milli>(now - last_frame).count();
+  last_frame = now;
+
+  history.push_back(current);
+  if(history.size() > constants::profiler_history_size)
+  {
+    history.pop_front();
+  }
+  current = {};
+}
+
+std::deque<ui_profiler::frame> const &ui_profiler::get_history() const
+{
+  return history;
+}
+
+void ui_profiler::save(std::string const &file) const
+{
+  picojson::array frames;
+  for(auto &&f : history)
+  {
+    picojson::object o;
+    o["frame_time"] = picojson::value(f.frame_time);
+    o["frame_interval"] = picojson::value(f.frame_interval);
+    for(size_t i{}; i < f.timers.size(); ++i)
+    {
+      o[name(static_cast<timer>(i))] = picojson::value(f.timers[i]);
+    }
+    for(size_t i{}; i < f.counters.size(); ++i)
+    {
+      o[name(static_cast<counter>(i))] = picojson::value(f.counters[i]);
+    }
+    frames.emplace_back(o);
+  }
+
+  picojson::object result;
+  result["frames"] = picojson::value(frames);
+
+  std::ofstream fs(file);
+  if(!fs)
+  {
+    throw std::runtime_error("ui_profiler: cannot write " + file);
+  }
+  picojson::value(result).serialize(std::ostreambuf_iterator<char>(fs), true);
+}
+
+char const *ui_profiler::name(timer t)
+{
+  switch(t)
+  {
+  case timer::node_paint: return "node_paint";
+  case timer::connection_paint: return "connection_paint";
+  case timer::background: return "background";
+  default: return "unknown";
+  }
+}
+
+char const *ui_profiler::name(counter c)
+{
+  switch(c)
+  {
+  case counter::items_painted: return "items_painted";
+  case counter::spatial_queries: return "spatial_queries";
+  case counter::position_updates: return "position_updates";
+  default: return "unknown";
+  }
+}
+
+} // namespace skadi
@@ -0,0 +1,86 @@
+#include "graph_io.h"
+#include "ui_registry_watcher.h"
+
+#include <fstream>
+
+namespace skadi
+{
+
+namespace constants
+{
+  static int const reload_delay = 200; // ms
+}
+
+ui_registry_watcher::ui_registry_watcher(QString config_file, std::shared_ptr<type_registry const> registry, picojson::value registry_config, QObject *parent)
+  : QObject(parent)
+  , config_file(std::move(config_file))
+  , registry(std::move(registry))
+  , registry_config(std::move(registry_config))
+{
+  debounce.setSingleShot(true);
+  debounce.setInterval(constants::reload_delay);
+  connect(&debounce, &QTimer::timeout, this, &ui_registry_watcher::reload);
+  connect(&watcher, &QFileSystemWatcher::fileChanged, &debounce, static_cast<void (QTimer::*)()>(&QTimer::start));
+
+  watcher.addPath(this->config_file);
+}
+
+void ui_registry_watcher::set_extension(std::function<void(type_registry &)> extension)
+{
+  extend = std::move(extension);
+}
+
+std::shared_ptr<type_registry const> ui_registry_watcher::get_registry() const
+{
+  return registry;
+}
+
+picojson::value const &ui_registry_watcher::get_registry_config() const
+{
+  return registry_config;
+}
+
+void ui_registry_watcher::reload()
+{
+  // saving by replacing the file drops it from the watcher
+  if(!watcher.files().contains(config_file))
+  {
+    watcher.addPath(config_file);
+  }
+
+  std::ifstream fs(config_file.toStdString());
+  picojson::value config;
+  fs >> config;
+  if(!picojson::get_last_error().empty() || !config.is<picojson::object>() || !config.contains("type_registry"))
+  {
+    return;
+  }
+
+  std::shared_ptr<type_registry const> new_registry;
+  try
+  {
+    auto loaded = load_type_registry(config.get("type_registry"));
+    if(extend)
+    {
+      extend(loaded);
+    }
+    new_registry = std::make_shared<type_registry const>(std::move(loaded));
+  }
+  catch(std::runtime_error &)
+  {
+    // keep the current version until the file is valid again
+    return;
+  }
+
+  auto diff = diff_registries(*registry, *new_registry);
+  registry_config = config.get("type_registry");
+  if(diff.empty())
+  {
+    return;
+  }
+
+  registry = new_registry;
+  emit registry_changed(registry, diff);
+}
+
+} // namespace skadi
@@ -0,0 +1,138 @@
+#include "ui_router.h"
+
+#include <iterator>
+#include <unordered_map>
+
+namespace skadi
+{
+
+ui_router::ui_router(QObject *parent)
+  : QObject(parent)
+  , is_busy()
+  , is_publish_scheduled()
+  , is_stopping()
+  , worker(&ui_router::run, this)
+{
+}
+
+ui_router::~ui_router()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    is_stopping = true;
+  }
+  wakeup.notify_one();
+  worker.join();
+}
+
+void ui_router::set_obstacle(int64_t id, QRectF rect)
+{
+  route_rect r{rect.left(), rect.top(), rect.right(), rect.bottom()};
+  post([=](edge_router &router) { router.set_obstacle(id, r); });
+}
+
+void ui_router::remove_obstacle(int64_t id)
+{
+  post([=](edge_router &router) { router.remove_obstacle(id); });
+}
+
+void ui_router::set_edge(int64_t id, QPointF source, QPointF destination)
+{
+  route_point s{source.x(), source.y()};
+  route_point d{destination.x(), destination.y()};
+  post([=](edge_router &router) { router.set_edge(id, s, d); });
+}
+
+void ui_router::remove_edge(int64_t id)
+{
+  post([=](edge_router &router) { router.remove_edge(id); });
+}
+
+void ui_router::flush()
+{
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [&] { return pending.empty() && !is_busy; });
+  }
+  publish();
+}
+
+void ui_router::publish()
+{
+  std::vector<std::pair<int64_t, route>> routes;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    routes.swap(finished);
+    is_publish_scheduled = false;
+  }
+
+  // only the latest route of an edge is of interest
+  std::unordered_map<int64_t, route const *> latest;
+  for(auto &&[id, r] : routes)
+  {
+    latest[id] = &r;
+  }
+
+  for(auto &&[id, r] : latest)
+  {
+    QPolygonF polygon;
+    polygon.reserve(static_cast<int>(r->size()));
+    for(auto &&p : *r)
+    {
+      polygon.push_back({p.x, p.y});
+    }
+    emit route_changed(id, polygon);
+  }
+}
+
+void ui_router::post(std::function<void(edge_router &)> change)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.push_back(std::move(change));
+  }
+  wakeup.notify_one();
+}
+
+void ui_router::run()
+{
+  edge_router router;
+  for(;;)
+  {
+    std::vector<std::function<void(edge_router &)>> changes;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeup.wait(lock, [&] { return is_stopping || !pending.empty(); });
+      if(is_stopping)
+      {
+        return;
+      }
+      changes.swap(pending);
+      is_busy = true;
+    }
+
+    // everything queued while the last batch was routed is applied at once
+    for(auto &&change : changes)
+    {
+      change(router);
+    }
+    auto routes = router.update();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    is_busy = false;
+    idle.notify_all();
+    if(routes.empty())
+    {
+      continue;
+    }
+
+    std::move(begin(routes), end(routes), std::back_inserter(finished));
+    if(!is_publish_scheduled)
+    {
+      is_publish_scheduled = true;
+      QMetaObject::invokeMethod(this, "publish", Qt::QueuedConnection);
+    }
+  }
+}
+
+} // namespace skadi
@@ -1,11 +1,23 @@
 #include "ui_connection.h"
 #include "ui_node.h"
+#include "ui_profiler.h"
+#include "ui_router.h"
 #include "ui_scene.h"
 
+#include <algorithm>
+#include <optional>
+#include <unordered_set>
+#include <utility>
+
+#include "boost/geometry.hpp"
+#include "boost/geometry/index/rtree.hpp"
+#include "boost/iterator/function_output_iterator.hpp"
 #include "boost/range/algorithm.hpp"
 #include "boost/range/adaptor/map.hpp"
 #include "boost/range/adaptor/transformed.hpp"
 
+#include "QtCore/QTimer"
+
 namespace skadi
 {
 
@@ -19,6 +31,15 @@ bool operator<(connection_instance_id const &lhs, connection_instance_id const &
   return (lhs.id < rhs.id);
 }
 
+namespace constants
+{
+  // extent assumed for node types which have not been materialized yet
+  static QSizeF const default_node_size(200, 150);
+  // fraction of the visible size materialized around it, to avoid churn while panning
+  static qreal const materialized_margin = 0.5;
+  static size_t const node_pool_size = 1024;
+}
+
 static picojson::value save(QPointF p)
 {
   picojson::array a{};
@@ -72,10 +93,149 @@ graph_layout load_graph_layout(picojson::value v)
   return layout;
 }
 
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+using spatial_point = bg::model::point<double, 2, bg::cs::cartesian>;
+using spatial_box = bg::model::box<spatial_point>;
+using spatial_entry = std::pair<spatial_box, int64_t>;
+
+static spatial_box to_box(QRectF r)
+{
+  return spatial_box(spatial_point(r.left(), r.top()), spatial_point(r.right(), r.bottom()));
+}
+
+static QRectF to_rect(spatial_box b)
+{
+  return QRectF(QPointF(b.min_corner().get<0>(), b.min_corner().get<1>()),
+                QPointF(b.max_corner().get<0>(), b.max_corner().get<1>()));
+}
+
+struct ui_scene::virtual_model
+{
+  struct node_record
+  {
+    node_type const *type;
+    QPointF position;
+    spatial_box bounds;
+    std::vector<connection_instance_id> connections;
+    bool is_selected;
+    ui_node *item;
+  };
+
+  struct connection_record
+  {
+    node_instance_id source;
+    int source_port;
+    std::optional<node_instance_id> destination;
+    int destination_port;
+    ui_connection *item;
+  };
+
+  QRectF node_bounds(node_record const &record) const
+  {
+    auto it = type_sizes.find(record.type->guid.guid);
+    return {record.position, (it != end(type_sizes)) ? it->second : constants::default_node_size};
+  }
+
+  void update_index(node_instance_id id, node_record &record)
+  {
+    auto bounds = to_box(node_bounds(record));
+    if(!bg::equals(bounds, record.bounds))
+    {
+      index.remove(spatial_entry{record.bounds, id.id});
+      record.bounds = bounds;
+      index.insert(spatial_entry{record.bounds, id.id});
+    }
+  }
+
+  void rebuild_index()
+  {
+    std::vector<spatial_entry> entries;
+    entries.reserve(nodes.size());
+    for(auto &&[id, record] : nodes)
+    {
+      record.bounds = to_box(node_bounds(record));
+      entries.emplace_back(record.bounds, id.id);
+    }
+    index = decltype(index)(entries); // bulk loading packs the tree
+  }
+
+  void attach(connection_instance_id id, node_instance_id node)
+  {
+    nodes.at(node).connections.push_back(id);
+  }
+
+  void detach(connection_instance_id id, node_instance_id node)
+  {
+    if(auto it = nodes.find(node); it != end(nodes))
+    {
+      auto &&ids = it->second.connections;
+      ids.erase(std::remove_if(begin(ids), end(ids), [=](auto &&v) { return v.id == id.id; }), end(ids));
+    }
+  }
+
+  std::map<node_instance_id, node_record> nodes;
+  std::map<connection_instance_id, connection_record> connections;
+  bgi::rtree<spatial_entry, bgi::quadratic<16>> index;
+  std::unordered_map<int64_t, QSizeF> type_sizes;
+  std::vector<ui_node *> node_pool;
+  QRectF visible;
+  QRectF materialized;
+};
+
+struct ui_scene::port_index
+{
+  using entry = std::pair<spatial_point, std::pair<ui_node *, int>>;
+
+  void insert(ui_node *node)
+  {
+    auto &&entries = node_entries[node];
+    auto const input_count = static_cast<int>(node->get_type_info().inputs.size());
+    for(int i{}; i < input_count; ++i)
+    {
+      auto const p = node->get_input_position(i);
+      entries.emplace_back(spatial_point(p.x(), p.y()), std::make_pair(node, i));
+    }
+    index.insert(entries);
+  }
+
+  void remove(ui_node const *node)
+  {
+    if(auto it = node_entries.find(node); it != end(node_entries))
+    {
+      index.remove(it->second);
+      node_entries.erase(it);
+    }
+    dirty.erase(const_cast<ui_node *>(node));
+  }
+
+  bgi::rtree<entry, bgi::quadratic<16>> index;
+  std::unordered_map<ui_node const *, std::vector<entry>> node_entries;
+  std::unordered_set<ui_node *> dirty;
+};
+
 ui_scene::ui_scene(type_registry registry)
   : registry(registry)
+  , types(registry)
+  , drag_source{nullptr, -1}
+  , router(new ui_router(this))
+  , ports(std::make_unique<port_index>())
+  , is_update_scheduled()
+  , is_item_bounds_outdated()
+  , virtualized()
+  , model(std::make_unique<virtual_model>())
+  , last_node_uid()
   , last_connection_uid()
 {
+  connect(router, &ui_router::route_changed, this, [this](qint64 id, QPolygonF route)
+  {
+    if(auto it = connections.find({id}); it != end(connections))
+    {
+      it->second->set_route(route);
+      grow_content_bounds(it->second->sceneBoundingRect());
+    }
+  });
 }
 
 ui_scene::~ui_scene()
@@ -85,56 +245,329 @@ ui_scene::~ui_scene()
 
 void ui_scene::clear()
 {
+  // drop the model first, so the destruction of items does not touch it
+  for(auto &&node : model->node_pool)
+  {
+    delete node;
+  }
+  model = std::make_unique<virtual_model>();
+
   // clear connections first as they reference nodes
   for(auto &&[unused, connection] : connections)
   {
     Q_UNUSED(unused);
     removeItem(connection);
   }
+  for(auto &&[id, unused] : connections)
+  {
+    Q_UNUSED(unused);
+    router->remove_edge(id.id);
+  }
+  for(auto &&[id, unused] : nodes)
+  {
+    Q_UNUSED(unused);
+    router->remove_obstacle(id.id);
+  }
   connections.clear();
+  connection_ids.clear();
   nodes.clear();
+  node_ids.clear();
+  ports = std::make_unique<port_index>();
+  invalidate_content_bounds();
+  type_errors.clear();
+  order = topological_order();
+  ordered_connections.clear();
+  cyclic_connections.clear();
+  rejected_cycle.clear();
+  drag_source = {nullptr, -1};
   QGraphicsScene::clear();
+
+  emit content_reset();
 }
 
-graph ui_scene::get_content() const
+void ui_scene::update_registry(type_registry new_registry, registry_diff const &diff)
 {
-  graph result{};
+  if(virtualized)
+  {
+    sync_model();
+  }
 
-  for(auto &&[id, ui_node] : nodes)
+  std::unordered_set<int64_t> removed_types;
+  for(auto &&id : diff.removed_node_types)
   {
-    node n{};
-    n.uid = id;
-    n.type = ui_node->get_type_info().guid;
-    result.nodes.emplace_back(std::move(n));
+    removed_types.insert(id.guid);
   }
 
-  auto find_node_id = [&](ui_node *node)
+  // old port index -> new port index, -1 if the port is gone
+  struct port_map
   {
-    using namespace boost::range;
+    std::vector<int> inputs;
+    std::vector<int> outputs;
+  };
+  auto const map_ports = [](auto &&old_ports, auto &&new_ports)
+  {
+    std::vector<int> result;
+    for(auto &&port : old_ports)
+    {
+      auto it = std::find_if(begin(new_ports), end(new_ports), [&](auto &&p) { return p.name == port.name; });
+      result.push_back((it != end(new_ports)) ? static_cast<int>(it - begin(new_ports)) : -1);
+    }
+    return result;
+  };
+
+  std::unordered_map<int64_t, port_map> changed_types;
+  for(auto &&type : diff.changed_node_types)
+  {
+    auto old_type = std::find_if(begin(registry.node_types), end(registry.node_types), [&](auto &&t) { return t.guid.guid == type.guid.guid; });
+    changed_types[type.guid.guid] = {map_ports(old_type->inputs, type.inputs), map_ports(old_type->outputs, type.outputs)};
+  }
 
-    auto it = find_if(nodes, [=](auto &&v)
+  auto const type_of = [&](node_instance_id id) -> int64_t
+  {
+    if(virtualized)
     {
-      return (v.second == node);
-    });
-    assert(it != end(nodes));
-    return it->first;
+      return model->nodes.at(id).type->guid.guid;
+    }
+    return nodes.at(id)->get_type_info().guid.guid;
+  };
+  auto const new_port = [&](node_instance_id id, int port, bool is_input)
+  {
+    if(removed_types.count(type_of(id)))
+    {
+      return -1;
+    }
+    auto it = changed_types.find(type_of(id));
+    if(it == end(changed_types))
+    {
+      return port;
+    }
+    auto &&ports = is_input ? it->second.inputs : it->second.outputs;
+    return (port < static_cast<int>(ports.size())) ? ports[port] : -1;
   };
+
+  // connections to ports which are gone are deleted, the others follow their ports
+  std::vector<connection_instance_id> dropped_connections;
+  if(virtualized)
+  {
+    for(auto &&[id, record] : model->connections)
+    {
+      if(!record.destination)
+      {
+        continue;
+      }
+      auto const source_port = new_port(record.source, record.source_port, false);
+      auto const destination_port = new_port(*record.destination, record.destination_port, true);
+      if(source_port < 0 || destination_port < 0)
+      {
+        dropped_connections.push_back(id);
+        continue;
+      }
+      record.source_port = source_port;
+      record.destination_port = destination_port;
+      if(record.item)
+      {
+        record.item->set_source_port(source_port);
+        record.item->set_destination(record.item->get_destination().first, destination_port);
+      }
+    }
+  }
+  else
+  {
+    for(auto &&[id, connection] : connections)
+    {
+      auto &&[source, source_port] = connection->get_source();
+      auto &&[destination, destination_port] = connection->get_destination();
+      if(!destination)
+      {
+        continue;
+      }
+      auto const new_source_port = new_port(node_ids.at(source), source_port, false);
+      auto const new_destination_port = new_port(node_ids.at(destination), destination_port, true);
+      if(new_source_port < 0 || new_destination_port < 0)
+      {
+        dropped_connections.push_back(id);
+        continue;
+      }
+      connection->set_source_port(new_source_port);
+      connection->set_destination(destination, new_destination_port);
+    }
+  }
+  for(auto &&id : dropped_connections)
+  {
+    if(auto it = connections.find(id); it != end(connections))
+    {
+      delete it->second;
+    }
+    else
+    {
+      remove_connection(id);
+    }
+  }
+
+  // all connections of the nodes of removed types are gone by now
+  std::vector<node_instance_id> dropped_nodes;
+  if(virtualized)
+  {
+    for(auto &&[id, record] : model->nodes)
+    {
+      if(removed_types.count(record.type->guid.guid))
+      {
+        dropped_nodes.push_back(id);
+      }
+    }
+  }
+  else
+  {
+    for(auto &&[id, node] : nodes)
+    {
+      if(removed_types.count(node->get_type_info().guid.guid))
+      {
+        dropped_nodes.push_back(id);
+      }
+    }
+  }
+  for(auto &&id : dropped_nodes)
+  {
+    if(auto it = nodes.find(id); it != end(nodes))
+    {
+      delete it->second;
+    }
+    else
+    {
+      remove_node(id);
+    }
+  }
+
+  // the records point into the node types of the old registry, which are gone once it is
+  // replaced, so their guids are taken first, in the order of the records
+  std::vector<int64_t> record_types;
+  if(virtualized)
+  {
+    record_types.reserve(model->nodes.size());
+    for(auto &&[id, record] : model->nodes)
+    {
+      record_types.push_back(record.type->guid.guid);
+    }
+  }
+
+  registry = std::move(new_registry);
+  types = type_system(registry);
+
+  std::unordered_map<int64_t, node_type const *> node_types_by_guid;
+  for(auto &&type : registry.node_types)
+  {
+    node_types_by_guid.emplace(type.guid.guid, &type);
+  }
+  if(virtualized)
+  {
+    auto guid = begin(record_types);
+    for(auto &&[id, record] : model->nodes)
+    {
+      record.type = node_types_by_guid.at(*guid++);
+    }
+  }
+
+  // only the nodes of changed types are laid out again
+  for(auto &&[id, node] : nodes)
+  {
+    if(changed_types.count(node->get_type_info().guid.guid))
+    {
+      node->set_type_info(*node_types_by_guid.at(node->get_type_info().guid.guid));
+    }
+  }
+  invalidate_content_bounds();
+
+  if(virtualized)
+  {
+    for(auto &&guid : changed_types)
+    {
+      model->type_sizes.erase(guid.first);
+    }
+    for(auto &&[id, record] : model->nodes)
+    {
+      auto const guid = record.type->guid.guid;
+      if(record.item && changed_types.count(guid))
+      {
+        model->type_sizes[guid] = record.item->sceneBoundingRect().size();
+      }
+    }
+    for(auto &&[id, record] : model->nodes)
+    {
+      if(changed_types.count(record.type->guid.guid))
+      {
+        model->update_index(id, record);
+      }
+    }
+  }
+
+  check_content();
+  emit content_reset();
+}
+
+graph ui_scene::get_content() const
+{
+  graph result{};
+
+  if(virtualized)
+  {
+    for(auto &&[id, record] : model->nodes)
+    {
+      node n{};
+      n.uid = id;
+      n.type = record.type->guid;
+      result.nodes.emplace_back(std::move(n));
+    }
+  }
+  else
+  {
+    for(auto &&[id, ui_node] : nodes)
+    {
+      node n{};
+      n.uid = id;
+      n.type = ui_node->get_type_info().guid;
+      result.nodes.emplace_back(std::move(n));
+    }
+  }
+
   for(auto &&[id, ui_connection] : connections)
   {
+    auto &&[source_node, signal] = ui_connection->get_source();
+    auto &&[destination_node, slot] = ui_connection->get_destination();
+    if(nullptr == destination_node) // still being dragged
+    {
+      continue;
+    }
+
     connection c{};
     c.uid = id;
-    
-    auto &&[source_node, signal] = ui_connection->get_source();
-    c.source = find_node_id(source_node);
+    c.source = node_ids.at(source_node);
     c.signal = source_node->get_type_info().outputs[signal].name;
-
-    auto &&[destination_node, slot] = ui_connection->get_destination();
-    c.destination = find_node_id(destination_node);
+    c.destination = node_ids.at(destination_node);
     c.slot = destination_node->get_type_info().inputs[slot].name;
 
     result.connections.emplace_back(std::move(c));
   }
 
+  if(virtualized)
+  {
+    for(auto &&[id, record] : model->connections)
+    {
+      if(record.item || !record.destination) // materialized ones are handled above
+      {
+        continue;
+      }
+
+      connection c{};
+      c.uid = id;
+      c.source = record.source;
+      c.signal = model->nodes.at(record.source).type->outputs[record.source_port].name;
+      c.destination = *record.destination;
+      c.slot = model->nodes.at(*record.destination).type->inputs[record.destination_port].name;
+
+      result.connections.emplace_back(std::move(c));
+    }
+  }
+
   return result;
 }
 
@@ -157,7 +590,16 @@ try
     }
 
     last_node_uid = std::max(last_node_uid, node.uid.id);
-    add_node(node.uid, new ui_node(*it));
+    order.add_node(node.uid.id);
+    emit node_type_used(node.type);
+    if(virtualized)
+    {
+      model->nodes.emplace(node.uid, virtual_model::node_record{&*it, {}, {}, {}, false, nullptr});
+    }
+    else
+    {
+      add_node(node.uid, new ui_node(*it));
+    }
   }
 
   auto find_index = [](auto &&range, std::string port_name)
@@ -172,20 +614,56 @@ try
     {
       throw std::runtime_error("unknown port: " + port_name);
     }
-    return distance(begin(range), it);
+    return static_cast<int>(distance(begin(range), it));
   };
 
   for(auto &&connection : content.connections)
   {
-    auto source = nodes.at(connection.source);
-    auto source_port = find_index(source->get_type_info().outputs, connection.signal);
+    last_connection_uid = std::max(last_connection_uid, connection.uid.id);
 
-    auto destination = nodes.at(connection.destination);
-    auto destination_port = find_index(destination->get_type_info().inputs, connection.slot);
+    // a loaded cycle is kept to be fixed, but stays out of the order
+    if(order.add_edge(connection.source.id, connection.destination.id))
+    {
+      ordered_connections.emplace(connection.uid.id, std::make_pair(connection.source.id, connection.destination.id));
+    }
+    else
+    {
+      cyclic_connections.insert(connection.uid.id);
+    }
 
-    last_connection_uid = std::max(last_connection_uid, connection.uid.id);
-    add_connection(connection.uid, new ui_connection(source, source_port, destination, destination_port));
+    if(virtualized)
+    {
+      auto &&source = model->nodes.at(connection.source);
+      auto source_port = find_index(source.type->outputs, connection.signal);
+
+      auto &&destination = model->nodes.at(connection.destination);
+      auto destination_port = find_index(destination.type->inputs, connection.slot);
+
+      model->connections.emplace(connection.uid, virtual_model::connection_record{
+        connection.source, source_port, connection.destination, destination_port, nullptr});
+      model->attach(connection.uid, connection.source);
+      model->attach(connection.uid, connection.destination);
+    }
+    else
+    {
+      auto source = nodes.at(connection.source);
+      auto source_port = find_index(source->get_type_info().outputs, connection.signal);
+
+      auto destination = nodes.at(connection.destination);
+      auto destination_port = find_index(destination->get_type_info().inputs, connection.slot);
+
+      add_connection(connection.uid, new ui_connection(source, source_port, destination, destination_port));
+    }
   }
+
+  if(virtualized)
+  {
+    model->rebuild_index();
+    update_materialized();
+  }
+
+  check_content();
+  emit content_reset();
 }
 catch(std::runtime_error &)
 {
@@ -196,21 +674,51 @@ catch(std::runtime_error &)
 graph_layout ui_scene::get_layout() const
 {
   graph_layout layout{};
-  for(auto &&[id, ui_node] : nodes)
+  if(virtualized)
   {
-    node_layout l{};
-    l.node = id;
-    l.position = ui_node->scenePos();
-    layout.node_layouts.emplace_back(l);
+    for(auto &&[id, record] : model->nodes)
+    {
+      node_layout l{};
+      l.node = id;
+      l.position = record.item ? record.item->scenePos() : record.position;
+      layout.node_layouts.emplace_back(l);
+    }
+  }
+  else
+  {
+    for(auto &&[id, ui_node] : nodes)
+    {
+      node_layout l{};
+      l.node = id;
+      l.position = ui_node->scenePos();
+      layout.node_layouts.emplace_back(l);
+    }
   }
   return layout;
 }
 
 void ui_scene::set_layout(graph_layout layout)
 {
-  for(auto &&l : layout.node_layouts)
+  if(virtualized)
+  {
+    for(auto &&l : layout.node_layouts)
+    {
+      auto &&record = model->nodes.at(l.node);
+      record.position = l.position;
+      if(record.item)
+      {
+        record.item->setPos(l.position);
+      }
+    }
+    model->rebuild_index();
+    update_materialized();
+  }
+  else
   {
-    nodes.at(l.node)->setPos(l.position);
+    for(auto &&l : layout.node_layouts)
+    {
+      nodes.at(l.node)->setPos(l.position);
+    }
   }
 }
 
@@ -228,10 +736,54 @@ ui_connection *ui_scene::create_connection(ui_node *source, int source_port)
   connection_instance_id id{last_connection_uid};
 
   auto connection = new ui_connection(source, source_port);
+  if(virtualized)
+  {
+    // the destination is picked up by sync_model once the connection is dropped
+    auto source_id = node_ids.at(source);
+    model->connections.emplace(id, virtual_model::connection_record{source_id, source_port, {}, 0, connection});
+    model->attach(id, source_id);
+  }
   add_connection(id, connection);
   return connection;
 }
 
+void ui_scene::commit_connection(ui_connection *connection)
+{
+  auto &&[source, source_port] = connection->get_source();
+  auto &&[destination, destination_port] = connection->get_destination();
+  auto it = connection_ids.find(connection);
+  if(!destination || (it == end(connection_ids)))
+  {
+    return;
+  }
+
+  // update_destination has refused destinations closing a cycle already; the old edge of the
+  // connection cannot be on a path back to its source, so it is only replaced once the new
+  // one is known to fit
+  auto const id = it->second;
+  auto const source_id = node_ids.at(source).id;
+  auto const destination_id = node_ids.at(destination).id;
+  if(order.closes_cycle(source_id, destination_id))
+  {
+    connection->deleteLater();
+    return;
+  }
+
+  // dragging a connection to another input replaces it
+  type_errors.erase(id.id);
+  cyclic_connections.erase(id.id);
+  if(auto edge = ordered_connections.find(id.id); edge != end(ordered_connections))
+  {
+    order.remove_edge(edge->second.first, edge->second.second);
+    ordered_connections.erase(edge);
+  }
+  order.add_edge(source_id, destination_id);
+  ordered_connections.emplace(id.id, std::make_pair(source_id, destination_id));
+  emit connection_removed(id);
+  emit connection_added({id, node_ids.at(source), source->get_type_info().outputs.at(source_port).name,
+                         node_ids.at(destination), destination->get_type_info().inputs.at(destination_port).name});
+}
+
 bool ui_scene::is_input_connected(ui_node *node, int port)
 {
   using namespace boost::adaptors;
@@ -265,34 +817,710 @@ void ui_scene::create_node(node_type_id id, QPointF pos)
   });
   if(it != end(registry.node_types))
   {
-    auto item = new ui_node(*it);
-    item->setPos(pos);
-    add_node({++last_node_uid}, item);
+    node_instance_id uid{++last_node_uid};
+    order.add_node(uid.id);
+    emit node_type_used(id);
+    emit node_added({uid, id});
+    if(virtualized)
+    {
+      auto &&record = model->nodes.emplace(uid, virtual_model::node_record{&*it, pos, {}, {}, false, nullptr}).first->second;
+      record.bounds = to_box(model->node_bounds(record));
+      model->index.insert(spatial_entry{record.bounds, uid.id});
+      acquire_node(uid);
+    }
+    else
+    {
+      auto item = new ui_node(*it);
+      item->setPos(pos);
+      add_node(uid, item);
+    }
   }
 }
 
-void ui_scene::remove_connection(connection_instance_id id)
+void ui_scene::delete_node(ui_node *node)
 {
-  connections.erase(id);
+  // connections reference their nodes, so they have to go first
+  std::vector<ui_connection *> attached;
+  for(auto &&[id, connection] : connections)
+  {
+    Q_UNUSED(id);
+    if((connection->get_source().first == node) || (connection->get_destination().first == node))
+    {
+      attached.push_back(connection);
+    }
+  }
+  for(auto &&connection : attached)
+  {
+    delete connection;
+  }
+
+  node->deleteLater();
 }
 
-void ui_scene::remove_node(node_instance_id id)
+void ui_scene::invalidate_connection(ui_connection *connection)
 {
-  nodes.erase(id);
+  schedule_update();
+  dirty_connections.emplace_back(connection);
 }
 
-void ui_scene::add_connection(connection_instance_id id, ui_connection *connection)
+void ui_scene::invalidate_ports(ui_node *node)
 {
-  addItem(connection);
-  connections.emplace(id, connection);
-  connect(connection, &QObject::destroyed, std::bind(&ui_scene::remove_connection, this, id));
+  schedule_update();
+  ports->dirty.insert(node);
+  grow_content_bounds(node->sceneBoundingRect());
 }
 
-void ui_scene::add_node(node_instance_id id, ui_node *node)
+void ui_scene::route_connection(ui_connection *connection, QPointF source, QPointF destination)
 {
-  addItem(node);
-  nodes.emplace(id, node);
-  connect(node, &QObject::destroyed, std::bind(&ui_scene::remove_node, this, id));
+  if(auto it = connection_ids.find(connection); it != end(connection_ids))
+  {
+    router->set_edge(it->second.id, source, destination);
+  }
+}
+
+void ui_scene::finish_routing()
+{
+  update_connections();
+  router->flush();
+}
+
+std::pair<ui_node *, int> ui_scene::find_input(QPointF pos, qreal radius, ui_node const *source, int source_port)
+{
+  update_ports();
+  ui_profiler::instance().increment(ui_profiler::counter::spatial_queries);
+
+  std::pair<ui_node *, int> result{nullptr, -1};
+  spatial_point const p(pos.x(), pos.y());
+  ports->index.query(
+    bgi::nearest(p, 1) && bgi::satisfies([=](port_index::entry const &e)
+  {
+    return (e.second.first != source) && can_connect(source, source_port, e.second.first, e.second.second);
+  }),
+    boost::make_function_output_iterator([&](port_index::entry const &e)
+  {
+    if(bg::distance(p, e.first) <= radius)
+    {
+      result = e.second;
+    }
+  }));
+  return result;
+}
+
+bool ui_scene::can_connect(ui_node const *source, int source_port, ui_node const *destination, int destination_port) const
+{
+  auto &&outputs = source->get_type_info().outputs;
+  auto &&inputs = destination->get_type_info().inputs;
+  if((source_port < 0) || (source_port >= static_cast<int>(outputs.size()))
+    || (destination_port < 0) || (destination_port >= static_cast<int>(inputs.size())))
+  {
+    return false;
+  }
+  return types.is_compatible(outputs[source_port].type, inputs[destination_port].type);
+}
+
+void ui_scene::begin_drag(ui_node *source, int source_port)
+{
+  drag_source = {source, source_port};
+  for(auto &&[id, node] : nodes)
+  {
+    Q_UNUSED(id);
+    node->update();
+  }
+}
+
+void ui_scene::end_drag()
+{
+  set_rejected_cycle({});
+  if(!drag_source.first)
+  {
+    return;
+  }
+  drag_source = {nullptr, -1};
+  for(auto &&[id, node] : nodes)
+  {
+    Q_UNUSED(id);
+    node->update();
+  }
+}
+
+std::pair<ui_node *, int> ui_scene::get_drag_source() const
+{
+  return drag_source;
+}
+
+bool ui_scene::is_invalid(ui_connection const *connection) const
+{
+  if(type_errors.empty() && cyclic_connections.empty())
+  {
+    return false;
+  }
+  auto it = connection_ids.find(connection);
+  return (it != end(connection_ids)) && (type_errors.count(it->second.id) || cyclic_connections.count(it->second.id));
+}
+
+bool ui_scene::check_cycle(ui_node const *source, ui_node const *destination)
+{
+  auto s = node_ids.find(source);
+  auto d = node_ids.find(destination);
+  if((s == end(node_ids)) || (d == end(node_ids)))
+  {
+    return true;
+  }
+
+  std::vector<int64_t> path;
+  if(!order.closes_cycle(s->second.id, d->second.id, &path))
+  {
+    set_rejected_cycle({});
+    return true;
+  }
+  set_rejected_cycle(path);
+  return false;
+}
+
+bool ui_scene::is_on_rejected_cycle(ui_node const *node) const
+{
+  if(rejected_cycle.empty())
+  {
+    return false;
+  }
+  auto it = node_ids.find(node);
+  return (it != end(node_ids)) && rejected_cycle.count(it->second.id);
+}
+
+bool ui_scene::is_on_rejected_cycle(ui_connection const *connection) const
+{
+  if(rejected_cycle.empty())
+  {
+    return false;
+  }
+  auto source = node_ids.find(connection->get_source().first);
+  auto destination = node_ids.find(connection->get_destination().first);
+  if((source == end(node_ids)) || (destination == end(node_ids)))
+  {
+    return false;
+  }
+  auto it = rejected_cycle.find(source->second.id);
+  return (it != end(rejected_cycle)) && (it->second == destination->second.id);
+}
+
+void ui_scene::set_rejected_cycle(std::vector<int64_t> const &path)
+{
+  // the path leads from the destination back to the source, the rejected connection
+  // would close it
+  std::unordered_map<int64_t, int64_t> cycle;
+  for(size_t i{}; i < path.size(); ++i)
+  {
+    cycle.emplace(path[i], path[(i + 1) % path.size()]);
+  }
+  if(cycle == rejected_cycle)
+  {
+    return;
+  }
+
+  auto previous = std::exchange(rejected_cycle, std::move(cycle));
+  for(auto &&highlighted : {&previous, &rejected_cycle})
+  {
+    for(auto &&[id, next] : *highlighted)
+    {
+      Q_UNUSED(next);
+      if(auto it = nodes.find({id}); it != end(nodes))
+      {
+        it->second->update();
+      }
+    }
+  }
+  // only when the cycle changes, not on every move of a drag
+  for(auto &&[id, connection] : connections)
+  {
+    Q_UNUSED(id);
+    auto source = node_ids.find(connection->get_source().first);
+    if((source != end(node_ids)) && (previous.count(source->second.id) || rejected_cycle.count(source->second.id)))
+    {
+      connection->update();
+    }
+  }
+}
+
+void ui_scene::check_content()
+{
+  // a pass over the whole content, so big graphs are checked once after loading them
+  QStringList errors;
+  for(auto &&id : cyclic_connections)
+  {
+    errors << QString("connection %1: closes a cycle").arg(id);
+  }
+  for(auto &&error : types.get_registry_errors())
+  {
+    errors << QString::fromStdString(error);
+  }
+  type_errors.clear();
+  for(auto &&error : types.check(get_content()))
+  {
+    type_errors.insert(error.connection.id);
+    errors << QString("connection %1: %2").arg(error.connection.id).arg(QString::fromStdString(error.message));
+  }
+
+  for(auto &&[id, connection] : connections)
+  {
+    Q_UNUSED(id);
+    connection->update();
+  }
+  emit content_checked(errors);
+}
+
+void ui_scene::set_virtualized(bool enabled)
+{
+  if(enabled == virtualized)
+  {
+    return;
+  }
+
+  auto content = get_content();
+  auto layout = get_layout();
+  clear();
+  virtualized = enabled;
+  set_content(std::move(content));
+  set_layout(std::move(layout));
+}
+
+bool ui_scene::is_virtualized() const
+{
+  return virtualized;
+}
+
+void ui_scene::set_visible_region(QRectF visible)
+{
+  if(!virtualized)
+  {
+    return;
+  }
+
+  model->visible = visible;
+  if(!model->materialized.contains(visible))
+  {
+    update_materialized();
+  }
+}
+
+QRectF ui_scene::content_bounds() const
+{
+  if(virtualized && !model->index.empty())
+  {
+    return to_rect(model->index.bounds());
+  }
+  if(is_item_bounds_outdated)
+  {
+    item_bounds = itemsBoundingRect();
+    is_item_bounds_outdated = false;
+  }
+  return item_bounds;
+}
+
+void ui_scene::grow_content_bounds(QRectF r)
+{
+  if(!is_item_bounds_outdated)
+  {
+    item_bounds = item_bounds.united(r);
+  }
+}
+
+void ui_scene::invalidate_content_bounds()
+{
+  is_item_bounds_outdated = true;
+}
+
+void ui_scene::schedule_update()
+{
+  if(!is_update_scheduled)
+  {
+    // runs once all pending input has been handled, but before the low priority paint request
+    is_update_scheduled = true;
+    QTimer::singleShot(0, this, &ui_scene::update_connections);
+  }
+}
+
+void ui_scene::update_ports()
+{
+  for(auto &&node : ports->dirty)
+  {
+    if(auto it = ports->node_entries.find(node); it != end(ports->node_entries))
+    {
+      ports->index.remove(it->second);
+      ports->node_entries.erase(it);
+    }
+    ports->insert(node);
+    router->set_obstacle(node_ids.at(node).id, node->sceneBoundingRect());
+  }
+  ports->dirty.clear();
+}
+
+void ui_scene::get_overview(QRectF area, std::vector<QRectF> &node_rects, std::vector<QLineF> &connection_lines) const
+{
+  ui_profiler::instance().increment(ui_profiler::counter::spatial_queries);
+
+  auto const line = [](QRectF const &source, QRectF const &destination)
+  {
+    return QLineF(source.right(), source.center().y(), destination.left(), destination.center().y());
+  };
+
+  if(virtualized)
+  {
+    auto const bounds = [&](virtual_model::node_record const &record)
+    {
+      return record.item ? record.item->sceneBoundingRect() : to_rect(record.bounds);
+    };
+
+    model->index.query(bgi::intersects(to_box(area)), boost::make_function_output_iterator([&](spatial_entry const &entry)
+    {
+      auto &&record = model->nodes.at({entry.second});
+      node_rects.push_back(bounds(record));
+      for(auto &&id : record.connections)
+      {
+        auto &&connection = model->connections.at(id);
+        if(connection.destination)
+        {
+          connection_lines.push_back(line(bounds(model->nodes.at(connection.source)),
+                                          bounds(model->nodes.at(*connection.destination))));
+        }
+      }
+    }));
+    return;
+  }
+
+  for(auto &&item : items(area, Qt::IntersectsItemBoundingRect))
+  {
+    if(auto node = qgraphicsitem_cast<ui_node *>(item))
+    {
+      node_rects.push_back(node->sceneBoundingRect());
+    }
+    else if(auto connection = qgraphicsitem_cast<ui_connection *>(item))
+    {
+      auto &&[source, source_port] = connection->get_source();
+      auto &&[destination, destination_port] = connection->get_destination();
+      if(destination)
+      {
+        connection_lines.emplace_back(source->get_output_position(source_port),
+                                      destination->get_input_position(destination_port));
+      }
+    }
+  }
+}
+
+void ui_scene::update_connections()
+{
+  is_update_scheduled = false;
+  update_ports();
+
+  auto dirty = std::move(dirty_connections);
+  dirty_connections.clear();
+  for(auto &&connection : dirty)
+  {
+    if(connection)
+    {
+      connection->update_positions();
+      grow_content_bounds(connection->sceneBoundingRect());
+    }
+  }
+}
+
+void ui_scene::remove_connection(connection_instance_id id)
+{
+  if(auto edge = ordered_connections.find(id.id); edge != end(ordered_connections))
+  {
+    order.remove_edge(edge->second.first, edge->second.second);
+    ordered_connections.erase(edge);
+  }
+  type_errors.erase(id.id);
+  cyclic_connections.erase(id.id);
+
+  bool is_removed{};
+  if(auto it = connections.find(id); it != end(connections))
+  {
+    router->remove_edge(id.id);
+    connection_ids.erase(it->second);
+    connections.erase(it);
+    invalidate_content_bounds();
+    is_removed = true;
+  }
+
+  if(auto it = model->connections.find(id); it != end(model->connections))
+  {
+    model->detach(id, it->second.source);
+    if(it->second.destination)
+    {
+      model->detach(id, *it->second.destination);
+    }
+    model->connections.erase(it);
+    is_removed = true;
+  }
+
+  if(is_removed)
+  {
+    emit connection_removed(id);
+  }
+}
+
+void ui_scene::remove_node(node_instance_id id)
+{
+  bool is_removed{};
+  if(auto it = nodes.find(id); it != end(nodes))
+  {
+    router->remove_obstacle(id.id);
+    ports->remove(it->second);
+    if(drag_source.first == it->second)
+    {
+      drag_source = {nullptr, -1};
+    }
+    node_ids.erase(it->second);
+    nodes.erase(it);
+    invalidate_content_bounds();
+    is_removed = true;
+  }
+
+  if(auto it = model->nodes.find(id); it != end(model->nodes))
+  {
+    // materialized connections have been removed by delete_node already
+    for(auto &&connection : std::vector<connection_instance_id>(it->second.connections))
+    {
+      remove_connection(connection);
+    }
+    model->index.remove(spatial_entry{it->second.bounds, id.id});
+    model->nodes.erase(it);
+    is_removed = true;
+  }
+
+  if(is_removed)
+  {
+    order.remove_node(id.id);
+    emit node_removed(id);
+  }
+}
+
+void ui_scene::add_connection(connection_instance_id id, ui_connection *connection)
+{
+  addItem(connection);
+  connections.emplace(id, connection);
+  connection_ids.emplace(connection, id);
+  connect(connection, &QObject::destroyed, this, std::bind(&ui_scene::remove_connection, this, id));
+  connection->update_positions();
+  grow_content_bounds(connection->sceneBoundingRect());
+}
+
+void ui_scene::add_node(node_instance_id id, ui_node *node)
+{
+  addItem(node);
+  nodes.emplace(id, node);
+  node_ids.emplace(node, id);
+  ports->insert(node);
+  router->set_obstacle(id.id, node->sceneBoundingRect());
+  grow_content_bounds(node->sceneBoundingRect());
+  connect(node, &QObject::destroyed, this, std::bind(&ui_scene::remove_node, this, id));
+  connect(node, &ui_node::positionChanged, this, std::bind(&ui_scene::invalidate_ports, this, node));
+}
+
+void ui_scene::sync_model()
+{
+  for(auto &&[id, item] : nodes)
+  {
+    auto &&record = model->nodes.at(id);
+    record.is_selected = item->isSelected();
+    record.position = item->scenePos();
+    model->update_index(id, record);
+  }
+
+  for(auto &&[id, item] : connections)
+  {
+    auto &&record = model->connections.at(id);
+    auto &&[destination, port] = item->get_destination();
+    auto destination_id = destination ? std::optional<node_instance_id>(node_ids.at(destination)) : std::nullopt;
+
+    auto const same_destination = (destination_id.has_value() == record.destination.has_value())
+      && (!destination_id || (destination_id->id == record.destination->id));
+    if(!same_destination)
+    {
+      if(record.destination)
+      {
+        model->detach(id, *record.destination);
+      }
+      if(destination_id)
+      {
+        model->attach(id, *destination_id);
+      }
+    }
+    record.destination = destination_id;
+    record.destination_port = port;
+  }
+}
+
+void ui_scene::update_materialized()
+{
+  sync_model();
+
+  auto const &visible = model->visible;
+  auto const dx = constants::materialized_margin * visible.width();
+  auto const dy = constants::materialized_margin * visible.height();
+  model->materialized = visible.adjusted(-dx, -dy, dx, dy);
+
+  std::unordered_set<int64_t> wanted_nodes;
+  std::unordered_set<int64_t> wanted_connections;
+
+  // connections of wanted nodes are materialized together with their other endpoint
+  auto want_node = [&](node_instance_id id)
+  {
+    wanted_nodes.insert(id.id);
+    for(auto &&connection : model->nodes.at(id).connections)
+    {
+      auto &&record = model->connections.at(connection);
+      wanted_connections.insert(connection.id);
+      wanted_nodes.insert(record.source.id);
+      if(record.destination)
+      {
+        wanted_nodes.insert(record.destination->id);
+      }
+    }
+  };
+
+  if(!visible.isEmpty())
+  {
+    ui_profiler::instance().increment(ui_profiler::counter::spatial_queries);
+    model->index.query(bgi::intersects(to_box(model->materialized)), boost::make_function_output_iterator([&](spatial_entry const &entry)
+    {
+      want_node({entry.second});
+    }));
+  }
+
+  // never pull items away from under the user
+  for(auto &&[id, item] : nodes)
+  {
+    if((item == mouseGrabberItem()) || (item == focusItem()) || item->isSelected())
+    {
+      want_node(id);
+    }
+  }
+  for(auto &&[id, item] : connections)
+  {
+    if(nullptr == item->get_destination().first) // still being dragged
+    {
+      wanted_connections.insert(id.id);
+      wanted_nodes.insert(node_ids.at(item->get_source().first).id);
+    }
+  }
+
+  std::vector<connection_instance_id> released_connections;
+  for(auto &&[id, item] : connections)
+  {
+    Q_UNUSED(item);
+    if(!wanted_connections.count(id.id))
+    {
+      released_connections.push_back(id);
+    }
+  }
+  for(auto &&id : released_connections)
+  {
+    release_connection(id);
+  }
+
+  std::vector<node_instance_id> released_nodes;
+  for(auto &&[id, item] : nodes)
+  {
+    Q_UNUSED(item);
+    if(!wanted_nodes.count(id.id))
+    {
+      released_nodes.push_back(id);
+    }
+  }
+  for(auto &&id : released_nodes)
+  {
+    release_node(id);
+  }
+
+  for(auto &&id : wanted_nodes)
+  {
+    if(!nodes.count({id}))
+    {
+      acquire_node({id});
+    }
+  }
+  for(auto &&id : wanted_connections)
+  {
+    if(!connections.count({id}))
+    {
+      acquire_connection({id});
+    }
+  }
+}
+
+void ui_scene::acquire_node(node_instance_id id)
+{
+  auto &&record = model->nodes.at(id);
+
+  ui_node *item{};
+  if(model->node_pool.empty())
+  {
+    item = new ui_node(*record.type);
+  }
+  else
+  {
+    item = model->node_pool.back();
+    model->node_pool.pop_back();
+    item->set_type_info(*record.type);
+  }
+
+  item->setPos(record.position);
+  add_node(id, item);
+  item->setSelected(record.is_selected);
+  record.item = item;
+
+  // the real extent is only known after layouting with the scene's font
+  model->type_sizes[record.type->guid.guid] = item->sceneBoundingRect().size();
+  model->update_index(id, record);
+}
+
+void ui_scene::release_node(node_instance_id id)
+{
+  auto item = nodes.at(id);
+  disconnect(item, nullptr, this, nullptr);
+  router->remove_obstacle(id.id);
+  ports->remove(item);
+  nodes.erase(id);
+  node_ids.erase(item);
+  removeItem(item);
+  model->nodes.at(id).item = nullptr;
+
+  if(model->node_pool.size() < constants::node_pool_size)
+  {
+    item->setSelected(false);
+    model->node_pool.push_back(item);
+  }
+  else
+  {
+    delete item;
+  }
+}
+
+void ui_scene::acquire_connection(connection_instance_id id)
+{
+  auto &&record = model->connections.at(id);
+  if(!record.destination)
+  {
+    return;
+  }
+
+  auto source = model->nodes.at(record.source).item;
+  auto destination = model->nodes.at(*record.destination).item;
+  record.item = new ui_connection(source, record.source_port, destination, record.destination_port);
+  add_connection(id, record.item);
+}
+
+void ui_scene::release_connection(connection_instance_id id)
+{
+  auto item = connections.at(id);
+  disconnect(item, &QObject::destroyed, this, nullptr);
+  router->remove_edge(id.id);
+  connection_ids.erase(item);
+  connections.erase(id);
+  model->connections.at(id).item = nullptr;
+  delete item;
 }
 
 } // namespace skadi
@@ -1,17 +1,107 @@
+#include "ui_library.h"
+#include "ui_library_search.h"
 #include "ui_tree_filter.h"
 
+#include <algorithm>
+
 namespace skadi
 {
 
 ui_tree_filter::ui_tree_filter(QObject *parent)
   : QSortFilterProxyModel(parent)
+  , library()
+  , search()
+  , filtered()
+{
+}
+
+ui_tree_filter::~ui_tree_filter() = default;
+
+void ui_tree_filter::setSourceModel(QAbstractItemModel *model)
+{
+  delete search;
+  search = nullptr;
+
+  library = qobject_cast<ui_library_model *>(model);
+  if(library)
+  {
+    // the worker only sees the registry of the library at the time of the request
+    auto const make_index = [library = library]
+    {
+      return [registry = library->get_registry()] { return ui_library_model::make_search_index(*registry); };
+    };
+    search = new ui_library_search(make_index(), this);
+    connect(search, &ui_library_search::result_changed, this, &ui_tree_filter::update_result);
+    connect(library, &ui_library_model::registry_changed, search, [=] { search->reset(make_index()); });
+  }
+
+  QSortFilterProxyModel::setSourceModel(model);
+}
+
+std::vector<int> ui_tree_filter::get_best_matches(size_t count) const
+{
+  if(!search)
+  {
+    return{};
+  }
+  auto &&best = search->get_best();
+  return{begin(best), begin(best) + std::min(count, best.size())};
+}
+
+void ui_tree_filter::set_query(QString const &query)
+{
+  if(!search)
+  {
+    setFilterWildcard(query);
+    return;
+  }
+
+  search->set_query(query);
+}
+
+void ui_tree_filter::update_result()
+{
+  // one reset is much cheaper than the row by row updates of invalidateFilter for large changes
+  beginResetModel();
+  filtered = !search->get_query().empty();
+  accepted.assign(filtered ? library->get_node_type_count() : 0, false);
+  for(auto entry : search->get_result())
+  {
+    if(entry < static_cast<int>(accepted.size()))
+    {
+      accepted[entry] = true;
+    }
+  }
+  endResetModel();
+
+  emit query_changed();
+}
+
+bool ui_tree_filter::is_filtered() const
+{
+  return filtered;
+}
+
+size_t ui_tree_filter::get_match_count() const
 {
+  return search ? search->get_result().size() : 0;
 }
 
 bool ui_tree_filter::filterAcceptsRow(int row, QModelIndex const &parent) const
 {
   auto model = sourceModel();
   auto index = model->index(row, 0, parent);
+
+  if(library)
+  {
+    auto &&entries = library->get_entries(index);
+    // until the result for a new registry arrives, its new entries are not accepted
+    return !filtered || std::any_of(begin(entries), end(entries), [&](int entry)
+    {
+      return (entry < static_cast<int>(accepted.size())) && accepted[entry];
+    });
+  }
+
   bool result{};
   if(model->hasChildren(index))
   {
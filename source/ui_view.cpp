@@ -1,7 +1,19 @@
+#include "ui_profiler.h"
 #include "ui_view.h"
 
+#include "QtCore/QElapsedTimer"
+#include "QtCore/QFileInfo"
 #include "QtCore/QMimeData"
 #include "QtGui/QDropEvent"
+#include "QtGui/QKeyEvent"
+#include "QtGui/QOpenGLContext"
+#include "QtGui/QPaintEvent"
+#include "QtGui/QSurfaceFormat"
+#include "QtWidgets/QOpenGLWidget"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
 
 namespace skadi
 {
@@ -11,11 +23,53 @@ namespace constants
   static QColor background_color(255, 255, 255);
   static QColor grid_color_fine(200, 200, 200);
   static QColor grid_color_coarse(130, 130, 130);
+  static int const opengl_samples = 4;
+  static qreal const grid_step_fine = 15;
+  static qreal const grid_step_coarse = 150;
+  static qreal const grid_spacing_min = 4;
+  static qreal const grid_spacing_faded = 12;
+
+  static QRectF const profiler_rect(10, 10, 320, 190);
+  static QColor const profiler_background_color(0, 0, 0, 180);
+  static QColor const profiler_text_color(255, 255, 255);
+  static QColor const profiler_bar_color(90, 200, 90);
+  static QColor const profiler_slow_bar_color(230, 80, 60);
+  static qreal const profiler_histogram_height = 50;
+  static qreal const profiler_budget = 16.7; // ms per frame at 60Hz
+  static int const profiler_histogram_frames = 150;
+  static int const profiler_average_frames = 30;
+  static char const *const profiler_file = "skadi_profile.json";
+}
+
+namespace
+{
+  QVector<QLineF> grid_lines(QRectF const &r, qreal step)
+  {
+    auto const left = static_cast<int64_t>(std::floor(r.left() / step));
+    auto const right = static_cast<int64_t>(std::ceil(r.right() / step));
+    auto const top = static_cast<int64_t>(std::floor(r.top() / step));
+    auto const bottom = static_cast<int64_t>(std::ceil(r.bottom() / step));
+
+    QVector<QLineF> lines;
+    lines.reserve(static_cast<int>((right - left) + (bottom - top) + 2));
+    for(auto x = left; x <= right; ++x)
+    {
+      lines.push_back(QLineF(x * step, top * step, x * step, bottom * step));
+    }
+    for(auto y = top; y <= bottom; ++y)
+    {
+      lines.push_back(QLineF(left * step, y * step, right * step, y * step));
+    }
+    return lines;
+  }
 }
 
 ui_view::ui_view(ui_scene *scene)
   : QGraphicsView(scene)
   , scene(scene)
+  , mode(render_mode::raster)
+  , update_mode(QGraphicsView::MinimalViewportUpdate)
+  , profile_file(constants::profiler_file)
 {
   qreal max = 50000;
   setSceneRect(-max, -max, 2 * max, 2 * max);
@@ -35,6 +89,56 @@ ui_view::ui_view(ui_scene *scene)
 
 ui_view::~ui_view() = default;
 
+render_mode ui_view::set_render_mode(render_mode new_mode)
+{
+  if(new_mode == mode)
+  {
+    return mode;
+  }
+
+  if(render_mode::opengl == new_mode)
+  {
+    // no profile or version requirements, so this also works on Mesa's llvmpipe
+    auto format = QSurfaceFormat::defaultFormat();
+    format.setSamples(constants::opengl_samples);
+
+    QOpenGLContext probe;
+    probe.setFormat(format);
+    if(!probe.create())
+    {
+      return mode;
+    }
+
+    auto gl_viewport = new QOpenGLWidget;
+    gl_viewport->setFormat(format);
+    setViewport(gl_viewport);
+
+    // the GL paint engine repaints the whole framebuffer anyway, so partial updates and a
+    // background pixmap only add overhead; multisampling replaces the antialiasing hint.
+    // nodes keep their device coordinate cache, so each one is drawn as a single texture.
+    update_mode = QGraphicsView::FullViewportUpdate;
+    setCacheMode(QGraphicsView::CacheNone);
+    setRenderHint(QPainter::Antialiasing, false);
+  }
+  else
+  {
+    setViewport(new QWidget);
+    update_mode = QGraphicsView::MinimalViewportUpdate;
+    setCacheMode(QGraphicsView::CacheBackground);
+    setRenderHint(QPainter::Antialiasing, true);
+  }
+
+  setViewportUpdateMode(update_mode);
+
+  mode = new_mode;
+  return mode;
+}
+
+render_mode ui_view::get_render_mode() const
+{
+  return mode;
+}
+
 void ui_view::dragEnterEvent(QDragEnterEvent *event)
 {
   if(event->mimeData()->formats().contains("application/x-skadinodetype"))
@@ -78,53 +182,170 @@ void ui_view::dropEvent(QDropEvent *event)
 
 void ui_view::drawBackground(QPainter *painter, QRectF const &r)
 {
+  ui_profiler::scoped_timer timer(ui_profiler::timer::background);
+
   QGraphicsView::drawBackground(painter, r);
 
-  auto drawGrid =
-    [&](double gridStep)
+  // spacing of the grid lines in pixels
+  auto const zoom = transform().m11();
+  auto const fine_spacing = constants::grid_step_fine * zoom;
+
+  // the fine grid fades out while zooming out instead of merging into grey
+  if(fine_spacing > constants::grid_spacing_min)
   {
-    QRect   windowRect = rect();
-    QPointF tl = mapToScene(windowRect.topLeft());
-    QPointF br = mapToScene(windowRect.bottomRight());
+    auto const alpha = std::min(1.0, (fine_spacing - constants::grid_spacing_min)
+                                     / (constants::grid_spacing_faded - constants::grid_spacing_min));
+    auto color = constants::grid_color_fine;
+    color.setAlphaF(alpha);
+    QPen pen(color, 0.0);
+    painter->setPen(pen);
+    painter->drawLines(grid_lines(r, constants::grid_step_fine));
+  }
 
-    double left   = std::floor(tl.x() / gridStep - 0.5);
-    double right  = std::floor(br.x() / gridStep + 1.0);
-    double bottom = std::floor(tl.y() / gridStep - 0.5);
-    double top    = std::floor (br.y() / gridStep + 1.0);
+  // the coarse grid switches to multiples of its step, so the number of lines stays bounded
+  auto coarse_step = constants::grid_step_coarse;
+  while(coarse_step * zoom < constants::grid_spacing_faded)
+  {
+    coarse_step *= constants::grid_step_coarse / constants::grid_step_fine;
+  }
+  QPen pen(constants::grid_color_coarse, 0.0);
+  painter->setPen(pen);
+  painter->drawLines(grid_lines(r, coarse_step));
+}
 
-    // vertical lines
-    for (int xi = int(left); xi <= int(right); ++xi)
-    {
-      QLineF line(xi * gridStep, bottom * gridStep,
-                  xi * gridStep, top * gridStep );
+void ui_view::drawForeground(QPainter *painter, QRectF const &r)
+{
+  QGraphicsView::drawForeground(painter, r);
 
-      painter->drawLine(line);
+  auto &&profiler = ui_profiler::instance();
+  if(!profiler.is_enabled())
+  {
+    return;
+  }
+
+  // the overlay shows the previous frames, the current one is still being painted
+  auto &&history = profiler.get_history();
+  auto const average_count = std::min<size_t>(history.size(), constants::profiler_average_frames);
+  ui_profiler::frame average{};
+  for(auto it = history.end() - static_cast<ptrdiff_t>(average_count); it != history.end(); ++it)
+  {
+    average.frame_time += it->frame_time / average_count;
+    average.frame_interval += it->frame_interval / average_count;
+    for(size_t i{}; i < average.timers.size(); ++i)
+    {
+      average.timers[i] += it->timers[i] / average_count;
     }
+    for(size_t i{}; i < average.counters.size(); ++i)
+    {
+      average.counters[i] += it->counters[i];
+    }
+  }
+
+  painter->save();
+  painter->resetTransform();
+  painter->setRenderHint(QPainter::Antialiasing, false);
+  painter->fillRect(constants::profiler_rect, constants::profiler_background_color);
 
-    // horizontal lines
-    for (int yi = int(bottom); yi <= int(top); ++yi)
+  QStringList lines;
+  lines << QString("frame %1 ms, %2 fps")
+           .arg(average.frame_time, 0, 'f', 2)
+           .arg((average.frame_interval > 0) ? 1000.0 / average.frame_interval : 0.0, 0, 'f', 1);
+  for(size_t i{}; i < average.timers.size(); ++i)
+  {
+    lines << QString("%1: %2 ms").arg(ui_profiler::name(static_cast<ui_profiler::timer>(i))).arg(average.timers[i], 0, 'f', 2);
+  }
+  for(size_t i{}; i < average.counters.size(); ++i)
+  {
+    auto const per_frame = average_count ? static_cast<double>(average.counters[i]) / average_count : 0.0;
+    lines << QString("%1: %2 / frame").arg(ui_profiler::name(static_cast<ui_profiler::counter>(i))).arg(per_frame, 0, 'f', 1);
+  }
+
+  auto const area = constants::profiler_rect.adjusted(8, 6, -8, -6);
+  painter->setPen(constants::profiler_text_color);
+  painter->drawText(area, Qt::AlignLeft | Qt::AlignTop, lines.join('\n'));
+
+  // histogram of the recent frame times, scaled to twice the frame budget
+  auto const histogram_count = std::min<size_t>(history.size(), constants::profiler_histogram_frames);
+  auto const bar_width = area.width() / constants::profiler_histogram_frames;
+  auto x = area.left();
+  for(auto it = history.end() - static_cast<ptrdiff_t>(histogram_count); it != history.end(); ++it)
+  {
+    auto const height = std::min(1.0, it->frame_time / (2 * constants::profiler_budget)) * constants::profiler_histogram_height;
+    auto const color = (it->frame_time > constants::profiler_budget) ? constants::profiler_slow_bar_color : constants::profiler_bar_color;
+    painter->fillRect(QRectF(x, area.bottom() - height, bar_width, height), color);
+    x += bar_width;
+  }
+
+  painter->restore();
+}
+
+void ui_view::keyPressEvent(QKeyEvent *event)
+{
+  if(event->key() == Qt::Key_F3)
+  {
+    set_profiler_enabled(!is_profiler_enabled());
+    event->accept();
+  }
+  else if((event->key() == Qt::Key_F4) && is_profiler_enabled())
+  {
+    // exceptions must not propagate through the event loop, the failure is reported instead
+    try
     {
-      QLineF line(left * gridStep, yi * gridStep,
-                  right * gridStep, yi * gridStep );
-      painter->drawLine(line);
+      ui_profiler::instance().save(profile_file.toStdString());
+      emit profile_saved(QString("profile saved to %1").arg(QFileInfo(profile_file).absoluteFilePath()));
     }
-  };
+    catch(std::runtime_error &e)
+    {
+      emit profile_saved(QString("saving the profile failed: %1").arg(e.what()));
+    }
+    event->accept();
+  }
+  else
+  {
+    QGraphicsView::keyPressEvent(event);
+  }
+}
 
-  QPen pfine(constants::grid_color_fine, 1.0);
+void ui_view::paintEvent(QPaintEvent *event)
+{
+  auto &&profiler = ui_profiler::instance();
+  auto const overlay = constants::profiler_rect.toAlignedRect();
+  // repaints of only the overlay are not frames of their own
+  if(!profiler.is_enabled() || overlay.contains(event->rect()))
+  {
+    QGraphicsView::paintEvent(event);
+    return;
+  }
 
-  painter->setPen(pfine);
-  drawGrid(15);
+  QElapsedTimer timer;
+  timer.start();
+  QGraphicsView::paintEvent(event);
+  profiler.end_frame(timer.nsecsElapsed() / 1e6);
 
-  QPen p(constants::grid_color_coarse, 1.0);
+  // partial updates may have left out the overlay, which shows this frame now
+  if(!event->region().contains(overlay))
+  {
+    viewport()->update(overlay);
+  }
+}
 
-  painter->setPen(p);
-  drawGrid(150);
+void ui_view::resizeEvent(QResizeEvent *event)
+{
+  QGraphicsView::resizeEvent(event);
+  update_visible_region();
+}
+
+void ui_view::scrollContentsBy(int dx, int dy)
+{
+  QGraphicsView::scrollContentsBy(dx, dy);
+  update_visible_region();
 }
 
 void ui_view::showEvent(QShowEvent *event)
 {
   scene->setSceneRect(this->rect());
   QGraphicsView::showEvent(event);
+  update_visible_region();
 }
 
 void ui_view::wheelEvent(QWheelEvent *event)
@@ -139,6 +360,44 @@ void ui_view::wheelEvent(QWheelEvent *event)
   {
     scale(inv_scaling, inv_scaling);
   }
+  update_visible_region();
+}
+
+void ui_view::set_profiler_enabled(bool enabled)
+{
+  ui_profiler::instance().set_enabled(enabled);
+
+  // the update mode stays, paintEvent repaints the overlay after each frame
+  if(enabled)
+  {
+    viewport()->update(constants::profiler_rect.toAlignedRect());
+  }
+  else
+  {
+    viewport()->update();
+  }
+}
+
+bool ui_view::is_profiler_enabled() const
+{
+  return ui_profiler::instance().is_enabled();
+}
+
+void ui_view::set_profile_file(QString file)
+{
+  profile_file = std::move(file);
+}
+
+QRectF ui_view::get_visible_region() const
+{
+  return mapToScene(viewport()->rect()).boundingRect();
+}
+
+void ui_view::update_visible_region()
+{
+  auto const visible = get_visible_region();
+  scene->set_visible_region(visible);
+  emit visible_region_changed(visible);
 }
 
 } // namespace skadi